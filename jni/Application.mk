@@ -1,2 +1,2 @@
 APP_ABI := armeabi armeabi-v7a
-APP_MODULES := autotalent
+APP_MODULES := autotalent autotalentd autotalent-loadgen
@@ -3,8 +3,12 @@ LOCAL_PATH := $(call my-dir)
 include $(CLEAR_VARS)
 
 LOCAL_MODULE := autotalent
-LOCAL_SRC_FILES := mayer_fft.c fft.c autotalent.c autotalent-interface.c
+LOCAL_SRC_FILES := mayer_fft.c fft.c autotalent.c autotalent-render.c \
+	autotalent-analysis.c autotalent-batch.c autotalent-stream.c \
+	autotalent-transport.c autotalent-engine.c autotalent-channels.c \
+	autotalent-harmony.c autotalent-interface.c
 LOCAL_C_INCLUDES := mayer_fft.h fft.h autotalent.h autotalent-interface.h
+LOCAL_CFLAGS := -ftree-vectorize
 LOCAL_STATIC_LIBRARIES := cpufeatures
 LOCAL_LDLIBS := -llog
 
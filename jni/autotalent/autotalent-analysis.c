@@ -0,0 +1,316 @@
+/* autotalent-analysis.c
+ * Autotalent library for Android
+ *
+ * Memory-mapped cache of the settings-independent analysis of a take.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+/*****************************************************************************/
+#include "autotalent.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define AT_ANALYSIS_MAGIC 0x4E415441	// "ATAN" when read back in the same byte order
+#define AT_ANALYSIS_VERSION 2
+#define AT_ANALYSIS_CHUNK 4096	// samples per call while writing
+
+// On-disk header; the tables follow at the given offsets
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t fs;
+	uint32_t cbsize;
+	uint32_t hop;
+	uint32_t ford;
+	uint32_t flags;
+	uint32_t reserved;
+	uint64_t length;
+	uint64_t nhops;
+	uint64_t checksum;	// hashTake of the take
+	uint64_t pitchoffset;
+	uint64_t formantoffset;	// 0 without AT_ANALYSIS_FORMANT
+	uint64_t latticeoffset;	// 0 without AT_ANALYSIS_FORMANT
+} AutotalentAnalysisHeader;
+
+#define AT_ANALYSIS_ALIGN(bytes) \
+	(((bytes) + AT_CACHE_LINE - 1) & ~(uint64_t)(AT_CACHE_LINE - 1))
+
+// FNV-1a over the samples of a take
+static uint64_t hashTake(const short *take, unsigned long length)
+{
+	unsigned long ti;
+	uint64_t hash;
+	uint16_t sample;
+
+	hash = 0xcbf29ce484222325ULL;
+	for (ti = 0; ti < length; ti++) {
+		sample = (uint16_t) take[ti];
+		hash = (hash ^ (sample & 0xff)) * 0x100000001b3ULL;
+		hash = (hash ^ (sample >> 8)) * 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+// Point analysis at the tables of the mapped file
+static void
+mapTables(AutotalentAnalysis * analysis, AutotalentAnalysisHeader * header)
+{
+	analysis->fs = header->fs;
+	analysis->cbsize = header->cbsize;
+	analysis->hop = header->hop;
+	analysis->ford = header->ford;
+	analysis->length = header->length;
+	analysis->nhops = header->nhops;
+	analysis->checksum = header->checksum;
+	analysis->pitch = (float *)((char *)analysis->map + header->pitchoffset);
+	analysis->formant = NULL;
+	analysis->lattice = NULL;
+	if (header->formantoffset != 0) {
+		analysis->formant =
+		    (float *)((char *)analysis->map + header->formantoffset);
+		analysis->lattice =
+		    (float *)((char *)analysis->map + header->latticeoffset);
+	}
+}
+
+// End of a table of count items of size bytes at offset, or 0 if it does
+// not start aligned at or after start or does not end within filesize
+//   Written so that no header value, however large, can overflow it.
+static uint64_t
+checkTable(uint64_t offset, uint64_t count, uint64_t size, uint64_t start,
+	   uint64_t filesize)
+{
+	if (offset < start || offset > filesize
+	    || (offset & (AT_CACHE_LINE - 1)) != 0
+	    || count > (filesize - offset) / size) {
+		return 0;
+	}
+	return offset + count * size;
+}
+
+// Tell whether the tables of a header all lie in a file of filesize
+// bytes, in order and without overlapping
+static int checkHeader(const AutotalentAnalysisHeader * header,
+		       uint64_t filesize)
+{
+	uint64_t end;
+
+	if (header->magic != AT_ANALYSIS_MAGIC
+	    || header->version != AT_ANALYSIS_VERSION
+	    || header->hop == 0
+	    || header->nhops != header->length / header->hop + 1) {
+		return -1;
+	}
+	end = checkTable(header->pitchoffset, header->nhops,
+			 2 * sizeof(float), sizeof(*header), filesize);
+	if (end == 0) {
+		return -1;
+	}
+	if (header->formantoffset == 0) {
+		return header->latticeoffset == 0 ? 0 : -1;
+	}
+	end = checkTable(header->formantoffset, header->length,
+			 ((uint64_t) header->ford + 1) * sizeof(float), end,
+			 filesize);
+	if (end == 0) {
+		return -1;
+	}
+	end = checkTable(header->latticeoffset,
+			 AT_LATTICE_SIZE((uint64_t) header->ford),
+			 sizeof(float), end, filesize);
+	return end == 0 ? -1 : 0;
+}
+
+// Analyze a take and write the result to a file at path
+//   Returns 0 on success.  The header is completed last, so a file left
+//   behind by a failed write is never accepted by openAutotalentAnalysis.
+int
+writeAutotalentAnalysis(const char *path, unsigned long sampleRate,
+			const short *take, unsigned long length, int flags)
+{
+	Autotalent *instance;
+	AutotalentAnalysis analysis;
+	AutotalentAnalysisHeader header;
+	short *discard;
+	unsigned long len;
+	unsigned long done;
+	int fd;
+	int result;
+
+	instance = instantiateAutotalent(sampleRate);
+	if (instance == NULL) {
+		return -1;
+	}
+	discard = allocAutotalentMemory(instance,
+					AT_ANALYSIS_CHUNK * sizeof(short));
+	if (discard == NULL) {
+		cleanupAutotalent(instance);
+		return -1;
+	}
+
+	memset(&header, 0, sizeof(header));
+	header.version = AT_ANALYSIS_VERSION;
+	header.fs = sampleRate;
+	header.cbsize = instance->cbsize;
+	header.hop = instance->cbsize / instance->noverlap;
+	header.ford = instance->ford;
+	header.flags = flags;
+	header.length = length;
+	header.nhops = length / header.hop + 1;
+	header.checksum = hashTake(take, length);
+	header.pitchoffset = AT_ANALYSIS_ALIGN(sizeof(header));
+	analysis.size = header.pitchoffset +
+	    AT_ANALYSIS_ALIGN(header.nhops * 2 * sizeof(float));
+	if (flags & AT_ANALYSIS_FORMANT) {
+		header.formantoffset = analysis.size;
+		analysis.size += AT_ANALYSIS_ALIGN((uint64_t) length *
+						   (header.ford +
+						    1) * sizeof(float));
+		header.latticeoffset = analysis.size;
+		analysis.size +=
+		    AT_ANALYSIS_ALIGN(AT_LATTICE_SIZE(header.ford) *
+				      sizeof(float));
+	}
+
+	result = -1;
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		goto out;
+	}
+	if (ftruncate(fd, analysis.size) != 0) {
+		close(fd);
+		goto out;
+	}
+	analysis.map = mmap(NULL, analysis.size, PROT_READ | PROT_WRITE,
+			    MAP_SHARED, fd, 0);
+	close(fd);
+	if (analysis.map == MAP_FAILED) {
+		goto out;
+	}
+	analysis.writable = 1;
+	mapTables(&analysis, &header);
+
+	// The formant lattice only runs while correction is on
+	if (flags & AT_ANALYSIS_FORMANT) {
+		setAutotalentParameter(instance, AT_PARAM_FCORR, 1);
+	}
+	setAutotalentAnalysis(instance, &analysis);
+	for (done = 0; done < length; done += len) {
+		len = length - done;
+		if (len > AT_ANALYSIS_CHUNK) {
+			len = AT_ANALYSIS_CHUNK;
+		}
+		setAutotalentBuffers(instance, (short *)take + done, discard);
+		runAutotalent(instance, len);
+	}
+
+	if (flags & AT_ANALYSIS_FORMANT) {
+		storeAutotalentLattice(instance, analysis.lattice);
+	}
+	header.magic = AT_ANALYSIS_MAGIC;
+	memcpy(analysis.map, &header, sizeof(header));
+	if (msync(analysis.map, analysis.size, MS_SYNC) == 0) {
+		result = 0;
+	}
+	munmap(analysis.map, analysis.size);
+
+ out:
+	freeAutotalentMemory(instance, discard);
+	cleanupAutotalent(instance);
+	return result;
+}
+
+// Map an analysis file read-only, shared with any other process using it
+AutotalentAnalysis *openAutotalentAnalysis(const char *path)
+{
+	AutotalentAnalysis *analysis;
+	AutotalentAnalysisHeader *header;
+	struct stat st;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return NULL;
+	}
+	if (fstat(fd, &st) != 0
+	    || (size_t)st.st_size < sizeof(AutotalentAnalysisHeader)) {
+		close(fd);
+		return NULL;
+	}
+	analysis = calloc(1, sizeof(AutotalentAnalysis));
+	if (analysis == NULL) {
+		close(fd);
+		return NULL;
+	}
+	analysis->size = st.st_size;
+	analysis->map = mmap(NULL, analysis->size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (analysis->map == MAP_FAILED) {
+		free(analysis);
+		return NULL;
+	}
+
+	header = analysis->map;
+	if (checkHeader(header, analysis->size) != 0) {
+		munmap(analysis->map, analysis->size);
+		free(analysis);
+		return NULL;
+	}
+	mapTables(analysis, header);
+	return analysis;
+}
+
+void closeAutotalentAnalysis(AutotalentAnalysis * analysis)
+{
+	if (analysis == NULL) {
+		return;
+	}
+	munmap(analysis->map, analysis->size);
+	free(analysis);
+}
+
+// Use analysis for the take the instance is processing, NULL to stop
+//   Returns -1 if it was made for another sample rate.
+int
+setAutotalentAnalysis(Autotalent * instance, AutotalentAnalysis * analysis)
+{
+	if (analysis != NULL && (analysis->fs != instance->fs
+				 || analysis->cbsize != instance->cbsize
+				 || analysis->hop !=
+				 instance->cbsize / instance->noverlap
+				 || analysis->ford != instance->ford)) {
+		return -1;
+	}
+	instance->analysis = analysis;
+	return 0;
+}
+
+// Tell whether analysis was made from this take
+//   Returns 0 if so, -1 if the take differs or is of another length.
+int
+checkAutotalentAnalysis(const AutotalentAnalysis * analysis, const short *take,
+			unsigned long length)
+{
+	if (analysis->length != length
+	    || analysis->checksum != hashTake(take, length)) {
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,169 @@
+/* autotalent-batch.c
+ * Autotalent library for Android
+ *
+ * Batches of runAutotalent calls, spread over a pool of worker threads.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+/*****************************************************************************/
+#include "autotalent.h"
+#include <stdlib.h>
+#include <pthread.h>
+
+struct AutotalentWorkers {
+	pthread_mutex_t lock;
+	pthread_cond_t start;	// workers wait here for a batch
+	pthread_cond_t finish;	// the caller waits here for the workers
+	pthread_mutex_t batch;	// held by the caller of the running batch
+	pthread_t *threads;
+	int nthreads;
+	int generation;		// batches handed out so far
+	int busy;		// workers still draining the current batch
+	int quit;
+	AutotalentJob *jobs;
+	int count;
+	volatile int next;	// next job to claim
+};
+
+static void runJob(AutotalentJob * job)
+{
+	setAutotalentBuffers(job->instance, job->input, job->output);
+	runAutotalent(job->instance, job->length);
+}
+
+// Claim and run jobs until the batch is exhausted
+static void drainJobs(AutotalentWorkers * workers)
+{
+	int i;
+
+	while ((i = __sync_fetch_and_add(&workers->next, 1)) < workers->count) {
+		runJob(&workers->jobs[i]);
+	}
+}
+
+static void *runWorker(void *arg)
+{
+	AutotalentWorkers *workers = arg;
+	int seen = 0;
+
+	// if this fails the worker borrows the scratch of the tables
+	prepareAutotalentThread(NULL);
+	pthread_mutex_lock(&workers->lock);
+	for (;;) {
+		while (!workers->quit && workers->generation == seen) {
+			pthread_cond_wait(&workers->start, &workers->lock);
+		}
+		if (workers->quit) {
+			break;
+		}
+		seen = workers->generation;
+		pthread_mutex_unlock(&workers->lock);
+		drainJobs(workers);
+		pthread_mutex_lock(&workers->lock);
+		if (--workers->busy == 0) {
+			pthread_cond_signal(&workers->finish);
+		}
+	}
+	pthread_mutex_unlock(&workers->lock);
+	return NULL;
+}
+
+AutotalentWorkers *createAutotalentWorkers(int threads)
+{
+	AutotalentWorkers *workers;
+	int i;
+
+	workers = calloc(1, sizeof(AutotalentWorkers));
+	if (workers == NULL) {
+		return NULL;
+	}
+	pthread_mutex_init(&workers->lock, NULL);
+	pthread_mutex_init(&workers->batch, NULL);
+	pthread_cond_init(&workers->start, NULL);
+	pthread_cond_init(&workers->finish, NULL);
+	if (threads > 0) {
+		workers->threads = calloc(threads, sizeof(pthread_t));
+		if (workers->threads == NULL) {
+			destroyAutotalentWorkers(workers);
+			return NULL;
+		}
+	}
+	for (i = 0; i < threads; i++) {
+		if (pthread_create(&workers->threads[i], NULL, runWorker,
+				   workers) != 0) {
+			break;
+		}
+		workers->nthreads++;
+	}
+	return workers;
+}
+
+void
+runAutotalentJobs(AutotalentWorkers * workers, AutotalentJob * jobs,
+		  int count)
+{
+	int i;
+
+	// run inline when there is nobody to share with, or when another
+	// caller already has the workers
+	if (workers == NULL || workers->nthreads == 0 || count < 2
+	    || pthread_mutex_trylock(&workers->batch) != 0) {
+		for (i = 0; i < count; i++) {
+			runJob(&jobs[i]);
+		}
+		return;
+	}
+	pthread_mutex_lock(&workers->lock);
+	workers->jobs = jobs;
+	workers->count = count;
+	workers->next = 0;
+	workers->busy = workers->nthreads;
+	workers->generation++;
+	pthread_cond_broadcast(&workers->start);
+	pthread_mutex_unlock(&workers->lock);
+
+	drainJobs(workers);
+
+	pthread_mutex_lock(&workers->lock);
+	while (workers->busy > 0) {
+		pthread_cond_wait(&workers->finish, &workers->lock);
+	}
+	workers->jobs = NULL;
+	workers->count = 0;
+	pthread_mutex_unlock(&workers->lock);
+	pthread_mutex_unlock(&workers->batch);
+}
+
+void destroyAutotalentWorkers(AutotalentWorkers * workers)
+{
+	int i;
+
+	if (workers == NULL) {
+		return;
+	}
+	pthread_mutex_lock(&workers->lock);
+	workers->quit = 1;
+	pthread_cond_broadcast(&workers->start);
+	pthread_mutex_unlock(&workers->lock);
+	for (i = 0; i < workers->nthreads; i++) {
+		pthread_join(workers->threads[i], NULL);
+	}
+	pthread_cond_destroy(&workers->finish);
+	pthread_cond_destroy(&workers->start);
+	pthread_mutex_destroy(&workers->batch);
+	pthread_mutex_destroy(&workers->lock);
+	free(workers->threads);
+	free(workers);
+}
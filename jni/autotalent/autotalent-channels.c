@@ -0,0 +1,352 @@
+/* autotalent-channels.c
+ * Autotalent library for Android
+ *
+ * Several channels of one performance corrected with a single pitch track.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+/*****************************************************************************/
+#include "autotalent.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define AT_CHANNEL_CHUNK 512	// samples downmixed at a time
+
+// One instance per channel, plus one for the downmix when there is no
+// key channel.  All of them hold the same parameters and are advanced
+// together, so their write positions and grain phases stay equal.
+struct AutotalentChannels {
+	Autotalent *channels[AT_CHANNELS_MAX];
+	int count;
+	Autotalent *key;	// pitch is estimated on this one only
+	int keychannel;		// index of key, or AT_CHANNELS_DOWNMIX
+	int flags;
+	AutotalentSettings plain;	// settings without formant correction
+	short *input[AT_CHANNELS_MAX];
+	short *output[AT_CHANNELS_MAX];
+	short downmix[AT_CHANNEL_CHUNK];
+	short discard[AT_CHANNEL_CHUNK];
+};
+
+static void destroyInstances(AutotalentChannels * channels)
+{
+	int ti;
+
+	for (ti = 0; ti < channels->count; ti++) {
+		cleanupAutotalent(channels->channels[ti]);
+	}
+	if (channels->keychannel == AT_CHANNELS_DOWNMIX) {
+		cleanupAutotalent(channels->key);
+	}
+}
+
+// Pitch is estimated on channel keyChannel, or on the average of all
+// channels for AT_CHANNELS_DOWNMIX.  With AT_CHANNELS_SHARE_FORMANT the
+// formant coefficients are also only adapted there, and every other
+// channel is filtered with them.
+AutotalentChannels *createAutotalentChannels(unsigned long SampleRate,
+					     int count, int keyChannel,
+					     int flags)
+{
+	AutotalentChannels *channels;
+	int ti;
+
+	if (count < 1 || count > AT_CHANNELS_MAX || keyChannel >= count
+	    || keyChannel < AT_CHANNELS_DOWNMIX) {
+		return NULL;
+	}
+	channels = calloc(1, sizeof(AutotalentChannels));
+	if (channels == NULL) {
+		return NULL;
+	}
+	channels->keychannel = keyChannel;
+	channels->flags = flags;
+	for (ti = 0; ti < count; ti++) {
+		channels->channels[ti] = instantiateAutotalent(SampleRate);
+		if (channels->channels[ti] == NULL) {
+			destroyInstances(channels);
+			free(channels);
+			return NULL;
+		}
+		channels->count++;
+	}
+	if (keyChannel == AT_CHANNELS_DOWNMIX) {
+		channels->key = instantiateAutotalent(SampleRate);
+		if (channels->key == NULL) {
+			destroyInstances(channels);
+			free(channels);
+			return NULL;
+		}
+	} else {
+		channels->key = channels->channels[keyChannel];
+	}
+	return channels;
+}
+
+void
+setAutotalentChannelsParameter(AutotalentChannels * channels, int param,
+			       float value)
+{
+	int ti;
+
+	for (ti = 0; ti < channels->count; ti++) {
+		setAutotalentParameter(channels->channels[ti], param, value);
+	}
+	if (channels->keychannel == AT_CHANNELS_DOWNMIX) {
+		setAutotalentParameter(channels->key, param, value);
+	}
+}
+
+void setAutotalentChannelsKey(AutotalentChannels * channels, char *keyPtr)
+{
+	int ti;
+
+	for (ti = 0; ti < channels->count; ti++) {
+		setAutotalentKey(channels->channels[ti], keyPtr);
+	}
+	if (channels->keychannel == AT_CHANNELS_DOWNMIX) {
+		setAutotalentKey(channels->key, keyPtr);
+	}
+}
+
+// Buffers of one channel; a channel outside the group is ignored
+void
+setAutotalentChannelBuffers(AutotalentChannels * channels, int channel,
+			    short *inputBuffer, short *outputBuffer)
+{
+	if (channel < 0 || channel >= channels->count) {
+		return;
+	}
+	channels->input[channel] = inputBuffer;
+	channels->output[channel] = outputBuffer;
+}
+
+// Average the channels into the key's input
+static void
+mixDown(AutotalentChannels * channels, short *const *input,
+	unsigned long SampleCount)
+{
+	unsigned long ti;
+	int sum;
+	int tc;
+
+	for (ti = 0; ti < SampleCount; ti++) {
+		sum = 0;
+		for (tc = 0; tc < channels->count; tc++) {
+			sum += input[tc][ti];
+		}
+		channels->downmix[ti] = (short)(sum / channels->count);
+	}
+}
+
+// Analyze a channel with the formant coefficients the key just adapted
+//   The lattice runs with the key's coefficient for each stage and
+//   sample, so the channel is whitened and later resynthesized by the
+//   same envelope; only the adaptation is skipped.
+static void
+analyzeShared(AutotalentChannels * channels, Autotalent * instance,
+	      unsigned long SampleCount)
+{
+	Autotalent *key = channels->key;
+	unsigned long N;
+	unsigned long ti;
+	unsigned long ti4;
+	long int ford;
+	long int k;
+	float tf;
+	float fa;
+	float fb;
+	float fc;
+	float flamb;
+
+	N = instance->cbsize;
+	ford = instance->ford;
+	flamb = instance->settings.flamb;
+	ti4 = instance->cbiwr;
+
+	// the coefficients this sub-block resynthesizes with
+	memcpy(instance->blkcoef, key->blkcoef,
+	       SampleCount * ford * sizeof(float));
+	analyzeAutotalentBlock(instance, &channels->plain, SampleCount);
+
+	for (ti = 0; ti < SampleCount; ti++) {
+		// highpass pre-emphasis filter feeds stage 0
+		tf = instance->blkin[ti];
+		fa = tf - instance->fhp;
+		fb = fa;
+		instance->fhp = tf;
+		for (k = 0; k < ford; k++) {
+			fc = (fb - instance->fc[k]) * flamb + instance->fb[k];
+			instance->fc[k] = fc;
+			instance->fb[k] = fb;
+			tf = key->fbuff[k][(ti4 + ti) % N];
+			fb = fc - (tf * fa);
+			fa = fa - (tf * fc);
+		}
+		instance->cbf[(ti4 + ti) % N] = fa;
+	}
+}
+
+// Give a channel the pitch the key estimated
+static void copyPitch(Autotalent * instance, const Autotalent * key)
+{
+	instance->inpitch = key->inpitch;
+	instance->conf = key->conf;
+	instance->outpitch = key->outpitch;
+	instance->lfophase = key->lfophase;
+	instance->inphinc = key->inphinc;
+	instance->outphinc = key->outphinc;
+	instance->phincfact = key->phincfact;
+}
+
+// The stages of processBlocks, each run once per channel except for the
+// pitch estimate and, when shared, the formant adaptation
+static void
+processChannels(AutotalentChannels * channels, short *const *input,
+		short *const *output, unsigned long SampleCount)
+{
+	Autotalent *key = channels->key;
+	Autotalent *instance;
+	const AutotalentSettings *s;
+	unsigned long done;
+	unsigned long len;
+	int share;
+	int hop;
+	int tc;
+
+	share = (channels->flags & AT_CHANNELS_SHARE_FORMANT) &&
+	    (key->settings.iKernel & AT_KERNEL_FORMANT);
+	for (done = 0; done < SampleCount; done += len) {
+		len = getAutotalentBlockLength(channels->channels[0],
+					       SampleCount - done, &hop);
+
+		// the key first, since the other channels may use its formants
+		if (channels->keychannel == AT_CHANNELS_DOWNMIX) {
+			convertAutotalentInput(key, channels->downmix + done,
+					       len);
+			analyzeAutotalentBlock(key, share ? &key->settings :
+					       &channels->plain, len);
+		} else {
+			convertAutotalentInput(key,
+					       input[channels->keychannel] +
+					       done, len);
+			analyzeAutotalentBlock(key, &key->settings, len);
+		}
+		for (tc = 0; tc < channels->count; tc++) {
+			instance = channels->channels[tc];
+			if (instance == key) {
+				continue;
+			}
+			convertAutotalentInput(instance, input[tc] + done, len);
+			if (share) {
+				analyzeShared(channels, instance, len);
+			} else {
+				analyzeAutotalentBlock(instance,
+						       &instance->settings,
+						       len);
+			}
+		}
+
+		for (tc = 0; tc < channels->count; tc++) {
+			shiftAutotalentBlock(channels->channels[tc], 0,
+					     hop ? len - 1 : len);
+		}
+		if (hop) {
+			estimateAutotalentPitch(key, &key->settings);
+			for (tc = 0; tc < channels->count; tc++) {
+				instance = channels->channels[tc];
+				if (instance != key) {
+					copyPitch(instance, key);
+				}
+				shiftAutotalentBlock(instance, len - 1, 1);
+			}
+		}
+		for (tc = 0; tc < channels->count; tc++) {
+			instance = channels->channels[tc];
+			s = &instance->settings;
+			resynthesizeAutotalentBlock(instance, s, len);
+			mixAutotalentOutput(instance, s, output[tc] + done,
+					    len);
+		}
+	}
+}
+
+// Run every channel over SampleCount samples of its buffers
+//   The channels only advance together, so nothing runs until each of
+//   them has been given both its buffers.
+void
+runAutotalentChannels(AutotalentChannels * channels, unsigned long SampleCount)
+{
+	Autotalent *key = channels->key;
+	short *input[AT_CHANNELS_MAX];
+	short *output[AT_CHANNELS_MAX];
+	unsigned long len;
+	int downmix;
+	int tc;
+
+	for (tc = 0; tc < channels->count; tc++) {
+		if (channels->input[tc] == NULL
+		    || channels->output[tc] == NULL) {
+			return;
+		}
+	}
+	downmix = channels->keychannel == AT_CHANNELS_DOWNMIX;
+	for (tc = 0; tc < channels->count; tc++) {
+		pollAutotalentParameters(channels->channels[tc]);
+		input[tc] = channels->input[tc];
+		output[tc] = channels->output[tc];
+	}
+	if (downmix) {
+		pollAutotalentParameters(key);
+	}
+	channels->plain = key->settings;
+	channels->plain.iKernel &= ~AT_KERNEL_FORMANT;
+
+	while (SampleCount > 0) {
+		len = SampleCount < AT_CHANNEL_CHUNK ?
+		    SampleCount : AT_CHANNEL_CHUNK;
+		if (downmix) {
+			mixDown(channels, input, len);
+		}
+		if (key->settings.iBypass) {
+			for (tc = 0; tc < channels->count; tc++) {
+				setAutotalentBuffers(channels->channels[tc],
+						     input[tc], output[tc]);
+				runAutotalent(channels->channels[tc], len);
+			}
+			if (downmix) {
+				setAutotalentBuffers(key, channels->downmix,
+						     channels->discard);
+				runAutotalent(key, len);
+			}
+		} else {
+			processChannels(channels, input, output, len);
+		}
+		for (tc = 0; tc < channels->count; tc++) {
+			input[tc] += len;
+			output[tc] += len;
+		}
+		SampleCount -= len;
+	}
+}
+
+void destroyAutotalentChannels(AutotalentChannels * channels)
+{
+	if (channels == NULL) {
+		return;
+	}
+	destroyInstances(channels);
+	free(channels);
+}
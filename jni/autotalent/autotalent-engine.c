@@ -0,0 +1,536 @@
+/* autotalent-engine.c
+ * Autotalent library for Android
+ *
+ * Many streams processed on a fixed pool of workers, earliest deadline
+ * first, with work stealing.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+/*****************************************************************************/
+#include "autotalent.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#define AT_ENGINE_BLOCKS 8	// blocks a stream can have queued
+#define AT_ENGINE_SLACK 1000000	// us, the deadline of a block without one
+
+// A submitted block, times in microseconds
+typedef struct {
+	short *input;
+	short *output;
+	unsigned long length;
+	unsigned long deadline;	// after submission, 0 for none
+	uint64_t submitted;
+	uint64_t due;		// when it has to be done by
+} EngineBlock;
+
+// One stream, on a line of its own
+//   The submitting thread advances head, the worker running the stream
+//   advances tail; scheduled is set while the stream sits in a queue or
+//   runs, so that only one worker has it at a time.  It is cleared under
+//   lock, which waitAutotalentEngineStream holds to check it.
+typedef struct {
+	Autotalent *instance;
+	EngineBlock blocks[AT_ENGINE_BLOCKS];
+	volatile unsigned long head;
+	volatile unsigned long tail;
+	volatile int scheduled;
+	int home;		// worker that last ran it, where it is queued
+	uint64_t due;		// of its oldest block, while queued
+	pthread_mutex_t lock;
+	pthread_cond_t idle;
+
+	// written by the worker running the stream only
+	unsigned long done;
+	unsigned long misses;
+	unsigned long migrations;
+	uint64_t totallatency;
+	unsigned long maxlatency;
+} EngineStream;
+
+// Ready streams of a worker, a heap by due time, on lines of its own
+//   The worker takes the stream due first; so does a thief, from the
+//   queue whose first stream is due first.  front is read without the
+//   lock to pick that queue, so a torn read only makes a poorer pick.
+//   sleeping is set while the worker waits on wake, kicked once a push
+//   has woken it.
+typedef struct {
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	EngineStream **items;
+	int count;
+	volatile uint64_t front;	// due time of items[0], UINT64_MAX if none
+	volatile int sleeping;
+	int kicked;
+} AT_LINE_ALIGNED EngineQueue;
+
+typedef struct {
+	AutotalentEngine *engine;
+	int index;
+	pthread_t thread;
+} EngineWorker;
+
+struct AutotalentEngine {
+	pthread_mutex_t lock;	// over the stream table only
+	EngineStream **streams;	// by id, NULL if free
+	int maxstreams;
+	EngineQueue *queues;	// one per worker
+	EngineWorker *workers;
+	int nworkers;
+	unsigned int next;	// home of the next stream added
+	volatile int sleepers;	// workers waiting for work
+	volatile int quit;
+};
+
+static uint64_t getMicroseconds(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Add a stream to a queue, under its lock
+static void insertStream(EngineQueue * queue, EngineStream * stream)
+{
+	int i = queue->count++;
+	int parent;
+
+	while (i > 0) {
+		parent = (i - 1) / 2;
+		if (queue->items[parent]->due <= stream->due) {
+			break;
+		}
+		queue->items[i] = queue->items[parent];
+		i = parent;
+	}
+	queue->items[i] = stream;
+	queue->front = queue->items[0]->due;
+}
+
+// Take the stream due first off a queue, under its lock
+static EngineStream *removeFirst(EngineQueue * queue)
+{
+	EngineStream *first;
+	EngineStream *last;
+	int child;
+	int i = 0;
+
+	if (queue->count == 0) {
+		return NULL;
+	}
+	first = queue->items[0];
+	last = queue->items[--queue->count];
+	for (;;) {
+		child = 2 * i + 1;
+		if (child >= queue->count) {
+			break;
+		}
+		if (child + 1 < queue->count
+		    && queue->items[child + 1]->due < queue->items[child]->due) {
+			child++;
+		}
+		if (last->due <= queue->items[child]->due) {
+			break;
+		}
+		queue->items[i] = queue->items[child];
+		i = child;
+	}
+	queue->items[i] = last;
+	queue->front = queue->count > 0 ? queue->items[0]->due : UINT64_MAX;
+	return first;
+}
+
+static EngineStream *popStream(EngineQueue * queue)
+{
+	EngineStream *stream;
+
+	pthread_mutex_lock(&queue->lock);
+	stream = removeFirst(queue);
+	pthread_mutex_unlock(&queue->lock);
+	return stream;
+}
+
+// Wake a sleeping worker to steal what its busy owner cannot run yet
+static void wakeIdle(AutotalentEngine * engine)
+{
+	EngineQueue *queue;
+	int woken;
+	int i;
+
+	for (i = 0; i < engine->nworkers; i++) {
+		queue = &engine->queues[i];
+		if (!queue->sleeping) {
+			continue;
+		}
+		pthread_mutex_lock(&queue->lock);
+		woken = queue->sleeping && !queue->kicked;
+		if (woken) {
+			queue->kicked = 1;
+			pthread_cond_signal(&queue->wake);
+		}
+		pthread_mutex_unlock(&queue->lock);
+		if (woken) {
+			return;
+		}
+	}
+}
+
+// Queue a scheduled stream on its home worker
+//   Only that worker's lock is taken, plus one more queue's when its
+//   owner is busy and some other worker is asleep.
+static void pushStream(AutotalentEngine * engine, EngineStream * stream)
+{
+	EngineQueue *queue = &engine->queues[stream->home];
+	int sleeping;
+
+	__sync_synchronize();
+	stream->due = stream->blocks[stream->tail % AT_ENGINE_BLOCKS].due;
+	pthread_mutex_lock(&queue->lock);
+	insertStream(queue, stream);
+	sleeping = queue->sleeping;
+	if (sleeping) {
+		queue->kicked = 1;
+		pthread_cond_signal(&queue->wake);
+	}
+	pthread_mutex_unlock(&queue->lock);
+	// against the count waitWork bumps before its last look
+	__sync_synchronize();
+	if (!sleeping && engine->sleepers > 0) {
+		wakeIdle(engine);
+	}
+}
+
+// Claim a ready stream, own queue first, then the most urgent elsewhere
+static EngineStream *takeStream(AutotalentEngine * engine, int self)
+{
+	EngineStream *stream;
+	uint64_t due = UINT64_MAX;
+	int victim = -1;
+	int i;
+
+	stream = popStream(&engine->queues[self]);
+	if (stream != NULL) {
+		return stream;
+	}
+	for (i = 1; i < engine->nworkers; i++) {
+		if (engine->queues[(self + i) % engine->nworkers].front < due) {
+			victim = (self + i) % engine->nworkers;
+			due = engine->queues[victim].front;
+		}
+	}
+	if (victim < 0) {
+		return NULL;
+	}
+	return popStream(&engine->queues[victim]);
+}
+
+// Sleep until a push wakes the worker; 0 once the engine quits
+//   The worker counts itself asleep before its last look at the queues,
+//   so that a push either sees the count or leaves a front seen here.
+static int waitWork(AutotalentEngine * engine, int self)
+{
+	EngineQueue *queue = &engine->queues[self];
+	int i;
+
+	pthread_mutex_lock(&queue->lock);
+	queue->sleeping = 1;
+	pthread_mutex_unlock(&queue->lock);
+	__sync_fetch_and_add(&engine->sleepers, 1);
+	for (i = 0; i < engine->nworkers; i++) {
+		if (engine->queues[i].front != UINT64_MAX) {
+			break;
+		}
+	}
+	pthread_mutex_lock(&queue->lock);
+	while (i == engine->nworkers && queue->count == 0 && !queue->kicked
+	       && !engine->quit) {
+		pthread_cond_wait(&queue->wake, &queue->lock);
+	}
+	queue->sleeping = 0;
+	queue->kicked = 0;
+	pthread_mutex_unlock(&queue->lock);
+	__sync_fetch_and_sub(&engine->sleepers, 1);
+	return !engine->quit;
+}
+
+// Run the oldest block of a stream, then requeue it or let it go idle
+static void runBlock(AutotalentEngine * engine, EngineStream * stream,
+		     int self)
+{
+	EngineBlock *block;
+	unsigned long latency;
+	uint64_t now;
+
+	if (stream->home != self) {
+		stream->migrations++;
+		stream->home = self;
+	}
+	__sync_synchronize();
+	block = &stream->blocks[stream->tail % AT_ENGINE_BLOCKS];
+	setAutotalentBuffers(stream->instance, block->input, block->output);
+	runAutotalent(stream->instance, block->length);
+	now = getMicroseconds();
+	latency = now - block->submitted;
+	stream->done++;
+	stream->totallatency += latency;
+	if (latency > stream->maxlatency) {
+		stream->maxlatency = latency;
+	}
+	if (block->deadline != 0 && now > block->due) {
+		stream->misses++;
+	}
+	__sync_synchronize();
+	stream->tail++;
+
+	if (stream->head != stream->tail) {
+		pushStream(engine, stream);
+		return;
+	}
+	pthread_mutex_lock(&stream->lock);
+	stream->scheduled = 0;
+	__sync_synchronize();
+	// a block submitted while scheduled was still set
+	if (stream->head != stream->tail
+	    && __sync_bool_compare_and_swap(&stream->scheduled, 0, 1)) {
+		pthread_mutex_unlock(&stream->lock);
+		pushStream(engine, stream);
+		return;
+	}
+	pthread_cond_broadcast(&stream->idle);
+	pthread_mutex_unlock(&stream->lock);
+}
+
+static void *runWorker(void *arg)
+{
+	EngineWorker *worker = arg;
+	AutotalentEngine *engine = worker->engine;
+	EngineStream *stream;
+
+	prepareAutotalentThread(NULL);
+	for (;;) {
+		stream = takeStream(engine, worker->index);
+		if (stream != NULL) {
+			runBlock(engine, stream, worker->index);
+		} else if (!waitWork(engine, worker->index)) {
+			return NULL;
+		}
+	}
+}
+
+AutotalentEngine *createAutotalentEngine(int threads, int maxStreams)
+{
+	AutotalentEngine *engine;
+	EngineQueue *queue;
+	int i;
+
+	if (threads < 1 || maxStreams < 1) {
+		return NULL;
+	}
+	engine = calloc(1, sizeof(AutotalentEngine));
+	if (engine == NULL) {
+		return NULL;
+	}
+	pthread_mutex_init(&engine->lock, NULL);
+	engine->maxstreams = maxStreams;
+	engine->streams = calloc(maxStreams, sizeof(EngineStream *));
+	engine->workers = calloc(threads, sizeof(EngineWorker));
+	if (posix_memalign((void **)&engine->queues, AT_CACHE_LINE,
+			   threads * sizeof(EngineQueue)) != 0) {
+		engine->queues = NULL;
+	}
+	if (engine->streams == NULL || engine->queues == NULL
+	    || engine->workers == NULL) {
+		destroyAutotalentEngine(engine);
+		return NULL;
+	}
+	memset(engine->queues, 0, threads * sizeof(EngineQueue));
+	for (i = 0; i < threads; i++) {
+		queue = &engine->queues[i];
+		queue->items = calloc(maxStreams, sizeof(EngineStream *));
+		if (queue->items == NULL) {
+			break;
+		}
+		queue->front = UINT64_MAX;
+		pthread_mutex_init(&queue->lock, NULL);
+		pthread_cond_init(&queue->wake, NULL);
+		engine->workers[i].engine = engine;
+		engine->workers[i].index = i;
+		if (pthread_create(&engine->workers[i].thread, NULL, runWorker,
+				   &engine->workers[i]) != 0) {
+			pthread_cond_destroy(&queue->wake);
+			pthread_mutex_destroy(&queue->lock);
+			free(queue->items);
+			break;
+		}
+		engine->nworkers++;
+	}
+	if (engine->nworkers == 0) {
+		destroyAutotalentEngine(engine);
+		return NULL;
+	}
+	return engine;
+}
+
+// Hand an instance to the engine, returning its stream id or -1 if full
+int addAutotalentEngineStream(AutotalentEngine * engine, Autotalent * instance)
+{
+	EngineStream *stream;
+	int id;
+
+	stream = allocAutotalentMemory(instance, sizeof(EngineStream));
+	if (stream == NULL) {
+		return -1;
+	}
+	stream->instance = instance;
+	pthread_mutex_init(&stream->lock, NULL);
+	pthread_cond_init(&stream->idle, NULL);
+	pthread_mutex_lock(&engine->lock);
+	for (id = 0; id < engine->maxstreams; id++) {
+		if (engine->streams[id] == NULL) {
+			break;
+		}
+	}
+	if (id == engine->maxstreams) {
+		pthread_mutex_unlock(&engine->lock);
+		pthread_cond_destroy(&stream->idle);
+		pthread_mutex_destroy(&stream->lock);
+		freeAutotalentMemory(instance, stream);
+		return -1;
+	}
+	// spread new streams over the workers
+	stream->home = engine->next++ % engine->nworkers;
+	engine->streams[id] = stream;
+	pthread_mutex_unlock(&engine->lock);
+	return id;
+}
+
+Autotalent *getAutotalentEngineInstance(AutotalentEngine * engine, int id)
+{
+	return engine->streams[id]->instance;
+}
+
+// Queue a block of a stream; 0 on success, -1 if its queue is full
+//   Blocks of a stream run in order, and streams in the order their
+//   oldest blocks fall due: deadline microseconds after submission, or
+//   AT_ENGINE_SLACK for a block without one.  Call from one thread per
+//   stream, and keep the buffers until waitAutotalentEngineStream says
+//   it is done.
+int
+submitAutotalentBlock(AutotalentEngine * engine, int id, short *input,
+		      short *output, unsigned long length,
+		      unsigned long deadline)
+{
+	EngineStream *stream = engine->streams[id];
+	EngineBlock *block;
+
+	if (stream->head - stream->tail == AT_ENGINE_BLOCKS) {
+		return -1;
+	}
+	block = &stream->blocks[stream->head % AT_ENGINE_BLOCKS];
+	block->input = input;
+	block->output = output;
+	block->length = length;
+	block->deadline = deadline;
+	block->submitted = getMicroseconds();
+	block->due = block->submitted + (deadline != 0 ? deadline :
+					 AT_ENGINE_SLACK);
+	__sync_synchronize();
+	stream->head++;
+	__sync_synchronize();
+	if (__sync_bool_compare_and_swap(&stream->scheduled, 0, 1)) {
+		pushStream(engine, stream);
+	}
+	return 0;
+}
+
+// Wait until every block submitted to a stream has been processed
+void waitAutotalentEngineStream(AutotalentEngine * engine, int id)
+{
+	EngineStream *stream = engine->streams[id];
+
+	pthread_mutex_lock(&stream->lock);
+	while (stream->head != stream->tail || stream->scheduled) {
+		pthread_cond_wait(&stream->idle, &stream->lock);
+	}
+	pthread_mutex_unlock(&stream->lock);
+}
+
+void
+getAutotalentEngineReport(AutotalentEngine * engine, int id,
+			  AutotalentEngineReport * report)
+{
+	EngineStream *stream = engine->streams[id];
+
+	report->blocks = stream->done;
+	report->misses = stream->misses;
+	report->migrations = stream->migrations;
+	report->meanlatency = 0;
+	if (stream->done > 0) {
+		report->meanlatency = stream->totallatency / stream->done;
+	}
+	report->maxlatency = stream->maxlatency;
+}
+
+// Take a stream out of the engine once it is idle, returning its instance
+Autotalent *removeAutotalentEngineStream(AutotalentEngine * engine, int id)
+{
+	EngineStream *stream = engine->streams[id];
+	Autotalent *instance = stream->instance;
+
+	waitAutotalentEngineStream(engine, id);
+	pthread_mutex_lock(&engine->lock);
+	engine->streams[id] = NULL;
+	pthread_mutex_unlock(&engine->lock);
+	pthread_cond_destroy(&stream->idle);
+	pthread_mutex_destroy(&stream->lock);
+	freeAutotalentMemory(instance, stream);
+	return instance;
+}
+
+// Stop the workers and clean up the instances still in the engine
+void destroyAutotalentEngine(AutotalentEngine * engine)
+{
+	int i;
+
+	if (engine == NULL) {
+		return;
+	}
+	for (i = 0; engine->streams != NULL && i < engine->maxstreams; i++) {
+		if (engine->streams[i] != NULL) {
+			cleanupAutotalent(removeAutotalentEngineStream(engine,
+								       i));
+		}
+	}
+	engine->quit = 1;
+	for (i = 0; i < engine->nworkers; i++) {
+		pthread_mutex_lock(&engine->queues[i].lock);
+		pthread_cond_signal(&engine->queues[i].wake);
+		pthread_mutex_unlock(&engine->queues[i].lock);
+	}
+	for (i = 0; i < engine->nworkers; i++) {
+		pthread_join(engine->workers[i].thread, NULL);
+		pthread_cond_destroy(&engine->queues[i].wake);
+		pthread_mutex_destroy(&engine->queues[i].lock);
+		free(engine->queues[i].items);
+	}
+	pthread_mutex_destroy(&engine->lock);
+	free(engine->workers);
+	free(engine->queues);
+	free(engine->streams);
+	free(engine);
+}
@@ -0,0 +1,272 @@
+/* autotalent-harmony.c
+ * Autotalent library for Android
+ *
+ * Several output voices from one input, analyzed once.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+/*****************************************************************************/
+#include "autotalent.h"
+#include <stdlib.h>
+#include <string.h>
+
+// The analysis instance takes the input; each voice is an instance of
+// its own for its parameters, pitch target, shifter and post-filter.  A
+// voice's input buffer is kept as a copy of the analysis residual.
+struct AutotalentHarmony {
+	Autotalent *analysis;
+	Autotalent *voices[AT_HARMONY_VOICES_MAX];
+	int count;
+	AutotalentSettings settings;	// of the analysis, with the dry delay
+	short *input;
+	short *output[AT_HARMONY_VOICES_MAX];
+};
+
+static void destroyInstances(AutotalentHarmony * harmony)
+{
+	int ti;
+
+	for (ti = 0; ti < harmony->count; ti++) {
+		cleanupAutotalent(harmony->voices[ti]);
+	}
+	cleanupAutotalent(harmony->analysis);
+}
+
+AutotalentHarmony *createAutotalentHarmony(unsigned long SampleRate,
+					   int voices)
+{
+	AutotalentHarmony *harmony;
+	int ti;
+
+	if (voices < 1 || voices > AT_HARMONY_VOICES_MAX) {
+		return NULL;
+	}
+	harmony = calloc(1, sizeof(AutotalentHarmony));
+	if (harmony == NULL) {
+		return NULL;
+	}
+	harmony->analysis = instantiateAutotalent(SampleRate);
+	if (harmony->analysis == NULL) {
+		free(harmony);
+		return NULL;
+	}
+	for (ti = 0; ti < voices; ti++) {
+		harmony->voices[ti] = instantiateAutotalent(SampleRate);
+		if (harmony->voices[ti] == NULL) {
+			destroyInstances(harmony);
+			free(harmony);
+			return NULL;
+		}
+		harmony->count++;
+	}
+	return harmony;
+}
+
+// Set a parameter of one voice
+//   Formant correction needs the shared analysis, so AT_PARAM_FCORR is
+//   set for every voice whichever one is given.
+void
+setAutotalentHarmonyParameter(AutotalentHarmony * harmony, int voice,
+			      int param, float value)
+{
+	int ti;
+
+	if (param != AT_PARAM_FCORR) {
+		setAutotalentParameter(harmony->voices[voice], param, value);
+		return;
+	}
+	setAutotalentParameter(harmony->analysis, param, value);
+	for (ti = 0; ti < harmony->count; ti++) {
+		setAutotalentParameter(harmony->voices[ti], param, value);
+	}
+}
+
+void
+setAutotalentHarmonyKey(AutotalentHarmony * harmony, int voice, char *keyPtr)
+{
+	setAutotalentKey(harmony->voices[voice], keyPtr);
+}
+
+// outputBuffers holds one buffer per voice
+void
+setAutotalentHarmonyBuffers(AutotalentHarmony * harmony, short *inputBuffer,
+			    short *const *outputBuffers)
+{
+	harmony->input = inputBuffer;
+	memcpy(harmony->output, outputBuffers,
+	       harmony->count * sizeof(short *));
+}
+
+// Give a voice what the analysis left for the sub-block just ingested
+static void
+ingestVoice(AutotalentHarmony * harmony, Autotalent * voice,
+	    unsigned long SampleCount)
+{
+	Autotalent *analysis = harmony->analysis;
+	const AutotalentSettings *s = &voice->settings;
+	unsigned long N;
+	unsigned long ti;
+	unsigned long ti4;
+
+	N = voice->cbsize;
+	ti4 = voice->cbiwr;
+	for (ti = 0; ti < SampleCount; ti++) {
+		voice->cbf[(ti4 + ti) % N] = analysis->cbf[(ti4 + ti) % N];
+	}
+	voice->cbiwr = analysis->cbiwr;
+	voice->position = analysis->position;
+
+	if ((s->iKernel & AT_KERNEL_FORMANT) && !s->iBypass) {
+		memcpy(voice->blkcoef, analysis->blkcoef,
+		       SampleCount * voice->ford * sizeof(float));
+	}
+	if ((s->iKernel & AT_KERNEL_MIX) && !s->iBypass) {
+		memcpy(voice->blkdry, analysis->blkdry,
+		       SampleCount * sizeof(float));
+	}
+}
+
+// As bypassBlocks: a bypassed voice is the delayed input
+static void
+bypassVoice(AutotalentHarmony * harmony, Autotalent * voice, short *output,
+	    unsigned long SampleCount)
+{
+	unsigned long N;
+	unsigned long ti;
+
+	N = voice->cbsize;
+	voice->fmute = 0;
+	for (ti = 0; ti < SampleCount; ti++) {
+		output[ti] =
+		    (short)(harmony->analysis->blkdry[ti] * FP_FACTOR);
+		voice->cbo[voice->cbord] = 0;
+		voice->cbord = (voice->cbord + 1) % N;
+	}
+}
+
+// Length of the next sub-block, cut for every voice
+//   Voices with different tuning reset their input phase at different
+//   samples, so the sub-block ends at the first voice's reset.
+static unsigned long
+getHarmonyBlockLength(AutotalentHarmony * harmony, unsigned long SampleCount,
+		      int *pHop)
+{
+	Autotalent *voice;
+	unsigned long hop;
+	unsigned long len;
+	unsigned long tlen;
+	int thop;
+	int ti;
+
+	hop = harmony->analysis->cbsize / harmony->analysis->noverlap;
+	len = hop - (harmony->analysis->cbiwr % hop);
+	*pHop = 1;
+	if (len > SampleCount) {
+		len = SampleCount;
+		*pHop = 0;
+	}
+	for (ti = 0; ti < harmony->count; ti++) {
+		voice = harmony->voices[ti];
+		if (voice->settings.iBypass) {
+			continue;
+		}
+		tlen = getAutotalentBlockLength(voice, len, &thop);
+		if (tlen < len || !thop) {
+			len = tlen;
+			*pHop = thop;
+		}
+	}
+	return len;
+}
+
+// Run every voice over SampleCount samples of the input
+void
+runAutotalentHarmony(AutotalentHarmony * harmony, unsigned long SampleCount)
+{
+	Autotalent *analysis = harmony->analysis;
+	Autotalent *voice;
+	const AutotalentSettings *s;
+	short *input;
+	short *output[AT_HARMONY_VOICES_MAX];
+	unsigned long done;
+	unsigned long len;
+	float period;
+	float conf;
+	int hop;
+	int ti;
+
+	pollAutotalentParameters(analysis);
+	for (ti = 0; ti < harmony->count; ti++) {
+		pollAutotalentParameters(harmony->voices[ti]);
+		output[ti] = harmony->output[ti];
+	}
+	// the dry delay is read once here for all the voices that mix
+	harmony->settings = analysis->settings;
+	harmony->settings.iKernel |= AT_KERNEL_MIX;
+
+	input = harmony->input;
+	for (done = 0; done < SampleCount; done += len) {
+		len = getHarmonyBlockLength(harmony, SampleCount - done, &hop);
+
+		convertAutotalentInput(analysis, input + done, len);
+		analyzeAutotalentBlock(analysis, &harmony->settings, len);
+		for (ti = 0; ti < harmony->count; ti++) {
+			voice = harmony->voices[ti];
+			ingestVoice(harmony, voice, len);
+			if (!voice->settings.iBypass) {
+				shiftAutotalentBlock(voice, 0,
+						     hop ? len - 1 : len);
+			}
+		}
+
+		if (hop && measureAutotalentPitch(analysis, &period,
+						  &conf) == 0) {
+			// kept, as the next measurement starts from it
+			analysis->conf = conf;
+			for (ti = 0; ti < harmony->count; ti++) {
+				voice = harmony->voices[ti];
+				if (!voice->settings.iBypass) {
+					targetAutotalentPitch(voice,
+							      &voice->settings,
+							      period, conf);
+				}
+			}
+		}
+
+		for (ti = 0; ti < harmony->count; ti++) {
+			voice = harmony->voices[ti];
+			s = &voice->settings;
+			if (s->iBypass) {
+				bypassVoice(harmony, voice, output[ti] + done,
+					    len);
+				continue;
+			}
+			if (hop) {
+				shiftAutotalentBlock(voice, len - 1, 1);
+			}
+			resynthesizeAutotalentBlock(voice, s, len);
+			mixAutotalentOutput(voice, s, output[ti] + done, len);
+		}
+	}
+}
+
+void destroyAutotalentHarmony(AutotalentHarmony * harmony)
+{
+	if (harmony == NULL) {
+		return;
+	}
+	destroyInstances(harmony);
+	free(harmony);
+}
@@ -21,15 +21,73 @@
 #include "autotalent-interface.h"
 #include "autotalent.h"
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdio.h>
+#include <pthread.h>
 #include <android/log.h>
 #include <cpu-features.h>
 
 #define MAX_SHORT 32767
 #define MIN_SHORT -32768
+#define AT_BATCH_JOBS 32	// jobs whose arrays are pinned at once
+#define AT_HANDLE_BUFFERS 8	// buffers createBuffer can hand out per handle
+
+// What a Java object holds on to
+//   The addresses of the direct buffers given to setBuffers are resolved
+//   once and kept here, so processBuffers makes no JNI calls at all.
+typedef struct {
+	Autotalent *instance;
+	short *input;		// direct buffers set with setBuffers
+	short *instrumental;	// or NULL if nothing is mixed in
+	short *output;
+	unsigned long capacity;	// samples in the smallest of them
+	void *buffers[AT_HANDLE_BUFFERS];	// handed out by createBuffer
+	int nbuffers;
+	AutotalentStream *stream;	// engine thread, while started
+} AutotalentHandle;
+
+// shared by every processBatch call, one thread per extra core
+static AutotalentWorkers *workers;
+static pthread_once_t workersOnce = PTHREAD_ONCE_INIT;
+
+// Every native takes the handle returned by instantiateAutotalent, so each
+// Java object drives its own instance and separate objects can be processed
+// concurrently from separate threads.
+static AutotalentHandle *getHandle(jlong handle)
+{
+	AutotalentHandle *h = (AutotalentHandle *)(intptr_t)handle;
+
+	if (h == NULL) {
+		__android_log_print(ANDROID_LOG_DEBUG, "libautotalent.so",
+				    "No suitable autotalent instance found!");
+	}
+	return h;
+}
+
+static Autotalent *getInstance(jlong handle)
+{
+	AutotalentHandle *h = getHandle(handle);
+
+	return h != NULL ? h->instance : NULL;
+}
 
-static Autotalent *instance;
+// The instance of a handle for processing on the calling thread, NULL
+// while the stream thread of the handle is rendering it
+static Autotalent *getIdleInstance(jlong handle)
+{
+	AutotalentHandle *h = getHandle(handle);
+
+	if (h == NULL || h->stream != NULL) {
+		return NULL;
+	}
+	return h->instance;
+}
+
+static void createWorkers(void)
+{
+	workers = createAutotalentWorkers(android_getCpuCount() - 1);
+}
 
 static void mixBuffers(short *out, short *buf1, short *buf2, int len)
 {
@@ -54,7 +112,7 @@ Java_net_sourceforge_autotalent_Autotalent_getLiveCorrectionEnabled(JNIEnv *
 		ANDROID_CPU_ARM_FEATURE_ARMv7);
 }
 
-JNIEXPORT void JNICALL
+JNIEXPORT jlong JNICALL
 Java_net_sourceforge_autotalent_Autotalent_instantiateAutotalent(JNIEnv *
 								 env,
 								 jclass
@@ -62,239 +120,213 @@ Java_net_sourceforge_autotalent_Autotalent_instantiateAutotalent(JNIEnv *
 								 jint
 								 sampleRate)
 {
-	if (instance == NULL) {
-		instance = instantiateAutotalent(sampleRate);
-		__android_log_print(ANDROID_LOG_DEBUG, "libautotalent.so",
-				    "instantiated autotalent with sample rate: %d",
-				    sampleRate);
+	Autotalent *inst;
+	AutotalentHandle *h;
+
+	inst = instantiateAutotalent(sampleRate);
+	if (inst == NULL) {
+		return 0;
 	}
+	h = allocAutotalentMemory(inst, sizeof(AutotalentHandle));
+	if (h == NULL) {
+		cleanupAutotalent(inst);
+		return 0;
+	}
+	h->instance = inst;
+	__android_log_print(ANDROID_LOG_DEBUG, "libautotalent.so",
+			    "instantiated autotalent %p with sample rate: %d",
+			    inst, sampleRate);
+	return (jlong)(intptr_t)h;
 }
 
 JNIEXPORT void JNICALL Java_net_sourceforge_autotalent_Autotalent_setConcertA
-    (JNIEnv * env, jclass class, jfloat concertA) {
-	if (instance != NULL) {
-		*(instance->m_pfTune) = (float)concertA;
-	} else {
-		__android_log_print(ANDROID_LOG_DEBUG, "libautotalent.so",
-				    "No suitable autotalent instance found!");
+    (JNIEnv * env, jclass class, jlong handle, jfloat concertA) {
+	Autotalent *inst = getInstance(handle);
+
+	if (inst != NULL) {
+		setAutotalentParameter(inst, AT_PARAM_TUNE, (float)concertA);
 	}
 }
 
 JNIEXPORT void JNICALL Java_net_sourceforge_autotalent_Autotalent_setKey
-    (JNIEnv * env, jclass class, jchar key) {
-	if (instance != NULL) {
-		setAutotalentKey(instance, (char *)&key);
-	} else {
-		__android_log_print(ANDROID_LOG_DEBUG, "libautotalent.so",
-				    "No suitable autotalent instance found!");
+    (JNIEnv * env, jclass class, jlong handle, jchar key) {
+	Autotalent *inst = getInstance(handle);
+
+	if (inst != NULL) {
+		setAutotalentKey(inst, (char *)&key);
 	}
 }
 
 JNIEXPORT void JNICALL Java_net_sourceforge_autotalent_Autotalent_setFixedPitch
-    (JNIEnv * env, jclass class, jfloat fixed) {
-	if (instance != NULL) {
-		*(instance->m_pfFixed) = (float)fixed;
-	} else {
-		__android_log_print(ANDROID_LOG_DEBUG, "libautotalent.so",
-				    "No suitable autotalent instance found!");
+    (JNIEnv * env, jclass class, jlong handle, jfloat fixed) {
+	Autotalent *inst = getInstance(handle);
+
+	if (inst != NULL) {
+		setAutotalentParameter(inst, AT_PARAM_FIXED, (float)fixed);
 	}
 }
 
 JNIEXPORT void JNICALL Java_net_sourceforge_autotalent_Autotalent_setFixedPull
-    (JNIEnv * env, jclass class, jfloat pull) {
-	if (instance != NULL) {
-		*(instance->m_pfPull) = (float)pull;
-	} else {
-		__android_log_print(ANDROID_LOG_DEBUG, "libautotalent.so",
-				    "No suitable autotalent instance found!");
+    (JNIEnv * env, jclass class, jlong handle, jfloat pull) {
+	Autotalent *inst = getInstance(handle);
+
+	if (inst != NULL) {
+		setAutotalentParameter(inst, AT_PARAM_PULL, (float)pull);
 	}
 }
 
 JNIEXPORT void JNICALL
-Java_net_sourceforge_autotalent_Autotalent_setCorrectionStrength(JNIEnv *
-								 env,
-								 jclass
-								 class,
-								 jfloat
-								 strength)
-{
-	if (instance != NULL) {
-		*(instance->m_pfAmount) = (float)strength;
-	} else {
-		__android_log_print(ANDROID_LOG_DEBUG, "libautotalent.so",
-				    "No suitable autotalent instance found!");
+    Java_net_sourceforge_autotalent_Autotalent_setCorrectionStrength
+    (JNIEnv * env, jclass class, jlong handle, jfloat strength) {
+	Autotalent *inst = getInstance(handle);
+
+	if (inst != NULL) {
+		setAutotalentParameter(inst, AT_PARAM_AMOUNT, (float)strength);
 	}
 }
 
 JNIEXPORT void JNICALL
-Java_net_sourceforge_autotalent_Autotalent_setCorrectionSmoothness(JNIEnv *
-								   env,
-								   jclass
-								   class,
-								   jfloat
-								   smooth)
-{
-	if (instance != NULL) {
-		*(instance->m_pfSmooth) = (float)smooth;
-	} else {
-		__android_log_print(ANDROID_LOG_DEBUG, "libautotalent.so",
-				    "No suitable autotalent instance found!");
+    Java_net_sourceforge_autotalent_Autotalent_setCorrectionSmoothness
+    (JNIEnv * env, jclass class, jlong handle, jfloat smooth) {
+	Autotalent *inst = getInstance(handle);
+
+	if (inst != NULL) {
+		setAutotalentParameter(inst, AT_PARAM_SMOOTH, (float)smooth);
 	}
 }
 
 JNIEXPORT void JNICALL Java_net_sourceforge_autotalent_Autotalent_setPitchShift
-    (JNIEnv * env, jclass class, jfloat shift) {
-	if (instance != NULL) {
-		*(instance->m_pfShift) = (float)shift;
-	} else {
-		__android_log_print(ANDROID_LOG_DEBUG, "libautotalent.so",
-				    "No suitable autotalent instance found!");
+    (JNIEnv * env, jclass class, jlong handle, jfloat shift) {
+	Autotalent *inst = getInstance(handle);
+
+	if (inst != NULL) {
+		setAutotalentParameter(inst, AT_PARAM_SHIFT, (float)shift);
 	}
 }
 
 JNIEXPORT void JNICALL Java_net_sourceforge_autotalent_Autotalent_setScaleRotate
-    (JNIEnv * env, jclass class, jint rotate) {
-	if (instance != NULL) {
-		*(instance->m_pfScwarp) = (int)rotate;
-	} else {
-		__android_log_print(ANDROID_LOG_DEBUG, "libautotalent.so",
-				    "No suitable autotalent instance found!");
+    (JNIEnv * env, jclass class, jlong handle, jint rotate) {
+	Autotalent *inst = getInstance(handle);
+
+	if (inst != NULL) {
+		setAutotalentParameter(inst, AT_PARAM_SCWARP, (float)rotate);
 	}
 }
 
 JNIEXPORT void JNICALL Java_net_sourceforge_autotalent_Autotalent_setLfoDepth
-    (JNIEnv * env, jclass class, jfloat depth) {
-	if (instance != NULL) {
-		*(instance->m_pfLfoamp) = (float)depth;
-	} else {
-		__android_log_print(ANDROID_LOG_DEBUG, "libautotalent.so",
-				    "No suitable autotalent instance found!");
+    (JNIEnv * env, jclass class, jlong handle, jfloat depth) {
+	Autotalent *inst = getInstance(handle);
+
+	if (inst != NULL) {
+		setAutotalentParameter(inst, AT_PARAM_LFOAMP, (float)depth);
 	}
 }
 
 JNIEXPORT void JNICALL Java_net_sourceforge_autotalent_Autotalent_setLfoRate
-    (JNIEnv * env, jclass class, jfloat rate) {
-	if (instance != NULL) {
-		*(instance->m_pfLforate) = (float)rate;
-	} else {
-		__android_log_print(ANDROID_LOG_DEBUG, "libautotalent.so",
-				    "No suitable autotalent instance found!");
+    (JNIEnv * env, jclass class, jlong handle, jfloat rate) {
+	Autotalent *inst = getInstance(handle);
+
+	if (inst != NULL) {
+		setAutotalentParameter(inst, AT_PARAM_LFORATE, (float)rate);
 	}
 }
 
 JNIEXPORT void JNICALL Java_net_sourceforge_autotalent_Autotalent_setLfoShape
-    (JNIEnv * env, jclass class, jfloat shape) {
-	if (instance != NULL) {
-		*(instance->m_pfLfoshape) = (float)shape;
-	} else {
-		__android_log_print(ANDROID_LOG_DEBUG, "libautotalent.so",
-				    "No suitable autotalent instance found!");
+    (JNIEnv * env, jclass class, jlong handle, jfloat shape) {
+	Autotalent *inst = getInstance(handle);
+
+	if (inst != NULL) {
+		setAutotalentParameter(inst, AT_PARAM_LFOSHAPE, (float)shape);
 	}
 }
 
 JNIEXPORT void JNICALL
-Java_net_sourceforge_autotalent_Autotalent_setLfoSymmetric(JNIEnv * env,
-							   jclass class,
-							   jfloat symmetric)
-{
-	if (instance != NULL) {
-		*(instance->m_pfLfosymm) = (float)symmetric;
-	} else {
-		__android_log_print(ANDROID_LOG_DEBUG, "libautotalent.so",
-				    "No suitable autotalent instance found!");
+    Java_net_sourceforge_autotalent_Autotalent_setLfoSymmetric
+    (JNIEnv * env, jclass class, jlong handle, jfloat symmetric) {
+	Autotalent *inst = getInstance(handle);
+
+	if (inst != NULL) {
+		setAutotalentParameter(inst, AT_PARAM_LFOSYMM,
+				       (float)symmetric);
 	}
 }
 
 JNIEXPORT void JNICALL
-Java_net_sourceforge_autotalent_Autotalent_setLfoQuantization(JNIEnv * env,
-							      jclass class,
-							      jint quantization)
-{
-	if (instance != NULL) {
-		*(instance->m_pfLfoquant) = (int)quantization;
-	} else {
-		__android_log_print(ANDROID_LOG_DEBUG, "libautotalent.so",
-				    "No suitable autotalent instance found!");
+    Java_net_sourceforge_autotalent_Autotalent_setLfoQuantization
+    (JNIEnv * env, jclass class, jlong handle, jint quantization) {
+	Autotalent *inst = getInstance(handle);
+
+	if (inst != NULL) {
+		setAutotalentParameter(inst, AT_PARAM_LFOQUANT,
+				       (float)quantization);
 	}
 }
 
 JNIEXPORT void JNICALL
-Java_net_sourceforge_autotalent_Autotalent_setFormantCorrection(JNIEnv *
-								env,
-								jclass
-								class,
-								jint correction)
-{
-	if (instance != NULL) {
-		*(instance->m_pfFcorr) = (int)correction;
-	} else {
-		__android_log_print(ANDROID_LOG_DEBUG, "libautotalent.so",
-				    "No suitable autotalent instance found!");
+    Java_net_sourceforge_autotalent_Autotalent_setFormantCorrection
+    (JNIEnv * env, jclass class, jlong handle, jint correction) {
+	Autotalent *inst = getInstance(handle);
+
+	if (inst != NULL) {
+		setAutotalentParameter(inst, AT_PARAM_FCORR, (float)correction);
 	}
 }
 
 JNIEXPORT void JNICALL Java_net_sourceforge_autotalent_Autotalent_setFormantWarp
-    (JNIEnv * env, jclass class, jfloat warp) {
-	if (instance != NULL) {
-		*(instance->m_pfFwarp) = (float)warp;
-	} else {
-		__android_log_print(ANDROID_LOG_DEBUG, "libautotalent.so",
-				    "No suitable autotalent instance found!");
+    (JNIEnv * env, jclass class, jlong handle, jfloat warp) {
+	Autotalent *inst = getInstance(handle);
+
+	if (inst != NULL) {
+		setAutotalentParameter(inst, AT_PARAM_FWARP, (float)warp);
 	}
 }
 
 JNIEXPORT void JNICALL Java_net_sourceforge_autotalent_Autotalent_setMix
-    (JNIEnv * env, jclass class, jfloat mix) {
-	if (instance != NULL) {
-		*(instance->m_pfMix) = (float)mix;
-	} else {
-		__android_log_print(ANDROID_LOG_DEBUG, "libautotalent.so",
-				    "No suitable autotalent instance found!");
+    (JNIEnv * env, jclass class, jlong handle, jfloat mix) {
+	Autotalent *inst = getInstance(handle);
+
+	if (inst != NULL) {
+		setAutotalentParameter(inst, AT_PARAM_MIX, (float)mix);
 	}
 }
 
 JNIEXPORT void JNICALL
-Java_net_sourceforge_autotalent_Autotalent_processSamples___3SI(JNIEnv *
-								env,
-								jclass
-								class,
-								jshortArray
-								samples,
-								jint numSamples)
-{
-	if (instance != NULL) {
+    Java_net_sourceforge_autotalent_Autotalent_processSamples__J_3SI
+    (JNIEnv * env, jclass class, jlong handle, jshortArray samples,
+     jint numSamples) {
+	Autotalent *inst = getIdleInstance(handle);
+
+	if (inst != NULL) {
 		// copy buffers
 		short *samplebuf =
 		    (short *)(*env)->GetPrimitiveArrayCritical(env, samples, 0);
 
-		setAutotalentBuffers(instance, samplebuf, samplebuf);
+		setAutotalentBuffers(inst, samplebuf, samplebuf);
 
 		// process samples
-		runAutotalent(instance, numSamples);
+		runAutotalent(inst, numSamples);
 
 		// copy results back up to java array
 		(*env)->ReleasePrimitiveArrayCritical(env, samples, samplebuf,
 						      0);
-
-	} else {
-		__android_log_print(ANDROID_LOG_DEBUG, "libautotalent.so",
-				    "No suitable autotalent instance found!");
 	}
 }
 
 JNIEXPORT void JNICALL
-    Java_net_sourceforge_autotalent_Autotalent_processSamples___3S_3SI
-    (JNIEnv * env, jclass class, jshortArray samples, jshortArray instrumental,
-     jint numSamples) {
-	if (instance != NULL) {
+    Java_net_sourceforge_autotalent_Autotalent_processSamples__J_3S_3SI
+    (JNIEnv * env, jclass class, jlong handle, jshortArray samples,
+     jshortArray instrumental, jint numSamples) {
+	Autotalent *inst = getIdleInstance(handle);
+
+	if (inst != NULL) {
 		short *samplebuf, *instrumentalbuf;
 
 		samplebuf =
 		    (short *)(*env)->GetPrimitiveArrayCritical(env, samples, 0);
-		setAutotalentBuffers(instance, samplebuf, samplebuf);
+		setAutotalentBuffers(inst, samplebuf, samplebuf);
 
 		// process samples
-		runAutotalent(instance, numSamples);
+		runAutotalent(inst, numSamples);
 
 		// mix instrumental samples with tuned recorded samples
 		instrumentalbuf =
@@ -307,20 +339,340 @@ JNIEXPORT void JNICALL
 		// copy results back up to java array
 		(*env)->ReleasePrimitiveArrayCritical(env, samples, samplebuf,
 						      0);
-	} else {
-		__android_log_print(ANDROID_LOG_DEBUG, "libautotalent.so",
-				    "No suitable autotalent instance found!");
 	}
 }
 
+static void
+pinArrays(JNIEnv * env, jshortArray * arrays, short **bufs, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		bufs[i] = NULL;
+		if (arrays[i] != NULL) {
+			bufs[i] = (short *)
+			    (*env)->GetPrimitiveArrayCritical(env, arrays[i], 0);
+		}
+	}
+}
+
+static void
+releaseArrays(JNIEnv * env, jshortArray * arrays, short **bufs, int count)
+{
+	int i;
+
+	// in the reverse order of pinArrays
+	for (i = count - 1; i >= 0; i--) {
+		if (bufs[i] != NULL) {
+			(*env)->ReleasePrimitiveArrayCritical(env, arrays[i],
+							      bufs[i], 0);
+		}
+	}
+}
+
+static void throwIllegalArgument(JNIEnv * env, const char *message)
+{
+	jclass class;
+
+	class = (*env)->FindClass(env, "java/lang/IllegalArgumentException");
+	if (class != NULL) {
+		(*env)->ThrowNew(env, class, message);
+	}
+}
+
+// Check one chunk of a batch before anything is pinned
+//   Returns 0, or -1 with an exception pending.  Two jobs on one instance,
+//   or a job on an instance with a stream running, would run it on two
+//   threads at once.
+static int
+checkBatch(JNIEnv * env, jshortArray * arrays, const jlong * handlebuf,
+	   const jint * lengthbuf, int count)
+{
+	int i, j;
+
+	for (i = 0; i < count; i++) {
+		if (handlebuf[i] == 0) {
+			continue;
+		}
+		if (getHandle(handlebuf[i])->stream != NULL) {
+			throwIllegalArgument(env, "instance is streaming");
+			return -1;
+		}
+		if (arrays[i] == NULL || lengthbuf[i] < 0
+		    || lengthbuf[i] > (*env)->GetArrayLength(env, arrays[i])) {
+			throwIllegalArgument(env, "samples too short");
+			return -1;
+		}
+		for (j = 0; j < i; j++) {
+			if (handlebuf[j] == handlebuf[i]) {
+				throwIllegalArgument(env,
+						     "instance given twice");
+				return -1;
+			}
+		}
+	}
+	return 0;
+}
+
+// Run many instances in one transition, each buffer processed in place
+//   Arrays are pinned a chunk at a time, and the jobs of a chunk are spread
+//   over the workers.  Invalid arguments throw IllegalArgumentException,
+//   leaving the chunks before the bad one processed.
+JNIEXPORT void JNICALL
+    Java_net_sourceforge_autotalent_Autotalent_processBatch
+    (JNIEnv * env, jclass class, jlongArray handles, jobjectArray samples,
+     jintArray numSamples, jint count) {
+	AutotalentJob jobs[AT_BATCH_JOBS];
+	jshortArray arrays[AT_BATCH_JOBS];
+	short *bufs[AT_BATCH_JOBS];
+	jlong handlebuf[AT_BATCH_JOBS];
+	jint lengthbuf[AT_BATCH_JOBS];
+	AutotalentHandle *h;
+	int first, n, njobs, i;
+
+	pthread_once(&workersOnce, createWorkers);
+	for (first = 0; first < count; first += n) {
+		n = count - first;
+		if (n > AT_BATCH_JOBS) {
+			n = AT_BATCH_JOBS;
+		}
+		if ((*env)->PushLocalFrame(env, n) != 0) {
+			return;
+		}
+		(*env)->GetLongArrayRegion(env, handles, first, n, handlebuf);
+		(*env)->GetIntArrayRegion(env, numSamples, first, n, lengthbuf);
+		if ((*env)->ExceptionCheck(env)) {
+			(*env)->PopLocalFrame(env, NULL);
+			return;
+		}
+		for (i = 0; i < n; i++) {
+			arrays[i] =
+			    (*env)->GetObjectArrayElement(env, samples,
+							  first + i);
+			if ((*env)->ExceptionCheck(env)) {
+				(*env)->PopLocalFrame(env, NULL);
+				return;
+			}
+		}
+		if (checkBatch(env, arrays, handlebuf, lengthbuf, n) != 0) {
+			(*env)->PopLocalFrame(env, NULL);
+			return;
+		}
+
+		// no other JNI calls until the arrays are released
+		pinArrays(env, arrays, bufs, n);
+		njobs = 0;
+		for (i = 0; i < n; i++) {
+			if (handlebuf[i] == 0 || bufs[i] == NULL) {
+				continue;
+			}
+			h = (AutotalentHandle *)(intptr_t)handlebuf[i];
+			jobs[njobs].instance = h->instance;
+			jobs[njobs].input = bufs[i];
+			jobs[njobs].output = bufs[i];
+			jobs[njobs].length = lengthbuf[i];
+			njobs++;
+		}
+		runAutotalentJobs(workers, jobs, njobs);
+		releaseArrays(env, arrays, bufs, n);
+		(*env)->PopLocalFrame(env, NULL);
+	}
+}
+
+// Line-aligned memory owned by the handle, for use with setBuffers
+//   It stays valid until destroyAutotalent.
+JNIEXPORT jobject JNICALL
+    Java_net_sourceforge_autotalent_Autotalent_createBuffer
+    (JNIEnv * env, jclass class, jlong handle, jint numSamples) {
+	AutotalentHandle *h = getHandle(handle);
+	void *mem;
+	jobject buffer;
+
+	if (h == NULL || h->nbuffers == AT_HANDLE_BUFFERS || numSamples <= 0) {
+		return NULL;
+	}
+	mem = allocAutotalentMemory(h->instance, numSamples * sizeof(short));
+	if (mem == NULL) {
+		return NULL;
+	}
+	buffer = (*env)->NewDirectByteBuffer(env, mem,
+					     numSamples * sizeof(short));
+	if (buffer == NULL) {
+		freeAutotalentMemory(h->instance, mem);
+		return NULL;
+	}
+	h->buffers[h->nbuffers++] = mem;
+	return buffer;
+}
+
+JNIEXPORT void JNICALL
+    Java_net_sourceforge_autotalent_Autotalent_setBuffers
+    (JNIEnv * env, jclass class, jlong handle, jobject samples,
+     jobject instrumental, jobject output) {
+	AutotalentHandle *h = getHandle(handle);
+	jlong capacity;
+
+	if (h == NULL) {
+		return;
+	}
+	if (samples == NULL || output == NULL) {
+		h->input = NULL;
+		h->output = NULL;
+		h->instrumental = NULL;
+		h->capacity = 0;
+		return;
+	}
+	h->input = (*env)->GetDirectBufferAddress(env, samples);
+	h->output = (*env)->GetDirectBufferAddress(env, output);
+	capacity = (*env)->GetDirectBufferCapacity(env, samples);
+	if ((*env)->GetDirectBufferCapacity(env, output) < capacity) {
+		capacity = (*env)->GetDirectBufferCapacity(env, output);
+	}
+	h->instrumental = NULL;
+	if (instrumental != NULL) {
+		h->instrumental =
+		    (*env)->GetDirectBufferAddress(env, instrumental);
+		if ((*env)->GetDirectBufferCapacity(env, instrumental) <
+		    capacity) {
+			capacity =
+			    (*env)->GetDirectBufferCapacity(env, instrumental);
+		}
+	}
+	if (h->input == NULL || h->output == NULL || capacity < 0) {
+		h->input = NULL;
+		h->output = NULL;
+		h->instrumental = NULL;
+		capacity = 0;
+	}
+	h->capacity = capacity / sizeof(short);
+}
+
+// Process the buffers given to setBuffers, holding no JNI critical section
+//   Up to their capacity; the Java object keeps them alive meanwhile.
+JNIEXPORT void JNICALL
+    Java_net_sourceforge_autotalent_Autotalent_processBuffers
+    (JNIEnv * env, jclass class, jlong handle, jint numSamples) {
+	AutotalentHandle *h = getHandle(handle);
+
+	if (h == NULL || h->input == NULL || h->stream != NULL
+	    || numSamples <= 0) {
+		return;
+	}
+	if ((unsigned long)numSamples > h->capacity) {
+		numSamples = h->capacity;
+	}
+	setAutotalentBuffers(h->instance, h->input, h->output);
+	runAutotalent(h->instance, numSamples);
+	if (h->instrumental != NULL) {
+		mixBuffers(h->output, h->output, h->instrumental, numSamples);
+	}
+}
+
+JNIEXPORT jboolean JNICALL
+    Java_net_sourceforge_autotalent_Autotalent_startStream
+    (JNIEnv * env, jclass class, jlong handle, jint ringSamples,
+     jint blockSize) {
+	AutotalentHandle *h = getHandle(handle);
+
+	if (h == NULL || h->stream != NULL || ringSamples <= 0
+	    || blockSize <= 0) {
+		return JNI_FALSE;
+	}
+	h->stream = startAutotalentStream(h->instance, ringSamples, blockSize);
+	return h->stream != NULL;
+}
+
+JNIEXPORT void JNICALL
+    Java_net_sourceforge_autotalent_Autotalent_stopStream
+    (JNIEnv * env, jclass class, jlong handle) {
+	AutotalentHandle *h = getHandle(handle);
+
+	if (h != NULL) {
+		stopAutotalentStream(h->stream);
+		h->stream = NULL;
+	}
+}
+
+// The arrays are only pinned for the copy into or out of the ring
+JNIEXPORT jint JNICALL
+    Java_net_sourceforge_autotalent_Autotalent_writeStream
+    (JNIEnv * env, jclass class, jlong handle, jshortArray samples,
+     jint numSamples) {
+	AutotalentHandle *h = getHandle(handle);
+	short *samplebuf;
+	jint n;
+
+	if (h == NULL || h->stream == NULL || numSamples <= 0) {
+		return 0;
+	}
+	samplebuf = (short *)(*env)->GetPrimitiveArrayCritical(env, samples, 0);
+	if (samplebuf == NULL) {
+		return 0;
+	}
+	n = writeAutotalentStream(h->stream, samplebuf, numSamples);
+	(*env)->ReleasePrimitiveArrayCritical(env, samples, samplebuf,
+					      JNI_ABORT);
+	return n;
+}
+
+JNIEXPORT jint JNICALL
+    Java_net_sourceforge_autotalent_Autotalent_readStream
+    (JNIEnv * env, jclass class, jlong handle, jshortArray samples,
+     jint numSamples) {
+	AutotalentHandle *h = getHandle(handle);
+	short *samplebuf;
+	jint n;
+
+	if (h == NULL || h->stream == NULL || numSamples <= 0) {
+		return 0;
+	}
+	samplebuf = (short *)(*env)->GetPrimitiveArrayCritical(env, samples, 0);
+	if (samplebuf == NULL) {
+		return 0;
+	}
+	n = readAutotalentStream(h->stream, samplebuf, numSamples);
+	(*env)->ReleasePrimitiveArrayCritical(env, samples, samplebuf, 0);
+	return n;
+}
+
+// Fills blocks, overruns, underruns, input fill and output fill
+JNIEXPORT void JNICALL
+    Java_net_sourceforge_autotalent_Autotalent_getStreamStats
+    (JNIEnv * env, jclass class, jlong handle, jlongArray stats) {
+	AutotalentHandle *h = getHandle(handle);
+	AutotalentStreamStats st;
+	jlong values[5];
+
+	if (h == NULL || h->stream == NULL) {
+		return;
+	}
+	getAutotalentStreamStats(h->stream, &st);
+	values[0] = st.blocks;
+	values[1] = st.overruns;
+	values[2] = st.underruns;
+	values[3] = st.inputfill;
+	values[4] = st.outputfill;
+	(*env)->SetLongArrayRegion(env, stats, 0, 5, values);
+}
+
 JNIEXPORT void JNICALL
 Java_net_sourceforge_autotalent_Autotalent_destroyAutotalent(JNIEnv * env,
-							     jclass class)
+							     jclass class,
+							     jlong handle)
 {
-	if (instance != NULL) {
-		cleanupAutotalent(instance);
+	AutotalentHandle *h = getHandle(handle);
+	Autotalent *inst;
+	int i;
+
+	if (h != NULL) {
+		inst = h->instance;
+		stopAutotalentStream(h->stream);
+		for (i = 0; i < h->nbuffers; i++) {
+			freeAutotalentMemory(inst, h->buffers[i]);
+		}
+		freeAutotalentMemory(inst, h);
+		cleanupAutotalent(inst);
 		__android_log_print(ANDROID_LOG_DEBUG, "libautotalent.so",
-				    "cleaned up autotalent at %d", instance);
-		instance = NULL;
+				    "cleaned up autotalent at %p", inst);
 	}
 }
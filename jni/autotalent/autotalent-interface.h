@@ -18,162 +18,234 @@ JNIEXPORT jboolean JNICALL Java_net_sourceforge_autotalent_Autotalent_getLiveCor
 /*
  * Class:     net_sourceforge_autotalent_Autotalent
  * Method:    instantiateAutotalent
- * Signature: (I)V
+ * Signature: (I)J
  */
-JNIEXPORT void JNICALL Java_net_sourceforge_autotalent_Autotalent_instantiateAutotalent
+JNIEXPORT jlong JNICALL Java_net_sourceforge_autotalent_Autotalent_instantiateAutotalent
   (JNIEnv *, jclass, jint);
 
 /*
  * Class:     net_sourceforge_autotalent_Autotalent
  * Method:    setConcertA
- * Signature: (F)V
+ * Signature: (JF)V
  */
 JNIEXPORT void JNICALL Java_net_sourceforge_autotalent_Autotalent_setConcertA
-  (JNIEnv *, jclass, jfloat);
+  (JNIEnv *, jclass, jlong, jfloat);
 
 /*
  * Class:     net_sourceforge_autotalent_Autotalent
  * Method:    setKey
- * Signature: (C)V
+ * Signature: (JC)V
  */
 JNIEXPORT void JNICALL Java_net_sourceforge_autotalent_Autotalent_setKey
-  (JNIEnv *, jclass, jchar);
+  (JNIEnv *, jclass, jlong, jchar);
 
 /*
  * Class:     net_sourceforge_autotalent_Autotalent
  * Method:    setFixedPitch
- * Signature: (F)V
+ * Signature: (JF)V
  */
 JNIEXPORT void JNICALL Java_net_sourceforge_autotalent_Autotalent_setFixedPitch
-  (JNIEnv *, jclass, jfloat);
+  (JNIEnv *, jclass, jlong, jfloat);
 
 /*
  * Class:     net_sourceforge_autotalent_Autotalent
  * Method:    setFixedPull
- * Signature: (F)V
+ * Signature: (JF)V
  */
 JNIEXPORT void JNICALL Java_net_sourceforge_autotalent_Autotalent_setFixedPull
-  (JNIEnv *, jclass, jfloat);
+  (JNIEnv *, jclass, jlong, jfloat);
 
 /*
  * Class:     net_sourceforge_autotalent_Autotalent
  * Method:    setCorrectionStrength
- * Signature: (F)V
+ * Signature: (JF)V
  */
 JNIEXPORT void JNICALL Java_net_sourceforge_autotalent_Autotalent_setCorrectionStrength
-  (JNIEnv *, jclass, jfloat);
+  (JNIEnv *, jclass, jlong, jfloat);
 
 /*
  * Class:     net_sourceforge_autotalent_Autotalent
  * Method:    setCorrectionSmoothness
- * Signature: (F)V
+ * Signature: (JF)V
  */
 JNIEXPORT void JNICALL Java_net_sourceforge_autotalent_Autotalent_setCorrectionSmoothness
-  (JNIEnv *, jclass, jfloat);
+  (JNIEnv *, jclass, jlong, jfloat);
 
 /*
  * Class:     net_sourceforge_autotalent_Autotalent
  * Method:    setPitchShift
- * Signature: (F)V
+ * Signature: (JF)V
  */
 JNIEXPORT void JNICALL Java_net_sourceforge_autotalent_Autotalent_setPitchShift
-  (JNIEnv *, jclass, jfloat);
+  (JNIEnv *, jclass, jlong, jfloat);
 
 /*
  * Class:     net_sourceforge_autotalent_Autotalent
  * Method:    setScaleRotate
- * Signature: (I)V
+ * Signature: (JI)V
  */
 JNIEXPORT void JNICALL Java_net_sourceforge_autotalent_Autotalent_setScaleRotate
-  (JNIEnv *, jclass, jint);
+  (JNIEnv *, jclass, jlong, jint);
 
 /*
  * Class:     net_sourceforge_autotalent_Autotalent
  * Method:    setLfoDepth
- * Signature: (F)V
+ * Signature: (JF)V
  */
 JNIEXPORT void JNICALL Java_net_sourceforge_autotalent_Autotalent_setLfoDepth
-  (JNIEnv *, jclass, jfloat);
+  (JNIEnv *, jclass, jlong, jfloat);
 
 /*
  * Class:     net_sourceforge_autotalent_Autotalent
  * Method:    setLfoRate
- * Signature: (F)V
+ * Signature: (JF)V
  */
 JNIEXPORT void JNICALL Java_net_sourceforge_autotalent_Autotalent_setLfoRate
-  (JNIEnv *, jclass, jfloat);
+  (JNIEnv *, jclass, jlong, jfloat);
 
 /*
  * Class:     net_sourceforge_autotalent_Autotalent
  * Method:    setLfoShape
- * Signature: (F)V
+ * Signature: (JF)V
  */
 JNIEXPORT void JNICALL Java_net_sourceforge_autotalent_Autotalent_setLfoShape
-  (JNIEnv *, jclass, jfloat);
+  (JNIEnv *, jclass, jlong, jfloat);
 
 /*
  * Class:     net_sourceforge_autotalent_Autotalent
  * Method:    setLfoSymmetric
- * Signature: (F)V
+ * Signature: (JF)V
  */
 JNIEXPORT void JNICALL Java_net_sourceforge_autotalent_Autotalent_setLfoSymmetric
-  (JNIEnv *, jclass, jfloat);
+  (JNIEnv *, jclass, jlong, jfloat);
 
 /*
  * Class:     net_sourceforge_autotalent_Autotalent
  * Method:    setLfoQuantization
- * Signature: (I)V
+ * Signature: (JI)V
  */
 JNIEXPORT void JNICALL Java_net_sourceforge_autotalent_Autotalent_setLfoQuantization
-  (JNIEnv *, jclass, jint);
+  (JNIEnv *, jclass, jlong, jint);
 
 /*
  * Class:     net_sourceforge_autotalent_Autotalent
  * Method:    setFormantCorrection
- * Signature: (I)V
+ * Signature: (JI)V
  */
 JNIEXPORT void JNICALL Java_net_sourceforge_autotalent_Autotalent_setFormantCorrection
-  (JNIEnv *, jclass, jint);
+  (JNIEnv *, jclass, jlong, jint);
 
 /*
  * Class:     net_sourceforge_autotalent_Autotalent
  * Method:    setFormantWarp
- * Signature: (F)V
+ * Signature: (JF)V
  */
 JNIEXPORT void JNICALL Java_net_sourceforge_autotalent_Autotalent_setFormantWarp
-  (JNIEnv *, jclass, jfloat);
+  (JNIEnv *, jclass, jlong, jfloat);
 
 /*
  * Class:     net_sourceforge_autotalent_Autotalent
  * Method:    setMix
- * Signature: (F)V
+ * Signature: (JF)V
  */
 JNIEXPORT void JNICALL Java_net_sourceforge_autotalent_Autotalent_setMix
-  (JNIEnv *, jclass, jfloat);
+  (JNIEnv *, jclass, jlong, jfloat);
 
 /*
  * Class:     net_sourceforge_autotalent_Autotalent
  * Method:    processSamples
- * Signature: ([SI)V
+ * Signature: (J[SI)V
  */
-JNIEXPORT void JNICALL Java_net_sourceforge_autotalent_Autotalent_processSamples___3SI
-  (JNIEnv *, jclass, jshortArray, jint);
+JNIEXPORT void JNICALL Java_net_sourceforge_autotalent_Autotalent_processSamples__J_3SI
+  (JNIEnv *, jclass, jlong, jshortArray, jint);
 
 /*
  * Class:     net_sourceforge_autotalent_Autotalent
  * Method:    processSamples
- * Signature: ([S[SI)V
+ * Signature: (J[S[SI)V
+ */
+JNIEXPORT void JNICALL Java_net_sourceforge_autotalent_Autotalent_processSamples__J_3S_3SI
+  (JNIEnv *, jclass, jlong, jshortArray, jshortArray, jint);
+
+/*
+ * Class:     net_sourceforge_autotalent_Autotalent
+ * Method:    processBatch
+ * Signature: ([J[[S[II)V
+ */
+JNIEXPORT void JNICALL Java_net_sourceforge_autotalent_Autotalent_processBatch
+  (JNIEnv *, jclass, jlongArray, jobjectArray, jintArray, jint);
+
+/*
+ * Class:     net_sourceforge_autotalent_Autotalent
+ * Method:    createBuffer
+ * Signature: (JI)Ljava/nio/ByteBuffer;
+ */
+JNIEXPORT jobject JNICALL Java_net_sourceforge_autotalent_Autotalent_createBuffer
+  (JNIEnv *, jclass, jlong, jint);
+
+/*
+ * Class:     net_sourceforge_autotalent_Autotalent
+ * Method:    setBuffers
+ * Signature: (JLjava/nio/ByteBuffer;Ljava/nio/ByteBuffer;Ljava/nio/ByteBuffer;)V
+ */
+JNIEXPORT void JNICALL Java_net_sourceforge_autotalent_Autotalent_setBuffers
+  (JNIEnv *, jclass, jlong, jobject, jobject, jobject);
+
+/*
+ * Class:     net_sourceforge_autotalent_Autotalent
+ * Method:    processBuffers
+ * Signature: (JI)V
+ */
+JNIEXPORT void JNICALL Java_net_sourceforge_autotalent_Autotalent_processBuffers
+  (JNIEnv *, jclass, jlong, jint);
+
+/*
+ * Class:     net_sourceforge_autotalent_Autotalent
+ * Method:    startStream
+ * Signature: (JII)Z
+ */
+JNIEXPORT jboolean JNICALL Java_net_sourceforge_autotalent_Autotalent_startStream
+  (JNIEnv *, jclass, jlong, jint, jint);
+
+/*
+ * Class:     net_sourceforge_autotalent_Autotalent
+ * Method:    stopStream
+ * Signature: (J)V
+ */
+JNIEXPORT void JNICALL Java_net_sourceforge_autotalent_Autotalent_stopStream
+  (JNIEnv *, jclass, jlong);
+
+/*
+ * Class:     net_sourceforge_autotalent_Autotalent
+ * Method:    writeStream
+ * Signature: (J[SI)I
+ */
+JNIEXPORT jint JNICALL Java_net_sourceforge_autotalent_Autotalent_writeStream
+  (JNIEnv *, jclass, jlong, jshortArray, jint);
+
+/*
+ * Class:     net_sourceforge_autotalent_Autotalent
+ * Method:    readStream
+ * Signature: (J[SI)I
  */
-JNIEXPORT void JNICALL Java_net_sourceforge_autotalent_Autotalent_processSamples___3S_3SI
-  (JNIEnv *, jclass, jshortArray, jshortArray, jint);
+JNIEXPORT jint JNICALL Java_net_sourceforge_autotalent_Autotalent_readStream
+  (JNIEnv *, jclass, jlong, jshortArray, jint);
+
+/*
+ * Class:     net_sourceforge_autotalent_Autotalent
+ * Method:    getStreamStats
+ * Signature: (J[J)V
+ */
+JNIEXPORT void JNICALL Java_net_sourceforge_autotalent_Autotalent_getStreamStats
+  (JNIEnv *, jclass, jlong, jlongArray);
 
 /*
  * Class:     net_sourceforge_autotalent_Autotalent
  * Method:    destroyAutotalent
- * Signature: ()V
+ * Signature: (J)V
  */
 JNIEXPORT void JNICALL Java_net_sourceforge_autotalent_Autotalent_destroyAutotalent
-  (JNIEnv *, jclass);
+  (JNIEnv *, jclass, jlong);
 
 #ifdef __cplusplus
 }
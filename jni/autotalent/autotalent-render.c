@@ -0,0 +1,210 @@
+/* autotalent-render.c
+ * Autotalent library for Android
+ *
+ * Offline rendering of a whole take, with seeking through checkpoints.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+/*****************************************************************************/
+#include "autotalent.h"
+#include <string.h>
+
+#define AT_RENDER_CHUNK 4096	// samples per call when output is discarded
+
+struct AutotalentRenderer {
+	Autotalent *instance;
+	const short *take;
+	unsigned long length;
+	unsigned long interval;	// samples between checkpoints
+	unsigned long position;	// next sample the instance will process
+	unsigned long ncheckpoints;
+	void **checkpoints;	// state before sample k * interval, or NULL
+	size_t *sizes;		// bytes of each checkpoint
+	short *discard;		// output of the pre-roll
+};
+
+// Render a take with instance, starting from its current state
+//   Sample 0 is the state the instance has after resetAutotalent, with
+//   the settings it has now.
+AutotalentRenderer *createAutotalentRenderer(Autotalent * instance,
+					     const short *take,
+					     unsigned long length,
+					     unsigned long interval)
+{
+	AutotalentRenderer *renderer;
+
+	if (interval == 0) {
+		return NULL;
+	}
+	renderer = allocAutotalentMemory(instance, sizeof(AutotalentRenderer));
+	if (renderer == NULL) {
+		return NULL;
+	}
+	renderer->instance = instance;
+	renderer->take = take;
+	renderer->length = length;
+	renderer->interval = interval;
+	renderer->ncheckpoints = length / interval + 1;
+	renderer->checkpoints =
+	    allocAutotalentMemory(instance,
+				  renderer->ncheckpoints * sizeof(void *));
+	renderer->sizes =
+	    allocAutotalentMemory(instance,
+				  renderer->ncheckpoints * sizeof(size_t));
+	renderer->discard =
+	    allocAutotalentMemory(instance, AT_RENDER_CHUNK * sizeof(short));
+	if (renderer->checkpoints == NULL || renderer->sizes == NULL
+	    || renderer->discard == NULL) {
+		destroyAutotalentRenderer(renderer);
+		return NULL;
+	}
+	resetAutotalent(instance);
+	return renderer;
+}
+
+// Record the state before the current position if it is on a boundary
+static void recordCheckpoint(AutotalentRenderer * renderer)
+{
+	unsigned long k;
+	size_t size;
+	void *state;
+
+	if (renderer->position % renderer->interval != 0) {
+		return;
+	}
+	k = renderer->position / renderer->interval;
+	if (k == 0 || renderer->checkpoints[k] != NULL) {
+		return;
+	}
+	size = getAutotalentCheckpointSize(renderer->instance);
+	state = allocAutotalentMemory(renderer->instance, size);
+	if (state == NULL) {
+		return;
+	}
+	saveAutotalentCheckpoint(renderer->instance, state, size);
+	renderer->checkpoints[k] = state;
+	renderer->sizes[k] = size;
+}
+
+// Process count samples from the current position
+//   Output goes to output, or nowhere if it is NULL.
+static void
+advance(AutotalentRenderer * renderer, unsigned long count, short *output)
+{
+	unsigned long len;
+	unsigned long edge;
+
+	while (count > 0) {
+		recordCheckpoint(renderer);
+		len = count;
+		edge = renderer->interval -
+		    renderer->position % renderer->interval;
+		if (len > edge) {
+			len = edge;
+		}
+		if (output == NULL && len > AT_RENDER_CHUNK) {
+			len = AT_RENDER_CHUNK;
+		}
+		setAutotalentBuffers(renderer->instance,
+				     (short *)renderer->take +
+				     renderer->position,
+				     output != NULL ? output :
+				     renderer->discard);
+		runAutotalent(renderer->instance, len);
+		renderer->position += len;
+		if (output != NULL) {
+			output += len;
+		}
+		count -= len;
+	}
+}
+
+// Render count samples of the take from start into output
+//   Returns the number of samples rendered, short of count at the end of
+//   the take.  A NULL output only advances, recording checkpoints, which
+//   is how a first pass over the take can be made.
+unsigned long
+renderAutotalent(AutotalentRenderer * renderer, unsigned long start,
+		 unsigned long count, short *output)
+{
+	unsigned long k;
+
+	if (start >= renderer->length) {
+		return 0;
+	}
+	if (count > renderer->length - start) {
+		count = renderer->length - start;
+	}
+	// Restore the latest checkpoint at or before start, unless the
+	// instance is already between it and start
+	k = start / renderer->interval;
+	while (k > 0 && renderer->checkpoints[k] == NULL) {
+		k--;
+	}
+	if (renderer->position < k * renderer->interval
+	    || renderer->position > start) {
+		if (k > 0
+		    && restoreAutotalentCheckpoint(renderer->instance,
+						   renderer->checkpoints[k],
+						   renderer->sizes[k],
+						   renderer->take) != 0) {
+			k = 0;
+		}
+		if (k == 0) {
+			resetAutotalent(renderer->instance);
+		}
+		renderer->position = k * renderer->interval;
+	}
+
+	advance(renderer, start - renderer->position, NULL);
+	advance(renderer, count, output);
+	return count;
+}
+
+// Drop every checkpoint, e.g. after a settings change
+//   The next render starts over from sample 0 with the current settings.
+void clearAutotalentCheckpoints(AutotalentRenderer * renderer)
+{
+	unsigned long k;
+
+	for (k = 0; k < renderer->ncheckpoints; k++) {
+		freeAutotalentMemory(renderer->instance,
+				     renderer->checkpoints[k]);
+		renderer->checkpoints[k] = NULL;
+	}
+	resetAutotalent(renderer->instance);
+	renderer->position = 0;
+}
+
+void destroyAutotalentRenderer(AutotalentRenderer * renderer)
+{
+	Autotalent *instance;
+	unsigned long k;
+
+	if (renderer == NULL) {
+		return;
+	}
+	instance = renderer->instance;
+	if (renderer->checkpoints != NULL) {
+		for (k = 0; k < renderer->ncheckpoints; k++) {
+			freeAutotalentMemory(instance,
+					     renderer->checkpoints[k]);
+		}
+	}
+	freeAutotalentMemory(instance, renderer->checkpoints);
+	freeAutotalentMemory(instance, renderer->sizes);
+	freeAutotalentMemory(instance, renderer->discard);
+	freeAutotalentMemory(instance, renderer);
+}
@@ -0,0 +1,351 @@
+/* autotalent-stream.c
+ * Autotalent library for Android
+ *
+ * Lock-free sample rings, and a real-time engine thread processing
+ * between them.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+/*****************************************************************************/
+#include "autotalent.h"
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+
+// SCHED_FIFO priority above the minimum, enough to preempt every normal
+// thread while staying under the system's own audio threads
+#define AT_STREAM_PRIORITY 2
+
+struct AutotalentStream {
+	Autotalent *instance;
+	AutotalentRing *input;
+	AutotalentRing *output;
+	unsigned long blocksize;
+	sem_t wake;		// posted whenever either ring moves
+	volatile int quit;
+	pthread_t thread;
+
+	// each counter has a single writer
+	volatile unsigned long blocks;	// engine thread
+	volatile unsigned long overruns;	// producer
+	volatile unsigned long underruns;	// consumer
+};
+
+static unsigned long ringCapacity(unsigned long samples)
+{
+	unsigned long size = 1;
+
+	while (size < samples) {
+		size <<= 1;
+	}
+	return size;
+}
+
+size_t getAutotalentRingSize(unsigned long samples)
+{
+	size_t size = sizeof(AutotalentRing) +
+	    ringCapacity(samples) * sizeof(short);
+
+	// whole lines, so that rings can be laid out back to back
+	return (size + AT_CACHE_LINE - 1) & ~(size_t)(AT_CACHE_LINE - 1);
+}
+
+void initAutotalentRing(AutotalentRing * ring, unsigned long samples)
+{
+	ring->head = 0;
+	ring->tail = 0;
+	ring->size = ringCapacity(samples);
+}
+
+unsigned long getAutotalentRingFill(const AutotalentRing * ring)
+{
+	return (uint32_t)(ring->head - ring->tail);
+}
+
+unsigned long
+getAutotalentSharedRingWritable(AutotalentRing * ring, uint32_t size,
+				short **data)
+{
+	uint32_t head = ring->head;
+	uint32_t start = head & (size - 1);
+	unsigned long space;
+
+	space = (uint32_t)(size - (uint32_t)(head - ring->tail));
+	// the consumer is done with the room before we write over it
+	__sync_synchronize();
+	if (space > size - start) {
+		space = size - start;
+	}
+	*data = ring->data + start;
+	return space;
+}
+
+unsigned long getAutotalentRingWritable(AutotalentRing * ring, short **data)
+{
+	return getAutotalentSharedRingWritable(ring, ring->size, data);
+}
+
+void commitAutotalentRing(AutotalentRing * ring, unsigned long count)
+{
+	// the samples land before the consumer can see them
+	__sync_synchronize();
+	ring->head += count;
+}
+
+unsigned long
+getAutotalentSharedRingReadable(AutotalentRing * ring, uint32_t size,
+				short **data)
+{
+	uint32_t tail = ring->tail;
+	uint32_t start = tail & (size - 1);
+	unsigned long fill;
+
+	fill = (uint32_t)(ring->head - tail);
+	// and are read only after the producer published them
+	__sync_synchronize();
+	if (fill > size - start) {
+		fill = size - start;
+	}
+	*data = ring->data + start;
+	return fill;
+}
+
+unsigned long getAutotalentRingReadable(AutotalentRing * ring, short **data)
+{
+	return getAutotalentSharedRingReadable(ring, ring->size, data);
+}
+
+void consumeAutotalentRing(AutotalentRing * ring, unsigned long count)
+{
+	__sync_synchronize();
+	ring->tail += count;
+}
+
+unsigned long
+writeAutotalentSharedRing(AutotalentRing * ring, uint32_t size,
+			  const short *samples, unsigned long count)
+{
+	unsigned long done = 0;
+	unsigned long n;
+	short *data;
+
+	// at most two pieces, either side of the wrap
+	while (done < count) {
+		n = getAutotalentSharedRingWritable(ring, size, &data);
+		if (n == 0) {
+			break;
+		}
+		if (n > count - done) {
+			n = count - done;
+		}
+		memcpy(data, samples + done, n * sizeof(short));
+		commitAutotalentRing(ring, n);
+		done += n;
+	}
+	return done;
+}
+
+unsigned long
+writeAutotalentRing(AutotalentRing * ring, const short *samples,
+		    unsigned long count)
+{
+	return writeAutotalentSharedRing(ring, ring->size, samples, count);
+}
+
+unsigned long
+readAutotalentSharedRing(AutotalentRing * ring, uint32_t size,
+			 short *samples, unsigned long count)
+{
+	unsigned long done = 0;
+	unsigned long n;
+	short *data;
+
+	while (done < count) {
+		n = getAutotalentSharedRingReadable(ring, size, &data);
+		if (n == 0) {
+			break;
+		}
+		if (n > count - done) {
+			n = count - done;
+		}
+		memcpy(samples + done, data, n * sizeof(short));
+		consumeAutotalentRing(ring, n);
+		done += n;
+	}
+	return done;
+}
+
+unsigned long
+readAutotalentRing(AutotalentRing * ring, short *samples, unsigned long count)
+{
+	return readAutotalentSharedRing(ring, ring->size, samples, count);
+}
+
+// Process one block straight between the rings, in as many runs as the
+// wraps of the two rings cut it into
+static void processBlock(AutotalentStream * stream)
+{
+	unsigned long left = stream->blocksize;
+	unsigned long n, room;
+	short *in, *out;
+
+	while (left > 0) {
+		n = getAutotalentRingReadable(stream->input, &in);
+		room = getAutotalentRingWritable(stream->output, &out);
+		if (n > room) {
+			n = room;
+		}
+		if (n > left) {
+			n = left;
+		}
+		setAutotalentBuffers(stream->instance, in, out);
+		runAutotalent(stream->instance, n);
+		consumeAutotalentRing(stream->input, n);
+		commitAutotalentRing(stream->output, n);
+		left -= n;
+	}
+	stream->blocks++;
+}
+
+static int blockReady(AutotalentStream * stream)
+{
+	AutotalentRing *output = stream->output;
+
+	return getAutotalentRingFill(stream->input) >= stream->blocksize
+	    && output->size - getAutotalentRingFill(output) >=
+	    stream->blocksize;
+}
+
+static void *runStream(void *arg)
+{
+	AutotalentStream *stream = arg;
+	struct sched_param param;
+
+	// best effort; without the privilege the engine runs at normal priority
+	memset(&param, 0, sizeof(param));
+	param.sched_priority = sched_get_priority_min(SCHED_FIFO) +
+	    AT_STREAM_PRIORITY;
+	pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+	prepareAutotalentThread(NULL);
+
+	while (!stream->quit) {
+		while (blockReady(stream)) {
+			processBlock(stream);
+		}
+		// a post since the check above is not lost, sem_wait returns
+		sem_wait(&stream->wake);
+	}
+	return NULL;
+}
+
+AutotalentStream *startAutotalentStream(Autotalent * instance,
+					unsigned long ringSamples,
+					unsigned long blockSize)
+{
+	AutotalentStream *stream;
+	size_t ringsize;
+
+	if (blockSize == 0 || blockSize > ringCapacity(ringSamples)) {
+		return NULL;
+	}
+	ringsize = getAutotalentRingSize(ringSamples);
+	stream = allocAutotalentMemory(instance, sizeof(AutotalentStream));
+	if (stream == NULL) {
+		return NULL;
+	}
+	stream->instance = instance;
+	stream->blocksize = blockSize;
+	stream->input = allocAutotalentMemory(instance, ringsize);
+	stream->output = allocAutotalentMemory(instance, ringsize);
+	if (stream->input == NULL || stream->output == NULL) {
+		freeAutotalentMemory(instance, stream->input);
+		freeAutotalentMemory(instance, stream->output);
+		freeAutotalentMemory(instance, stream);
+		return NULL;
+	}
+	initAutotalentRing(stream->input, ringSamples);
+	initAutotalentRing(stream->output, ringSamples);
+	sem_init(&stream->wake, 0, 0);
+	if (pthread_create(&stream->thread, NULL, runStream, stream) != 0) {
+		sem_destroy(&stream->wake);
+		freeAutotalentMemory(instance, stream->input);
+		freeAutotalentMemory(instance, stream->output);
+		freeAutotalentMemory(instance, stream);
+		return NULL;
+	}
+	return stream;
+}
+
+// Producer side: queue input, dropping what does not fit
+unsigned long
+writeAutotalentStream(AutotalentStream * stream, const short *samples,
+		      unsigned long count)
+{
+	unsigned long n;
+
+	n = writeAutotalentRing(stream->input, samples, count);
+	if (n < count) {
+		stream->overruns += count - n;
+	}
+	sem_post(&stream->wake);
+	return n;
+}
+
+// Consumer side: take processed output, as much as is ready
+unsigned long
+readAutotalentStream(AutotalentStream * stream, short *samples,
+		     unsigned long count)
+{
+	unsigned long n;
+
+	n = readAutotalentRing(stream->output, samples, count);
+	if (n < count) {
+		stream->underruns += count - n;
+	}
+	// room for the engine if it was held up by a full output ring
+	if (n > 0) {
+		sem_post(&stream->wake);
+	}
+	return n;
+}
+
+void
+getAutotalentStreamStats(AutotalentStream * stream,
+			 AutotalentStreamStats * stats)
+{
+	stats->blocks = stream->blocks;
+	stats->overruns = stream->overruns;
+	stats->underruns = stream->underruns;
+	stats->inputfill = getAutotalentRingFill(stream->input);
+	stats->outputfill = getAutotalentRingFill(stream->output);
+}
+
+void stopAutotalentStream(AutotalentStream * stream)
+{
+	Autotalent *instance;
+
+	if (stream == NULL) {
+		return;
+	}
+	instance = stream->instance;
+	stream->quit = 1;
+	sem_post(&stream->wake);
+	pthread_join(stream->thread, NULL);
+	sem_destroy(&stream->wake);
+	freeAutotalentMemory(instance, stream->input);
+	freeAutotalentMemory(instance, stream->output);
+	freeAutotalentMemory(instance, stream);
+}
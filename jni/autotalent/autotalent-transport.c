@@ -0,0 +1,477 @@
+/* autotalent-transport.c
+ * Autotalent library for Android
+ *
+ * Shared-memory transport to an instance running in another process.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+/*****************************************************************************/
+#include "autotalent.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#define AT_TRANSPORT_MAGIC 0x50525441	// "ATRP" when read back in the same byte order
+#define AT_TRANSPORT_VERSION 2
+#define AT_TRANSPORT_TRIES 64	// reads of the parameters per block at most
+#define AT_TRANSPORT_PATIENCE 500	// ms without a heartbeat until a worker is lost
+
+// Start of the shared region; the input and output rings follow it
+//   Only fixed-width fields, so that 32 and 64 bit processes agree on the
+//   layout.  The sequence words double as futexes, and the host is the
+//   only writer of everything but outputseq, blocks, heartbeat and the
+//   output ring.
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t fs;
+	uint32_t blocksize;
+	uint64_t size;		// bytes of the region
+	uint64_t inputoffset;	// of the rings, from the start of the region
+	uint64_t outputoffset;
+	volatile uint32_t quit;
+
+	volatile int32_t inputseq AT_LINE_ALIGNED;	// bumped on new input
+	volatile int32_t outputseq AT_LINE_ALIGNED;	// bumped on new output
+	volatile uint32_t blocks;	// blocks processed by the worker
+	volatile uint32_t heartbeat;	// bumped by the worker once a period at least
+
+	// PARAMETERS, a sequence lock: odd while the host is writing
+	volatile uint32_t paramseq AT_LINE_ALIGNED;
+	uint32_t paramset;	// AT_PARAM_* bits the host has set
+	int32_t key;		// key for setAutotalentKey, 0 if never set
+	float params[AT_PARAM_COUNT];
+} AutotalentTransportRegion;
+
+// One side's view of the region
+//   The geometry is read or set up once, checked, and kept here, out of
+//   reach of the other process: only the ring indices, the sequence words
+//   and the parameters are read from the region after that.
+struct AutotalentTransport {
+	AutotalentTransportRegion *region;
+	size_t size;		// bytes mapped
+	unsigned long fs;
+	unsigned long blocksize;
+	AutotalentRing *input;
+	AutotalentRing *output;
+	uint32_t ringsize;	// samples in each ring
+	struct timespec period;	// of one block, the longest futex wait
+
+	// host side, liveness of the worker
+	uint32_t heartbeat;	// value last seen
+	uint64_t beaten;	// ms when it last moved
+	int lost;		// the worker stopped beating
+};
+
+// Sleep until word moves from seen, for one block period at most
+static void
+waitWord(AutotalentTransport * transport, volatile int32_t * word,
+	 int32_t seen)
+{
+	syscall(__NR_futex, word, FUTEX_WAIT, seen, &transport->period, NULL,
+		0);
+}
+
+static void wakeWord(volatile int32_t * word)
+{
+	__sync_fetch_and_add(word, 1);
+	syscall(__NR_futex, word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+static uint64_t getMilliseconds(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static size_t headerSize(void)
+{
+	return (sizeof(AutotalentTransportRegion) + AT_CACHE_LINE - 1) &
+	    ~(size_t)(AT_CACHE_LINE - 1);
+}
+
+// Keep the checked geometry of a mapped region in a new view of it
+static AutotalentTransport *makeView(AutotalentTransportRegion * region,
+				     size_t size, unsigned long fs,
+				     unsigned long blockSize,
+				     uint64_t outputoffset, uint32_t ringsize)
+{
+	AutotalentTransport *transport;
+	uint64_t ns;
+
+	transport = calloc(1, sizeof(AutotalentTransport));
+	if (transport == NULL) {
+		return NULL;
+	}
+	transport->region = region;
+	transport->size = size;
+	transport->fs = fs;
+	transport->blocksize = blockSize;
+	transport->input = (AutotalentRing *)((char *)region + headerSize());
+	transport->output = (AutotalentRing *)((char *)region + outputoffset);
+	transport->ringsize = ringsize;
+	ns = (uint64_t)blockSize * 1000000000 / fs;
+	transport->period.tv_sec = ns / 1000000000;
+	transport->period.tv_nsec = ns % 1000000000;
+	transport->beaten = getMilliseconds();
+	return transport;
+}
+
+// Host side: size the shared file fd (memfd, ashmem or shm) and map it
+AutotalentTransport *createAutotalentTransport(int fd,
+					       unsigned long sampleRate,
+					       unsigned long ringSamples,
+					       unsigned long blockSize)
+{
+	AutotalentTransportRegion *region;
+	AutotalentTransport *transport;
+	size_t ringsize, size;
+
+	ringsize = getAutotalentRingSize(ringSamples);
+	size = headerSize() + 2 * ringsize;
+	if (sampleRate == 0 || blockSize == 0 || blockSize * sizeof(short) >
+	    ringsize - sizeof(AutotalentRing)) {
+		return NULL;
+	}
+	if (ftruncate(fd, size) != 0) {
+		return NULL;
+	}
+	region = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (region == MAP_FAILED) {
+		return NULL;
+	}
+	region->version = AT_TRANSPORT_VERSION;
+	region->fs = sampleRate;
+	region->blocksize = blockSize;
+	region->size = size;
+	region->inputoffset = headerSize();
+	region->outputoffset = headerSize() + ringsize;
+	transport = makeView(region, size, sampleRate, blockSize,
+			     region->outputoffset, 0);
+	if (transport == NULL) {
+		munmap(region, size);
+		return NULL;
+	}
+	initAutotalentRing(transport->input, ringSamples);
+	initAutotalentRing(transport->output, ringSamples);
+	transport->ringsize = transport->input->size;
+	// a worker only accepts the region once this is set
+	__sync_synchronize();
+	region->magic = AT_TRANSPORT_MAGIC;
+	return transport;
+}
+
+// A ring of the region, size a power of two and holding a whole block
+static int
+checkRing(AutotalentTransportRegion * region, uint64_t offset, uint64_t end,
+	  uint32_t size)
+{
+	return size != 0 && (size & (size - 1)) == 0
+	    && size >= region->blocksize
+	    && offset + getAutotalentRingSize(size) <= end;
+}
+
+// Worker side: map the region the host created
+//   Everything is read once into locals, checked, and only then kept.
+AutotalentTransport *openAutotalentTransport(int fd)
+{
+	AutotalentTransportRegion *region;
+	AutotalentTransport *transport;
+	struct stat st;
+	uint64_t outputoffset;
+	uint32_t blocksize;
+	uint32_t ringsize;
+	uint32_t fs;
+
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < headerSize()) {
+		return NULL;
+	}
+	region = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		      fd, 0);
+	if (region == MAP_FAILED) {
+		return NULL;
+	}
+	fs = region->fs;
+	blocksize = region->blocksize;
+	outputoffset = region->outputoffset;
+	ringsize = ((AutotalentRing *)((char *)region + headerSize()))->size;
+	__sync_synchronize();
+	transport = NULL;
+	if (region->magic == AT_TRANSPORT_MAGIC
+	    && region->version == AT_TRANSPORT_VERSION
+	    && region->size == (uint64_t)st.st_size
+	    && fs != 0 && blocksize != 0
+	    && region->inputoffset == headerSize()
+	    && outputoffset == headerSize() + getAutotalentRingSize(ringsize)
+	    && ((AutotalentRing *)((char *)region + outputoffset))->size ==
+	    ringsize
+	    && checkRing(region, outputoffset, st.st_size, ringsize)
+	    && blocksize <= ringsize) {
+		transport = makeView(region, st.st_size, fs, blocksize,
+				     outputoffset, ringsize);
+	}
+	if (transport == NULL) {
+		munmap(region, st.st_size);
+		return NULL;
+	}
+	region->heartbeat++;
+	return transport;
+}
+
+void closeAutotalentTransport(AutotalentTransport * transport)
+{
+	if (transport != NULL) {
+		munmap(transport->region, transport->size);
+		free(transport);
+	}
+}
+
+unsigned long getAutotalentTransportRate(AutotalentTransport * transport)
+{
+	return transport->fs;
+}
+
+// Host side: tell whether the worker still shows signs of life
+//   Returns 0 while it does, -1 once it has not beaten for
+//   AT_TRANSPORT_PATIENCE ms, after which the transport stays lost.
+int checkAutotalentTransport(AutotalentTransport * transport)
+{
+	uint32_t heartbeat;
+	uint64_t now;
+
+	if (transport->lost) {
+		return -1;
+	}
+	heartbeat = transport->region->heartbeat;
+	now = getMilliseconds();
+	if (heartbeat != transport->heartbeat) {
+		transport->heartbeat = heartbeat;
+		transport->beaten = now;
+	} else if (now - transport->beaten > AT_TRANSPORT_PATIENCE) {
+		transport->lost = 1;
+		return -1;
+	}
+	return 0;
+}
+
+// Host side: queue input for the worker, returning what fit
+unsigned long
+writeAutotalentTransport(AutotalentTransport * transport,
+			 const short *samples, unsigned long count)
+{
+	unsigned long n;
+
+	n = writeAutotalentSharedRing(transport->input, transport->ringsize,
+				      samples, count);
+	if (n > 0) {
+		wakeWord(&transport->region->inputseq);
+	}
+	return n;
+}
+
+// Host side: take processed output; if wait, block until count are ready
+//   Returns early with what there is once the worker is stopped or lost:
+//   the wait goes a block period at a time, checking on the worker in
+//   between, so that a worker that crashed cannot hold the host up.
+unsigned long
+readAutotalentTransport(AutotalentTransport * transport, short *samples,
+			unsigned long count, int wait)
+{
+	AutotalentTransportRegion *region = transport->region;
+	unsigned long done = 0;
+	unsigned long n;
+	int32_t seq;
+
+	for (;;) {
+		seq = region->outputseq;
+		__sync_synchronize();
+		n = readAutotalentSharedRing(transport->output,
+					     transport->ringsize,
+					     samples + done, count - done);
+		if (n > 0) {
+			// room for a worker held up by a full output ring
+			wakeWord(&region->inputseq);
+			done += n;
+		}
+		if (done == count || !wait || region->quit
+		    || checkAutotalentTransport(transport) != 0) {
+			return done;
+		}
+		waitWord(transport, &region->outputseq, seq);
+	}
+}
+
+static void beginParams(AutotalentTransportRegion * region)
+{
+	region->paramseq++;
+	__sync_synchronize();
+}
+
+static void endParams(AutotalentTransportRegion * region)
+{
+	__sync_synchronize();
+	region->paramseq++;
+}
+
+// Host side: the worker applies parameters before its next block
+void
+setAutotalentTransportParameter(AutotalentTransport * transport, int param,
+				float value)
+{
+	AutotalentTransportRegion *region = transport->region;
+
+	if (param < 0 || param >= AT_PARAM_COUNT) {
+		return;
+	}
+	beginParams(region);
+	region->params[param] = value;
+	region->paramset |= 1 << param;
+	endParams(region);
+}
+
+void setAutotalentTransportKey(AutotalentTransport * transport, char key)
+{
+	beginParams(transport->region);
+	transport->region->key = key;
+	endParams(transport->region);
+}
+
+// Host side: make serveAutotalentTransport return
+void stopAutotalentTransport(AutotalentTransport * transport)
+{
+	transport->region->quit = 1;
+	wakeWord(&transport->region->inputseq);
+	wakeWord(&transport->region->outputseq);
+}
+
+// Take a consistent copy of the parameters if they moved since seen
+//   Gives up after a few tries while the host is writing, keeping the old
+//   values until the next block, so that a host that died halfway through
+//   a write cannot hold the worker up.
+static int
+copyParams(AutotalentTransportRegion * region, uint32_t * seen,
+	   float *params, uint32_t * set, char *key)
+{
+	uint32_t seq;
+	int tries;
+	int i;
+
+	for (tries = 0; tries < AT_TRANSPORT_TRIES; tries++) {
+		seq = region->paramseq;
+		if (seq == *seen) {
+			return 0;
+		}
+		if ((seq & 1) != 0) {
+			continue;
+		}
+		__sync_synchronize();
+		for (i = 0; i < AT_PARAM_COUNT; i++) {
+			params[i] = region->params[i];
+		}
+		*set = region->paramset;
+		*key = region->key;
+		__sync_synchronize();
+		if (seq == region->paramseq) {
+			*seen = seq;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void
+applyParams(AutotalentTransport * transport, Autotalent * instance,
+	    uint32_t * seen)
+{
+	float params[AT_PARAM_COUNT];
+	uint32_t set;
+	char key;
+	int i;
+
+	if (!copyParams(transport->region, seen, params, &set, &key)) {
+		return;
+	}
+	for (i = 0; i < AT_PARAM_COUNT; i++) {
+		if (set & (1 << i)) {
+			setAutotalentParameter(instance, i, params[i]);
+		}
+	}
+	if (key != 0) {
+		setAutotalentKey(instance, &key);
+	}
+}
+
+// Worker side: process blocks for the host until it stops the transport
+//   Blocks run in place between the shared rings, as in the stream
+//   engine.  The wait for input goes a block period at a time, beating
+//   the heartbeat the host watches.  Returns 0 once stopped.
+int serveAutotalentTransport(AutotalentTransport * transport,
+			     Autotalent * instance)
+{
+	AutotalentTransportRegion *region = transport->region;
+	AutotalentRing *input = transport->input;
+	AutotalentRing *output = transport->output;
+	unsigned long left, n, room;
+	uint32_t paramseq = 0;
+	int32_t seq;
+	short *in, *out;
+
+	prepareAutotalentThread(NULL);
+	for (;;) {
+		region->heartbeat++;
+		seq = region->inputseq;
+		__sync_synchronize();
+		if (region->quit) {
+			return 0;
+		}
+		if (getAutotalentRingFill(input) < transport->blocksize
+		    || transport->ringsize - getAutotalentRingFill(output) <
+		    transport->blocksize) {
+			waitWord(transport, &region->inputseq, seq);
+			continue;
+		}
+		applyParams(transport, instance, &paramseq);
+		left = transport->blocksize;
+		while (left > 0) {
+			n = getAutotalentSharedRingReadable(input,
+							    transport->ringsize,
+							    &in);
+			room = getAutotalentSharedRingWritable(output,
+							       transport->
+							       ringsize, &out);
+			if (n > room) {
+				n = room;
+			}
+			if (n > left) {
+				n = left;
+			}
+			setAutotalentBuffers(instance, in, out);
+			runAutotalent(instance, n);
+			consumeAutotalentRing(input, n);
+			commitAutotalentRing(output, n);
+			left -= n;
+		}
+		region->blocks++;
+		wakeWord(&region->outputseq);
+	}
+}
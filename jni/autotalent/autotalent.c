@@ -31,39 +31,516 @@
 #include <math.h>
 #include <stdio.h>
 #include <android/log.h>
+#include <pthread.h>
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
 
 #define PI (float)3.14159265358979323846
 #define L2SC (float)3.32192809488736218171
 
-Autotalent *instantiateAutotalent(unsigned long SampleRate)
+// Set on the middle mailbox slot while it holds unread values
+#define AT_MAILBOX_NEW 4
+
+// Who holds the formant block of a compact instance
+//   The control thread allocates and frees it, the audio thread carves
+//   it; each hands it over to the other by changing formantstate.
+#define AT_FORMANT_NONE 0	// no block
+#define AT_FORMANT_READY 1	// allocated, for the audio thread to attach
+#define AT_FORMANT_ATTACHED 2	// in use by the audio thread
+#define AT_FORMANT_RELEASING 3	// to be let go once correction is off
+#define AT_FORMANT_DETACHED 4	// let go, for the control thread to free
+
+// Stage bodies are inlined into each specialized kernel
+#define AT_INLINE __inline__ __attribute__((always_inline))
+
+#define AT_FORD 7		// formant corrector order
+#define AT_NOVERLAP 4		// pitch estimates per circular buffer
+#define AT_MAX_CBSIZE 4096	// largest circular buffer of any sample rate
+
+// Round a size up to whole cache lines
+#define AT_ALIGN(bytes) \
+	(((bytes) + AT_CACHE_LINE - 1) & ~(size_t)(AT_CACHE_LINE - 1))
+
+// Reserve count elements of type at offset off of the arena at base
+//   With base NULL the space is only counted.
+#define AT_CARVE(ptr, type, count) \
+	do { \
+		if (base != NULL) { \
+			(ptr) = (type *)(base + off); \
+		} \
+		off += AT_ALIGN((count) * sizeof(type)); \
+	} while (0)
+
+static volatile unsigned long allocCount;
+
+// Default allocator on top of libc
+//   The raw pointer is kept just below the aligned block.
+static void *libcAlloc(void *ctx, size_t size, size_t align)
+{
+	char *raw;
+	char *mem;
+
+	raw = malloc(size + align + sizeof(void *));
+	if (raw == NULL) {
+		return NULL;
+	}
+	mem = raw + sizeof(void *);
+	mem += (align - (size_t) mem % align) % align;
+	((void **)mem)[-1] = raw;
+	return mem;
+}
+
+static void libcFree(void *ctx, void *mem)
+{
+	free(((void **)mem)[-1]);
+}
+
+static const AutotalentAllocator libcAllocator = { libcAlloc, libcFree, NULL };
+
+// Every allocation the library makes goes through here
+//   Returns zeroed memory aligned to AT_CACHE_LINE.
+static void *atAlloc(const AutotalentAllocator * allocator, size_t size)
+{
+	char *mem;
+
+	mem = allocator->alloc(allocator->ctx, size, AT_CACHE_LINE);
+	if (mem == NULL) {
+		return NULL;
+	}
+	__sync_fetch_and_add(&allocCount, 1);
+	memset(mem, 0, size);
+	return mem;
+}
+
+static void atFree(const AutotalentAllocator * allocator, void *mem)
+{
+	if (mem != NULL) {
+		allocator->free(allocator->ctx, mem);
+	}
+}
+
+// Memory for the companions of an instance, from its allocator
+void *allocAutotalentMemory(Autotalent * instance, size_t size)
+{
+	return atAlloc(&instance->allocator, size);
+}
+
+void freeAutotalentMemory(Autotalent * instance, void *mem)
+{
+	atFree(&instance->allocator, mem);
+}
+
+// Number of allocations made so far, for checking that a code path makes none
+unsigned long getAutotalentAllocCount(void)
+{
+	return allocCount;
+}
+
+// FFT buffers used only within one pitch estimate
+//   One set per prepared thread serves every instance run on that
+//   thread; the shared tables hold one more for the other threads.
+typedef struct AutotalentScratch {
+	AutotalentAllocator allocator;	// where the scratch came from
+	fft_vars *fmembvars;
+	char *fftmem;
+	float *ffttime;
+	float *fftfreqre;
+	float *fftfreqim;
+} AutotalentScratch;
+
+static pthread_key_t scratchKey;
+static pthread_once_t scratchOnce = PTHREAD_ONCE_INIT;
+
+static void freeScratch(void *scratch)
+{
+	AutotalentAllocator allocator;
+
+	allocator = ((AutotalentScratch *) scratch)->allocator;
+	atFree(&allocator, scratch);
+}
+
+static void createScratchKey(void)
+{
+	pthread_key_create(&scratchKey, freeScratch);
+}
+
+// Allocate scratch for transforms of up to N points
+static AutotalentScratch *allocScratch(const AutotalentAllocator * allocator,
+				       unsigned long N)
+{
+	AutotalentScratch *scratch;
+	char *base;
+	size_t off;
+
+	off = AT_ALIGN(sizeof(AutotalentScratch));
+	off += AT_ALIGN(fft_size(N));
+	off += AT_ALIGN(N * sizeof(float));
+	off += 2 * AT_ALIGN((N / 2 + 1) * sizeof(float));
+	base = atAlloc(allocator, off);
+	if (base == NULL) {
+		return NULL;
+	}
+	scratch = (AutotalentScratch *) base;
+	scratch->allocator = *allocator;
+	off = AT_ALIGN(sizeof(AutotalentScratch));
+	AT_CARVE(scratch->fftmem, char, fft_size(N));
+	AT_CARVE(scratch->ffttime, float, N);
+	AT_CARVE(scratch->fftfreqre, float, N / 2 + 1);
+	AT_CARVE(scratch->fftfreqim, float, N / 2 + 1);
+	return scratch;
+}
+
+// Give the calling thread its own FFT scratch, freed when it exits
+//   Threads that run instances call this once before they start, so
+//   that no pitch estimate waits for the scratch of the shared tables.
+//   Returns 0 on success, or if the thread already has its scratch.
+int prepareAutotalentThread(const AutotalentAllocator * allocator)
+{
+	AutotalentScratch *scratch;
+
+	pthread_once(&scratchOnce, createScratchKey);
+	if (pthread_getspecific(scratchKey) != NULL) {
+		return 0;
+	}
+	if (allocator == NULL) {
+		allocator = &libcAllocator;
+	}
+	scratch = allocScratch(allocator, AT_MAX_CBSIZE);
+	if (scratch == NULL) {
+		return -1;
+	}
+	if (pthread_setspecific(scratchKey, scratch) != 0) {
+		atFree(allocator, scratch);
+		return -1;
+	}
+	return 0;
+}
+
+// Scratch of the calling thread, or NULL if it was never prepared
+static AutotalentScratch *getScratch(void)
+{
+	pthread_once(&scratchOnce, createScratchKey);
+	return pthread_getspecific(scratchKey);
+}
+
+// Range of lags searched for the pitch period, [nmin, nmax)
+static void
+getLagRange(unsigned long fs, unsigned long cbsize, unsigned long *nmin,
+	    unsigned long *nmax)
+{
+	float pmax;
+	float pmin;
+
+	pmax = 1 / (float)70;
+	pmin = 1 / (float)700;
+	*nmax = (unsigned long)(fs * pmax);
+	if (*nmax > cbsize / 2 + 1) {
+		*nmax = cbsize / 2 + 1;
+	}
+	*nmin = (unsigned long)(fs * pmin);
+}
+
+// Windows shared by every instance with the same fs, cbsize and allocator
+//   Built on first use and freed with the last instance using them.
+static pthread_mutex_t tableLock = PTHREAD_MUTEX_INITIALIZER;
+static AutotalentTables *tableList;
+
+static void
+buildTables(AutotalentTables * tables, AutotalentScratch * scratch)
+{
+	unsigned long ti;
+	unsigned long N;
+	float *ffttime;
+	float *fftfreqre;
+	float *fftfreqim;
+	float tf;
+
+	N = tables->cbsize;
+	ffttime = scratch->ffttime;
+	fftfreqre = scratch->fftfreqre;
+	fftfreqim = scratch->fftfreqim;
+
+	// Standard raised cosine window, max height at N/2
+	for (ti = 0; ti < N; ti++) {
+		tables->hannwindow[ti] = -0.5 * cos(2 * PI * ti / N) + 0.5;
+	}
+
+	// Generate a window with a single raised cosine from N/4 to 3N/4
+	for (ti = 0; ti < (N / 2); ti++) {
+		tables->cbwindow[ti + N / 4] =
+		    -0.5 * cos(4 * PI * ti / (N - 1)) + 0.5;
+	}
+
+	// ---- Calculate autocorrelation of window ----
+
+	for (ti = 0; ti < N; ti++) {
+		ffttime[ti] = tables->cbwindow[ti];
+	}
+	scratch->fmembvars = fft_init(scratch->fftmem, N);
+	fft_forward(scratch->fmembvars, tables->cbwindow, fftfreqre,
+		    fftfreqim);
+	for (ti = 0; ti < N / 2 + 1; ti++) {
+		fftfreqre[ti] =
+		    (fftfreqre[ti]) * (fftfreqre[ti]) +
+		    (fftfreqim[ti]) * (fftfreqim[ti]);
+		fftfreqim[ti] = 0;
+	}
+	fft_inverse(scratch->fmembvars, fftfreqre, fftfreqim, ffttime);
+	//   only the searched lags are kept, acwinv[0] is lag nmin
+	for (ti = tables->nmin; ti < tables->nmax; ti++) {
+		tf = ffttime[ti] / ffttime[0];
+		if (ti == 0) {
+			tf = 1;
+		} else if (tf > 0.000001) {
+			tf = (float)1 / tf;
+		} else {
+			tf = 0;
+		}
+		tables->acwinv[ti - tables->nmin] = tf;
+	}
+	// ---- END Calculate autocorrelation of window ----
+}
+
+static AutotalentTables *acquireTables(unsigned long fs, unsigned long cbsize,
+					const AutotalentAllocator * allocator)
+{
+	AutotalentTables *tables;
+	AutotalentScratch *scratch;
+	unsigned long nmin;
+	unsigned long nmax;
+	char *base;
+	size_t size;
+	size_t off;
+
+	pthread_mutex_lock(&tableLock);
+	for (tables = tableList; tables != NULL; tables = tables->next) {
+		if (tables->fs == fs && tables->cbsize == cbsize
+		    && tables->allocator.alloc == allocator->alloc
+		    && tables->allocator.free == allocator->free
+		    && tables->allocator.ctx == allocator->ctx) {
+			tables->refs++;
+			pthread_mutex_unlock(&tableLock);
+			return tables;
+		}
+	}
+
+	getLagRange(fs, cbsize, &nmin, &nmax);
+	size = AT_ALIGN(sizeof(AutotalentTables)) +
+	    2 * AT_ALIGN(cbsize * sizeof(float)) +
+	    AT_ALIGN((nmax - nmin) * sizeof(float));
+	scratch = allocScratch(allocator, cbsize);
+	base = atAlloc(allocator, size);
+	if (scratch == NULL || base == NULL) {
+		atFree(allocator, scratch);
+		atFree(allocator, base);
+		pthread_mutex_unlock(&tableLock);
+		return NULL;
+	}
+	tables = (AutotalentTables *) base;
+	off = AT_ALIGN(sizeof(AutotalentTables));
+	AT_CARVE(tables->hannwindow, float, cbsize);
+	AT_CARVE(tables->cbwindow, float, cbsize);
+	AT_CARVE(tables->acwinv, float, nmax - nmin);
+	tables->size = size;
+	tables->fs = fs;
+	tables->cbsize = cbsize;
+	tables->nmin = nmin;
+	tables->nmax = nmax;
+	tables->refs = 1;
+	tables->allocator = *allocator;
+	tables->scratch = scratch;
+	pthread_mutex_init(&tables->scratchlock, NULL);
+	buildTables(tables, scratch);
+
+	tables->next = tableList;
+	tableList = tables;
+	pthread_mutex_unlock(&tableLock);
+	return tables;
+}
+
+static void releaseTables(AutotalentTables * tables)
+{
+	AutotalentTables **link;
+
+	pthread_mutex_lock(&tableLock);
+	if (--tables->refs == 0) {
+		for (link = &tableList; *link != tables; link = &(*link)->next) ;
+		*link = tables->next;
+		pthread_mutex_destroy(&tables->scratchlock);
+		atFree(&tables->allocator, tables->scratch);
+		atFree(&tables->allocator, tables);
+	}
+	pthread_mutex_unlock(&tableLock);
+}
+
+// Lay out the formant corrector state of an instance
+//   Part of the arena, or a block of its own in compact mode.
+//   Returns the size of the state; with base NULL nothing is assigned.
+static size_t
+layoutFormant(char *base, Autotalent * membvars, unsigned long cbsize)
 {
 	unsigned long ti;
+	unsigned long hop;
+	size_t off;
+
+	off = 0;
+	hop = cbsize / AT_NOVERLAP;
+
+	AT_CARVE(membvars->cbf, float, cbsize);
+	AT_CARVE(membvars->fk, float, AT_FORD);
+	AT_CARVE(membvars->fb, float, AT_FORD);
+	AT_CARVE(membvars->fc, float, AT_FORD);
+	AT_CARVE(membvars->frb, float, AT_FORD);
+	AT_CARVE(membvars->frc, float, AT_FORD);
+	AT_CARVE(membvars->fsig, float, AT_FORD);
+	AT_CARVE(membvars->fsmooth, float, AT_FORD);
+	AT_CARVE(membvars->ftvec, float, AT_FORD);
+	AT_CARVE(membvars->fwa, float, AT_FORD + 1);
+	AT_CARVE(membvars->fwb, float, AT_FORD + 1);
+	AT_CARVE(membvars->fwna, float, AT_FORD + 1);
+	AT_CARVE(membvars->fwnb, float, AT_FORD + 1);
+	AT_CARVE(membvars->fablk, float, AT_BLOCK);
+	AT_CARVE(membvars->fkblk, float, (AT_BLOCK + AT_FORD - 1) * AT_FORD);
+	AT_CARVE(membvars->fbuff, float *, AT_FORD);
+	for (ti = 0; ti < AT_FORD; ti++) {
+		AT_CARVE(membvars->fbuff[ti], float, cbsize);
+	}
+	AT_CARVE(membvars->blkcoef, float, hop * AT_FORD);
+	return off;
+}
+
+// Lay out the arena of an instance with a circular buffer of cbsize
+//   The instance itself comes first, followed by all of its buffers.
+//   Returns the size of the arena; with base NULL nothing is assigned.
+static size_t
+layoutArena(char *base, Autotalent * membvars, unsigned long cbsize,
+	    int compact)
+{
+	unsigned long hop;
+	size_t off;
+
+	off = AT_ALIGN(sizeof(Autotalent));
+	hop = cbsize / AT_NOVERLAP;
+
+	AT_CARVE(membvars->cbi, short, cbsize);
+	AT_CARVE(membvars->cbo, float, cbsize);
+	AT_CARVE(membvars->frag, float, cbsize);
+	AT_CARVE(membvars->blkin, float, hop);
+	AT_CARVE(membvars->blkdry, float, hop);
+	AT_CARVE(membvars->blkwet, float, hop);
+
+	if (!compact) {
+		off += layoutFormant(base != NULL ? base + off : NULL,
+				     membvars, cbsize);
+	}
+	return off;
+}
+
+// Point an instance at its shared tables
+static void
+attachTables(Autotalent * membvars, AutotalentTables * tables)
+{
+	membvars->tables = tables;
+	membvars->hannwindow = tables->hannwindow;
+	membvars->cbwindow = tables->cbwindow;
+	membvars->acwinv = tables->acwinv;
+}
+
+// Compact mode: allocate the formant corrector state
+//   Called on the control thread only, by enableAutotalentFormant or
+//   with the instance idle; the audio thread picks the block up with
+//   attachFormant once formantstate says AT_FORMANT_READY.
+static int prepareFormant(Autotalent * membvars)
+{
+	size_t size;
+	void *mem;
+
+	if (membvars->formantmem != NULL) {
+		return 0;
+	}
+	size = layoutFormant(NULL, NULL, membvars->cbsize);
+	mem = atAlloc(&membvars->allocator, size);
+	if (mem == NULL) {
+		return -1;
+	}
+	membvars->formantmem = mem;
+	membvars->formantsize = size;
+	return 0;
+}
+
+// Free the formant block, which nothing may be using any more
+static void freeFormant(Autotalent * membvars)
+{
+	atFree(&membvars->allocator, membvars->formantmem);
+	membvars->formantmem = NULL;
+	membvars->formantsize = 0;
+}
+
+// Carve the prepared formant block on the audio thread
+//   cbf starts as the unfiltered history, as it is while correction is off.
+static void attachFormant(Autotalent * membvars, unsigned long cbsize)
+{
+	unsigned long ti;
+
+	layoutFormant(membvars->formantmem, membvars, cbsize);
+	for (ti = 0; ti < cbsize; ti++) {
+		membvars->cbf[ti] = membvars->cbi[ti] / (float)FP_FACTOR;
+	}
+}
+
+Autotalent *instantiateAutotalent(unsigned long SampleRate)
+{
+	return instantiateAutotalentWithAllocator(SampleRate, NULL);
+}
+
+// Control values of a new instance
+static void setDefaultParams(AutotalentParams * params)
+{
+	int ti;
+
+	params->fTune = 440;
+	params->fFixed = 0;
+	params->fPull = 0;
+	for (ti = 0; ti < 12; ti++) {
+		params->iKey[ti] = 1;
+	}
+	params->fAmount = 1;
+	params->fSmooth = 0;
+	params->fShift = 0;
+	params->iScwarp = 0;
+	params->fLfoamp = 0;
+	params->fLforate = 5;
+	params->fLfoshape = 0;
+	params->fLfosymm = 0;
+	params->iLfoquant = 0;
+	params->iFcorr = 0;
+	params->fFwarp = 0;
+	params->fMix = 1;
+	for (ti = 0; ti <= AT_PARAM_COUNT; ti++) {
+		params->changes[ti]++;
+	}
+}
 
-	Autotalent *membvars = malloc(sizeof(Autotalent));
+// Set up all state of an instance except its memory and parameters
+//   Expects a zeroed arena holding the parameters to start with.
+static void
+startInstance(Autotalent * membvars, unsigned long SampleRate,
+	      unsigned long cbsize)
+{
+	unsigned long ti;
 
 	membvars->aref = 440;
 
 	membvars->fs = SampleRate;
 
-	if (SampleRate >= 88200) {
-		membvars->cbsize = 4096;
-	} else {
-		membvars->cbsize = 2048;
-	}
+	membvars->cbsize = cbsize;
 	membvars->corrsize = membvars->cbsize / 2 + 1;
 
 	membvars->pmax = 1 / (float)70;	// max and min periods (ms)
 	membvars->pmin = 1 / (float)700;	// eventually may want to bring these out as sliders
 
-	membvars->nmax = (unsigned long)(SampleRate * membvars->pmax);
-	if (membvars->nmax > membvars->corrsize) {
-		membvars->nmax = membvars->corrsize;
-	}
-	membvars->nmin = (unsigned long)(SampleRate * membvars->pmin);
-
-	membvars->cbi = calloc(membvars->cbsize, sizeof(float));
-	membvars->cbf = calloc(membvars->cbsize, sizeof(float));
-	membvars->cbo = calloc(membvars->cbsize, sizeof(float));
+	getLagRange(SampleRate, cbsize, &membvars->nmin, &membvars->nmax);
 
 	membvars->cbiwr = 0;
 	membvars->cbord = 0;
@@ -71,116 +548,959 @@ Autotalent *instantiateAutotalent(unsigned long SampleRate)
 	membvars->lfophase = 0;
 
 	// Initialize formant corrector
-	membvars->ford = 7;	// should be sufficient to capture formants
+	membvars->ford = AT_FORD;	// should be sufficient to capture formants
 	membvars->falph = pow(0.001, (float)80 / (SampleRate));
 	membvars->flamb = -(0.8517 * sqrt(atan(0.06583 * SampleRate)) - 0.1916);	// or about -0.88 @ 44.1kHz
-	membvars->fk = calloc(membvars->ford, sizeof(float));
-	membvars->fb = calloc(membvars->ford, sizeof(float));
-	membvars->fc = calloc(membvars->ford, sizeof(float));
-	membvars->frb = calloc(membvars->ford, sizeof(float));
-	membvars->frc = calloc(membvars->ford, sizeof(float));
-	membvars->fsig = calloc(membvars->ford, sizeof(float));
-	membvars->fsmooth = calloc(membvars->ford, sizeof(float));
 	membvars->fhp = 0;
 	membvars->flp = 0;
 	membvars->flpa = pow(0.001, (float)10 / (SampleRate));
-	membvars->fbuff = (float **)malloc((membvars->ford) * sizeof(float *));
+	membvars->fmute = 1;
+	membvars->fmutealph = pow(0.001, (float)1 / (SampleRate));
+
+	membvars->noverlap = AT_NOVERLAP;
+
+	membvars->lrshift = 0;
+	membvars->ptarget = 0;
+	membvars->sptarget = 0;
+	membvars->vthresh = 0.7;	//  The voiced confidence (unbiased peak) threshold level
+
+	// Pitch shifter initialization
+	membvars->phprdd = 0.01;	// Default period
+	membvars->inphinc = (float)1 / (membvars->phprdd * SampleRate);
+	membvars->phincfact = 1;
+	membvars->phasein = 0;
+	membvars->phaseout = 0;
+	membvars->fragsize = 0;
+	membvars->outphinc = 0;
+	membvars->inpitch = 0;
+	membvars->outpitch = 0;
+	membvars->conf = 0;
+
+	// Current settings, published as the first mailbox slot
+	membvars->mbox[0] = membvars->params;
+	membvars->mboxlast = membvars->params;
+	membvars->live = membvars->params;
+	membvars->nevents = 0;
+	for (ti = 0; ti < AT_PARAM_COUNT; ti++) {
+		membvars->ramps[ti].length = 0;
+	}
+	membvars->mboxfront = 0;
+	membvars->mboxmid = 1;
+	membvars->mboxback = 2;
+	loadAutotalentSettings(membvars, &membvars->settings);
+}
+
+static Autotalent *instantiateInstance(unsigned long SampleRate,
+				       const AutotalentAllocator * allocator,
+				       int compact)
+{
+	unsigned long cbsize;
+	size_t size;
+	char *arena;
+	AutotalentTables *tables;
+	Autotalent *membvars;
+
+	if (SampleRate >= 88200) {
+		cbsize = 4096;
+	} else {
+		cbsize = 2048;
+	}
+
+	// All instance state lives in one zeroed arena
+	size = layoutArena(NULL, NULL, cbsize, compact);
+	if (allocator == NULL) {
+		allocator = &libcAllocator;
+	}
+	tables = acquireTables(SampleRate, cbsize, allocator);
+	if (tables == NULL) {
+		return NULL;
+	}
+	arena = atAlloc(allocator, size);
+	if (arena == NULL) {
+		releaseTables(tables);
+		return NULL;
+	}
+	membvars = (Autotalent *) arena;
+	layoutArena(arena, membvars, cbsize, compact);
+	membvars->arenasize = size;
+	membvars->allocator = *allocator;
+	membvars->compact = compact;
+	attachTables(membvars, tables);
+
+	setDefaultParams(&membvars->params);
+	startInstance(membvars, SampleRate, cbsize);
+
+	return membvars;
+}
+
+Autotalent *instantiateAutotalentWithAllocator(unsigned long SampleRate,
+					       const AutotalentAllocator *
+					       allocator)
+{
+	return instantiateInstance(SampleRate, allocator, 0);
+}
+
+// As instantiateAutotalentWithAllocator, in compact mode
+Autotalent *instantiateCompactAutotalent(unsigned long SampleRate,
+					 const AutotalentAllocator * allocator)
+{
+	return instantiateInstance(SampleRate, allocator, 1);
+}
+
+// Give a compact instance formant state, for correction to run with
+//   Call on the control thread.  Full instances always have it.
+//   Returns -1 if the state cannot be allocated.
+int enableAutotalentFormant(Autotalent * Instance)
+{
+	if (!Instance->compact) {
+		return 0;
+	}
+	for (;;) {
+		switch (Instance->formantstate) {
+		case AT_FORMANT_NONE:
+			if (prepareFormant(Instance) != 0) {
+				return -1;
+			}
+			__sync_lock_test_and_set(&Instance->formantstate,
+						 AT_FORMANT_READY);
+			return 0;
+		case AT_FORMANT_RELEASING:
+			// the audio thread may be letting go of it right now
+			if (__sync_bool_compare_and_swap
+			    (&Instance->formantstate, AT_FORMANT_RELEASING,
+			     AT_FORMANT_ATTACHED)) {
+				return 0;
+			}
+			break;
+		case AT_FORMANT_DETACHED:
+			__sync_lock_test_and_set(&Instance->formantstate,
+						 AT_FORMANT_READY);
+			return 0;
+		default:
+			return 0;
+		}
+	}
+}
+
+// Free the formant state of a compact instance
+//   Call on the control thread, after switching formant correction off.
+//   Returns 1 while runAutotalent still has the state; it lets go of it
+//   at its next call with correction off, so call again after that.
+int releaseAutotalentFormant(Autotalent * Instance)
+{
+	for (;;) {
+		switch (Instance->formantstate) {
+		case AT_FORMANT_READY:
+			if (__sync_bool_compare_and_swap
+			    (&Instance->formantstate, AT_FORMANT_READY,
+			     AT_FORMANT_NONE)) {
+				freeFormant(Instance);
+				return 0;
+			}
+			break;
+		case AT_FORMANT_ATTACHED:
+			if (__sync_bool_compare_and_swap
+			    (&Instance->formantstate, AT_FORMANT_ATTACHED,
+			     AT_FORMANT_RELEASING)) {
+				return 1;
+			}
+			break;
+		case AT_FORMANT_RELEASING:
+			return 1;
+		case AT_FORMANT_DETACHED:
+			__sync_lock_test_and_set(&Instance->formantstate,
+						 AT_FORMANT_NONE);
+			freeFormant(Instance);
+			return 0;
+		default:
+			return 0;
+		}
+	}
+}
+
+// What ties an instance to its memory, as opposed to its state
+typedef struct {
+	size_t arenasize;
+	AutotalentAllocator allocator;
+	AutotalentTables *tables;
+	AutotalentPool *pool;
+	Autotalent *poolnext;
+	unsigned long fs;
+	unsigned long cbsize;
+	int compact;
+	void *formantmem;
+	size_t formantsize;
+	int formantstate;
+} AutotalentBinding;
+
+static void saveBinding(const Autotalent * membvars, AutotalentBinding * b)
+{
+	b->arenasize = membvars->arenasize;
+	b->allocator = membvars->allocator;
+	b->tables = membvars->tables;
+	b->pool = membvars->pool;
+	b->poolnext = membvars->poolnext;
+	b->fs = membvars->fs;
+	b->cbsize = membvars->cbsize;
+	b->compact = membvars->compact;
+	b->formantmem = membvars->formantmem;
+	b->formantsize = membvars->formantsize;
+	b->formantstate = membvars->formantstate;
+}
+
+// What the host has handed an instance to work with
+//   Resets and restores keep it; releasing an instance to its pool
+//   drops it, so that the next session does not start with any of it.
+typedef struct {
+	short *input;
+	short *output;
+	AutotalentAnalysis *analysis;
+	int flushdenormals;
+} AutotalentHostState;
+
+static void
+saveHostState(const Autotalent * membvars, AutotalentHostState * h)
+{
+	h->input = membvars->m_pfInputBuffer1;
+	h->output = membvars->m_pfOutputBuffer1;
+	h->analysis = membvars->analysis;
+	h->flushdenormals = membvars->flushdenormals;
+}
+
+static void
+loadHostState(Autotalent * membvars, const AutotalentHostState * h)
+{
+	membvars->m_pfInputBuffer1 = h->input;
+	membvars->m_pfOutputBuffer1 = h->output;
+	membvars->analysis = h->analysis;
+	membvars->flushdenormals = h->flushdenormals;
+}
+
+// Carve the arena again and put the binding back after it was overwritten
+//   The formant block of a compact instance is left for the caller.
+static void loadBinding(Autotalent * membvars, const AutotalentBinding * b)
+{
+	layoutArena((char *)membvars, membvars, b->cbsize, b->compact);
+	membvars->arenasize = b->arenasize;
+	membvars->allocator = b->allocator;
+	attachTables(membvars, b->tables);
+	membvars->pool = b->pool;
+	membvars->poolnext = b->poolnext;
+	membvars->fs = b->fs;
+	membvars->cbsize = b->cbsize;
+	membvars->compact = b->compact;
+	membvars->formantmem = b->formantmem;
+	membvars->formantsize = b->formantsize;
+	membvars->formantstate = b->formantstate;
+}
+
+// Return an instance to its freshly instantiated state, keeping its
+// parameters, buffers, analysis and denormal mode.  Must not run
+// concurrently with any other call on it.
+void resetAutotalent(Autotalent * Instance)
+{
+	AutotalentParams params;
+	AutotalentBinding binding;
+	AutotalentHostState host;
+
+	params = Instance->params;
+	saveBinding(Instance, &binding);
+	saveHostState(Instance, &host);
+
+	// zeroing the arena and carving it again is cheaper than tracking
+	// every piece of state that processing leaves behind
+	memset(Instance, 0, binding.arenasize);
+	loadBinding(Instance, &binding);
+	loadHostState(Instance, &host);
+	if (binding.formantmem != NULL) {
+		memset(binding.formantmem, 0, binding.formantsize);
+		if (binding.formantstate == AT_FORMANT_ATTACHED
+		    || binding.formantstate == AT_FORMANT_RELEASING) {
+			attachFormant(Instance, binding.cbsize);
+		}
+	}
+
+	Instance->params = params;
+	startInstance(Instance, binding.fs, binding.cbsize);
+}
+
+// ---- State snapshots ----
+//   A snapshot is the instance arena as it is in memory, plus the formant
+//   block of a compact instance, behind a header.  Pointers are carved
+//   again on restore, so a snapshot only has to come from the same build.
+
+#define AT_STATE_MAGIC 0x41545354	// "ATST"
+#define AT_STATE_VERSION 1
+
+typedef struct {
+	unsigned int magic;
+	unsigned int version;
+	unsigned int structsize;	// sizeof(Autotalent) of the writer
+	unsigned int compact;
+	unsigned long fs;
+	unsigned long cbsize;
+	size_t arenasize;
+	size_t formantsize;	// 0 unless a compact instance has formant state
+} AutotalentStateHeader;
+
+// Formant block of a compact instance that the audio thread is using
+static size_t getFormantState(const Autotalent * membvars)
+{
+	if (membvars->compact && membvars->cbf != NULL) {
+		return membvars->formantsize;
+	}
+	return 0;
+}
+
+// Settle the formant block of a compact instance after its arena was
+// overwritten with one that uses the block if attached is set
+static void
+loadFormant(Autotalent * membvars, const AutotalentBinding * binding,
+	    int attached)
+{
+	if (attached) {
+		layoutFormant(binding->formantmem, membvars, binding->cbsize);
+		membvars->formantstate = AT_FORMANT_ATTACHED;
+	} else if (binding->formantmem != NULL) {
+		// the image has none: start the block afresh, as
+		// resetAutotalent does, rather than keep the lattice of the
+		// state it replaced
+		memset(binding->formantmem, 0, binding->formantsize);
+		if (binding->formantstate == AT_FORMANT_ATTACHED
+		    || binding->formantstate == AT_FORMANT_RELEASING) {
+			membvars->formantstate = AT_FORMANT_READY;
+		}
+	}
+}
+
+// Overwrite the whole state of an instance with an arena image
+//   The tables are shared as they are, being read-only.
+static int
+copyState(Autotalent * membvars, const void *arena, const void *formant,
+	  size_t formantsize)
+{
+	AutotalentBinding binding;
+	AutotalentHostState host;
+
+	if (formantsize != 0 && prepareFormant(membvars) != 0) {
+		return -1;
+	}
+	saveBinding(membvars, &binding);
+	saveHostState(membvars, &host);
+	memcpy(membvars, arena, binding.arenasize);
+	loadBinding(membvars, &binding);
+	loadHostState(membvars, &host);
+	if (formantsize != 0) {
+		memcpy(binding.formantmem, formant, formantsize);
+	}
+	loadFormant(membvars, &binding, formantsize != 0);
+	return 0;
+}
+
+// Bytes needed for a snapshot of the instance as it is now
+size_t getAutotalentStateSize(Autotalent * Instance)
+{
+	return AT_ALIGN(sizeof(AutotalentStateHeader)) + Instance->arenasize +
+	    getFormantState(Instance);
+}
+
+// Write a snapshot of the complete processing state and parameters
+//   Returns the bytes written, or 0 if size is too small.  Must not run
+//   concurrently with runAutotalent.
+size_t saveAutotalentState(Autotalent * Instance, void *state, size_t size)
+{
+	AutotalentStateHeader *header;
+	char *base;
+	size_t off;
+
+	if (size < getAutotalentStateSize(Instance)) {
+		return 0;
+	}
+	base = state;
+	header = state;
+	header->magic = AT_STATE_MAGIC;
+	header->version = AT_STATE_VERSION;
+	header->structsize = sizeof(Autotalent);
+	header->compact = Instance->compact;
+	header->fs = Instance->fs;
+	header->cbsize = Instance->cbsize;
+	header->arenasize = Instance->arenasize;
+	header->formantsize = getFormantState(Instance);
+
+	off = AT_ALIGN(sizeof(AutotalentStateHeader));
+	memcpy(base + off, Instance, header->arenasize);
+	off += header->arenasize;
+	if (header->formantsize != 0) {
+		memcpy(base + off, Instance->formantmem, header->formantsize);
+	}
+	return off + header->formantsize;
+}
+
+// Load a snapshot into an instance of the same sample rate and mode
+//   Returns -1, leaving the instance as it was, if the snapshot does not
+//   fit it.  Must not run concurrently with any other call on it.
+int
+restoreAutotalentState(Autotalent * Instance, const void *state, size_t size)
+{
+	const AutotalentStateHeader *header;
+	const char *base;
+	size_t off;
+
+	header = state;
+	base = state;
+	off = AT_ALIGN(sizeof(AutotalentStateHeader));
+	if (size < off || header->magic != AT_STATE_MAGIC
+	    || header->version != AT_STATE_VERSION
+	    || header->structsize != sizeof(Autotalent)
+	    || header->compact != (unsigned int)Instance->compact
+	    || header->fs != Instance->fs
+	    || header->cbsize != Instance->cbsize
+	    || header->arenasize != Instance->arenasize
+	    || size < off + header->arenasize + header->formantsize) {
+		return -1;
+	}
+	return copyState(Instance, base + off, base + off + header->arenasize,
+			 header->formantsize);
+}
+
+// ---- Checkpoints ----
+//   A checkpoint is the part of a snapshot a render needs to resume from:
+//   the instance itself, the output ring and fragment and, with formant
+//   state, the residual ring, the lattice and the coefficient delay
+//   lines.  The per-block scratch is written before it is read in every
+//   block and is left out, and so is the input ring, which holds the last
+//   cbsize samples of the input and is filled again from it.
+
+#define AT_CHECKPOINT_MAGIC 0x41544350	// "ATCP"
+#define AT_CHECKPOINT_REGIONS (10 + AT_FORD)
+
+// Buffers a checkpoint holds after the instance, as float counts
+//   The formant ones are listed only if formant is set.  Returns how many
+//   there are; the addresses are those of membvars as it is carved now.
+static int
+listCheckpoint(const Autotalent * membvars, int formant, float **regions,
+	       unsigned long *counts)
+{
+	unsigned long N;
+	int n;
+	int k;
+
+	N = membvars->cbsize;
+	n = 0;
+	regions[n] = membvars->cbo;
+	counts[n++] = N;
+	regions[n] = membvars->frag;
+	counts[n++] = N;
+	if (!formant) {
+		return n;
+	}
+	regions[n] = membvars->cbf;
+	counts[n++] = N;
+	regions[n] = membvars->fk;
+	counts[n++] = AT_FORD;
+	regions[n] = membvars->fb;
+	counts[n++] = AT_FORD;
+	regions[n] = membvars->fc;
+	counts[n++] = AT_FORD;
+	regions[n] = membvars->frb;
+	counts[n++] = AT_FORD;
+	regions[n] = membvars->frc;
+	counts[n++] = AT_FORD;
+	regions[n] = membvars->fsig;
+	counts[n++] = AT_FORD;
+	regions[n] = membvars->fsmooth;
+	counts[n++] = AT_FORD;
+	for (k = 0; k < AT_FORD; k++) {
+		regions[n] = membvars->fbuff[k];
+		counts[n++] = N;
+	}
+	return n;
+}
+
+// Bytes of a checkpoint of an instance with or without formant state
+static size_t checkpointSize(const Autotalent * membvars, int formant)
+{
+	float *regions[AT_CHECKPOINT_REGIONS];
+	unsigned long counts[AT_CHECKPOINT_REGIONS];
+	size_t size;
+	int n;
+	int ti;
+
+	n = listCheckpoint(membvars, formant, regions, counts);
+	size = AT_ALIGN(sizeof(AutotalentStateHeader)) +
+	    AT_ALIGN(sizeof(Autotalent));
+	for (ti = 0; ti < n; ti++) {
+		size += counts[ti] * sizeof(float);
+	}
+	return size;
+}
+
+// Bytes needed for a checkpoint of the instance as it is now
+//   At 44.1 kHz that is about 87 KB with formant state and 21 KB
+//   without, against 114 KB for a snapshot of a full instance.
+size_t getAutotalentCheckpointSize(Autotalent * Instance)
+{
+	return checkpointSize(Instance, Instance->cbf != NULL);
+}
+
+// Write a checkpoint of the instance
+//   Returns the bytes written, or 0 if size is too small.  Must not run
+//   concurrently with runAutotalent.
+size_t
+saveAutotalentCheckpoint(Autotalent * Instance, void *checkpoint, size_t size)
+{
+	AutotalentStateHeader *header;
+	float *regions[AT_CHECKPOINT_REGIONS];
+	unsigned long counts[AT_CHECKPOINT_REGIONS];
+	char *base;
+	size_t off;
+	int n;
+	int ti;
+
+	if (size < getAutotalentCheckpointSize(Instance)) {
+		return 0;
+	}
+	base = checkpoint;
+	header = checkpoint;
+	header->magic = AT_CHECKPOINT_MAGIC;
+	header->version = AT_STATE_VERSION;
+	header->structsize = sizeof(Autotalent);
+	header->compact = Instance->compact;
+	header->fs = Instance->fs;
+	header->cbsize = Instance->cbsize;
+	header->arenasize = Instance->arenasize;
+	header->formantsize = Instance->cbf != NULL;	// a flag here
+
+	off = AT_ALIGN(sizeof(AutotalentStateHeader));
+	memcpy(base + off, Instance, sizeof(Autotalent));
+	off += AT_ALIGN(sizeof(Autotalent));
+	n = listCheckpoint(Instance, header->formantsize, regions, counts);
+	for (ti = 0; ti < n; ti++) {
+		memcpy(base + off, regions[ti], counts[ti] * sizeof(float));
+		off += counts[ti] * sizeof(float);
+	}
+	return off;
+}
+
+// Resume an instance of the same sample rate and mode from a checkpoint
+//   input is what the instance ran on from its last reset up to the
+//   checkpoint, indexed from that reset: the input ring is rebuilt from
+//   it.  Returns -1, leaving the instance as it was, if the checkpoint
+//   does not fit it.  Must not run concurrently with any other call on it.
+int
+restoreAutotalentCheckpoint(Autotalent * Instance, const void *checkpoint,
+			    size_t size, const short *input)
+{
+	const AutotalentStateHeader *header;
+	AutotalentBinding binding;
+	AutotalentHostState host;
+	float *regions[AT_CHECKPOINT_REGIONS];
+	unsigned long counts[AT_CHECKPOINT_REGIONS];
+	const char *base;
+	unsigned long N;
+	unsigned long ti;
+	size_t off;
+	int formant;
+	int n;
+	int tk;
+
+	header = checkpoint;
+	base = checkpoint;
+	off = AT_ALIGN(sizeof(AutotalentStateHeader));
+	if (size < off || header->magic != AT_CHECKPOINT_MAGIC
+	    || header->version != AT_STATE_VERSION
+	    || header->structsize != sizeof(Autotalent)
+	    || header->compact != (unsigned int)Instance->compact
+	    || header->fs != Instance->fs
+	    || header->cbsize != Instance->cbsize
+	    || header->arenasize != Instance->arenasize
+	    || size < checkpointSize(Instance, header->formantsize != 0)) {
+		return -1;
+	}
+	formant = header->formantsize != 0;
+	if (formant && Instance->compact && prepareFormant(Instance) != 0) {
+		return -1;
+	}
+
+	saveBinding(Instance, &binding);
+	saveHostState(Instance, &host);
+	memcpy(Instance, base + off, sizeof(Autotalent));
+	off += AT_ALIGN(sizeof(Autotalent));
+	loadBinding(Instance, &binding);
+	loadHostState(Instance, &host);
+	if (Instance->compact) {
+		loadFormant(Instance, &binding, formant);
+	}
+	n = listCheckpoint(Instance, formant, regions, counts);
+	for (tk = 0; tk < n; tk++) {
+		memcpy(regions[tk], base + off, counts[tk] * sizeof(float));
+		off += counts[tk] * sizeof(float);
+	}
+
+	// the input ring: the sample before the write position is the last
+	// one processed, and the ring is zero before the first
+	N = Instance->cbsize;
+	for (ti = 1; ti <= N; ti++) {
+		Instance->cbi[(Instance->cbiwr + N - ti) % N] =
+		    ti <= Instance->position ?
+		    input[Instance->position - ti] : 0;
+	}
+	return 0;
+}
+
+// Fork an instance: a new one from the same allocator in the same state
+//   The clone shares the tables, belongs to no pool and has the buffers
+//   of the original until given its own.  Must not run concurrently with
+//   runAutotalent on the original.
+Autotalent *cloneAutotalent(Autotalent * Instance)
+{
+	Autotalent *clone;
+
+	clone = instantiateInstance(Instance->fs, &Instance->allocator,
+				    Instance->compact);
+	if (clone == NULL) {
+		return NULL;
+	}
+	if (copyState(clone, Instance, Instance->formantmem,
+		      getFormantState(Instance)) != 0
+	    || (Instance->formantstate == AT_FORMANT_READY
+		&& enableAutotalentFormant(clone) != 0)) {
+		cleanupAutotalent(clone);
+		return NULL;
+	}
+	clone->m_pfInputBuffer1 = Instance->m_pfInputBuffer1;
+	clone->m_pfOutputBuffer1 = Instance->m_pfOutputBuffer1;
+	return clone;
+}
+
+// Store one of the AT_PARAM_* control values, -1 for an unknown id
+static int storeParameter(AutotalentParams * p, int param, float value)
+{
+	switch (param) {
+	case AT_PARAM_TUNE:
+		p->fTune = value;
+		break;
+	case AT_PARAM_FIXED:
+		p->fFixed = value;
+		break;
+	case AT_PARAM_PULL:
+		p->fPull = value;
+		break;
+	case AT_PARAM_AMOUNT:
+		p->fAmount = value;
+		break;
+	case AT_PARAM_SMOOTH:
+		p->fSmooth = value;
+		break;
+	case AT_PARAM_SHIFT:
+		p->fShift = value;
+		break;
+	case AT_PARAM_SCWARP:
+		p->iScwarp = (int)value;
+		break;
+	case AT_PARAM_LFOAMP:
+		p->fLfoamp = value;
+		break;
+	case AT_PARAM_LFORATE:
+		p->fLforate = value;
+		break;
+	case AT_PARAM_LFOSHAPE:
+		p->fLfoshape = value;
+		break;
+	case AT_PARAM_LFOSYMM:
+		p->fLfosymm = value;
+		break;
+	case AT_PARAM_LFOQUANT:
+		p->iLfoquant = (int)value;
+		break;
+	case AT_PARAM_FCORR:
+		p->iFcorr = (int)value;
+		break;
+	case AT_PARAM_FWARP:
+		p->fFwarp = value;
+		break;
+	case AT_PARAM_MIX:
+		p->fMix = value;
+		break;
+	default:
+		return -1;
+	}
+	return 0;
+}
+
+// Read one of the AT_PARAM_* control values
+static float readParameter(const AutotalentParams * p, int param)
+{
+	switch (param) {
+	case AT_PARAM_TUNE:
+		return p->fTune;
+	case AT_PARAM_FIXED:
+		return p->fFixed;
+	case AT_PARAM_PULL:
+		return p->fPull;
+	case AT_PARAM_AMOUNT:
+		return p->fAmount;
+	case AT_PARAM_SMOOTH:
+		return p->fSmooth;
+	case AT_PARAM_SHIFT:
+		return p->fShift;
+	case AT_PARAM_SCWARP:
+		return (float)p->iScwarp;
+	case AT_PARAM_LFOAMP:
+		return p->fLfoamp;
+	case AT_PARAM_LFORATE:
+		return p->fLforate;
+	case AT_PARAM_LFOSHAPE:
+		return p->fLfoshape;
+	case AT_PARAM_LFOSYMM:
+		return p->fLfosymm;
+	case AT_PARAM_LFOQUANT:
+		return (float)p->iLfoquant;
+	case AT_PARAM_FCORR:
+		return (float)p->iFcorr;
+	case AT_PARAM_FWARP:
+		return p->fFwarp;
+	case AT_PARAM_MIX:
+		return p->fMix;
+	}
+	return 0;
+}
+
+// Hand the control values over to the audio thread
+//   The filled back slot is swapped with the middle one, so the audio
+//   thread never sees a slot that is still being written.
+static void publishParameters(Autotalent * autotalent)
+{
+	int ti;
+
+	autotalent->mbox[autotalent->mboxback] = autotalent->params;
+	__sync_synchronize();
+	ti = __sync_lock_test_and_set(&autotalent->mboxmid,
+				      autotalent->mboxback | AT_MAILBOX_NEW);
+	autotalent->mboxback = ti & ~AT_MAILBOX_NEW;
+}
+
+// Take over a published value the control thread stored since the last
+// pickup, whether or not it differs from the value last picked up
+//   Values the control thread left alone keep any automation applied to
+//   them; a new value from the control thread ends a ramp on it.
+#define AT_MERGE(field, param) \
+	if (p->changes[param] != autotalent->mboxlast.changes[param]) { \
+		autotalent->live.field = p->field; \
+		autotalent->ramps[param].length = 0; \
+	}
+
+// Take up or let go of the formant block of a compact instance
+//   The block is let go only while correction is off and no event could
+//   switch it on again before the next call.
+static void syncFormant(Autotalent * autotalent)
+{
+	switch (autotalent->formantstate) {
+	case AT_FORMANT_READY:
+		if (__sync_bool_compare_and_swap(&autotalent->formantstate,
+						 AT_FORMANT_READY,
+						 AT_FORMANT_ATTACHED)) {
+			attachFormant(autotalent, autotalent->cbsize);
+			loadAutotalentSettings(autotalent,
+					       &autotalent->settings);
+		}
+		break;
+	case AT_FORMANT_RELEASING:
+		if (autotalent->live.iFcorr >= 1 || autotalent->nevents > 0
+		    || autotalent->ramps[AT_PARAM_FCORR].length > 0) {
+			break;
+		}
+		if (__sync_bool_compare_and_swap(&autotalent->formantstate,
+						 AT_FORMANT_RELEASING,
+						 AT_FORMANT_DETACHED)) {
+			autotalent->cbf = NULL;
+			loadAutotalentSettings(autotalent,
+					       &autotalent->settings);
+		}
+		break;
+	}
+}
+
+// Pick up the latest published control values, if there are new ones
+//   Returns 1 and refreshes the derived settings when something changed.
+int pollAutotalentParameters(Autotalent * autotalent)
+{
+	AutotalentParams *p;
+	int ti;
 
-	for (ti = 0; ti < membvars->ford; ti++) {
-		membvars->fbuff[ti] = calloc(membvars->cbsize, sizeof(float));
+	if (autotalent->compact) {
+		syncFormant(autotalent);
+	}
+	if (!(autotalent->mboxmid & AT_MAILBOX_NEW)) {
+		return 0;
+	}
+	ti = __sync_lock_test_and_set(&autotalent->mboxmid,
+				      autotalent->mboxfront);
+	__sync_synchronize();
+	autotalent->mboxfront = ti & ~AT_MAILBOX_NEW;
+
+	p = &autotalent->mbox[autotalent->mboxfront];
+	AT_MERGE(fTune, AT_PARAM_TUNE);
+	AT_MERGE(fFixed, AT_PARAM_FIXED);
+	AT_MERGE(fPull, AT_PARAM_PULL);
+	AT_MERGE(fAmount, AT_PARAM_AMOUNT);
+	AT_MERGE(fSmooth, AT_PARAM_SMOOTH);
+	AT_MERGE(fShift, AT_PARAM_SHIFT);
+	AT_MERGE(iScwarp, AT_PARAM_SCWARP);
+	AT_MERGE(fLfoamp, AT_PARAM_LFOAMP);
+	AT_MERGE(fLforate, AT_PARAM_LFORATE);
+	AT_MERGE(fLfoshape, AT_PARAM_LFOSHAPE);
+	AT_MERGE(fLfosymm, AT_PARAM_LFOSYMM);
+	AT_MERGE(iLfoquant, AT_PARAM_LFOQUANT);
+	AT_MERGE(iFcorr, AT_PARAM_FCORR);
+	AT_MERGE(fFwarp, AT_PARAM_FWARP);
+	AT_MERGE(fMix, AT_PARAM_MIX);
+	if (p->changes[AT_PARAM_COUNT] !=
+	    autotalent->mboxlast.changes[AT_PARAM_COUNT]) {
+		memcpy(autotalent->live.iKey, p->iKey, sizeof(p->iKey));
 	}
+	autotalent->mboxlast = *p;
 
-	membvars->ftvec = calloc(membvars->ford, sizeof(float));
-	membvars->fmute = 1;
-	membvars->fmutealph = pow(0.001, (float)1 / (SampleRate));
+	loadAutotalentSettings(autotalent, &autotalent->settings);
+	return 1;
+}
 
-	// Standard raised cosine window, max height at N/2
-	membvars->hannwindow = calloc(membvars->cbsize, sizeof(float));
-	for (ti = 0; ti < membvars->cbsize; ti++) {
-		membvars->hannwindow[ti] =
-		    -0.5 * cos(2 * PI * ti / membvars->cbsize) + 0.5;
-	}
+// Queue an automation event for the audio thread
+//   Call from the thread that runs runAutotalent.  The value takes effect
+//   offset samples into the next call (later calls if it is past its end)
+//   and, with a non-zero ramp, is reached linearly over ramp samples.
+//   Returns -1 if the id is unknown or the queue is full, or if the event
+//   enables formant correction on a compact instance that has no formant
+//   state; enableAutotalentFormant gives it some.
+int
+queueAutotalentEvent(Autotalent * autotalent, int param, unsigned long offset,
+		     float value, unsigned long ramp)
+{
+	AutotalentEvent *events;
+	int ti;
 
-	// Generate a window with a single raised cosine from N/4 to 3N/4
-	membvars->cbwindow = calloc(membvars->cbsize, sizeof(float));
-	for (ti = 0; ti < (membvars->cbsize / 2); ti++) {
-		membvars->cbwindow[ti + membvars->cbsize / 4] =
-		    -0.5 * cos(4 * PI * ti / (membvars->cbsize - 1)) + 0.5;
+	if (param < 0 || param >= AT_PARAM_COUNT
+	    || autotalent->nevents >= AT_EVENT_COUNT) {
+		return -1;
 	}
+	if (param == AT_PARAM_FCORR && value >= 1 && autotalent->compact
+	    && autotalent->cbf == NULL
+	    && autotalent->formantstate != AT_FORMANT_READY) {
+		return -1;
+	}
+	// keep the queue sorted by offset, in order of arrival for ties
+	events = autotalent->events;
+	ti = autotalent->nevents;
+	while (ti > 0 && events[ti - 1].offset > offset) {
+		events[ti] = events[ti - 1];
+		ti--;
+	}
+	events[ti].param = param;
+	events[ti].offset = offset;
+	events[ti].value = value;
+	events[ti].ramp = ramp;
+	autotalent->nevents++;
+	return 0;
+}
 
-	membvars->noverlap = 4;
-	membvars->fmembvars = fft_con(membvars->cbsize);
-	membvars->ffttime = calloc(membvars->cbsize, sizeof(float));
-	membvars->fftfreqre = calloc(membvars->corrsize, sizeof(float));
-	membvars->fftfreqim = calloc(membvars->corrsize, sizeof(float));
+// Apply the events and ramp steps that are due now
+//   Returns how many samples can run before the next one is due.
+static unsigned long
+applyEvents(Autotalent * autotalent, unsigned long SampleCount)
+{
+	AutotalentEvent *events;
+	AutotalentRamp *ramp;
+	unsigned long len;
+	int changed;
+	int ti;
 
-	// ---- Calculate autocorrelation of window ----
-	membvars->acwinv = calloc(membvars->cbsize, sizeof(float));
-
-	for (ti = 0; ti < membvars->cbsize; ti++) {
-		membvars->ffttime[ti] = membvars->cbwindow[ti];
-	}
-	fft_forward(membvars->fmembvars, membvars->cbwindow,
-		    membvars->fftfreqre, membvars->fftfreqim);
-	for (ti = 0; ti < membvars->corrsize; ti++) {
-		membvars->fftfreqre[ti] =
-		    (membvars->fftfreqre[ti]) * (membvars->fftfreqre[ti]) +
-		    (membvars->fftfreqim[ti]) * (membvars->fftfreqim[ti]);
-		membvars->fftfreqim[ti] = 0;
-	}
-	fft_inverse(membvars->fmembvars, membvars->fftfreqre,
-		    membvars->fftfreqim, membvars->ffttime);
-	for (ti = 1; ti < membvars->cbsize; ti++) {
-		membvars->acwinv[ti] =
-		    membvars->ffttime[ti] / membvars->ffttime[0];
-		if (membvars->acwinv[ti] > 0.000001) {
-			membvars->acwinv[ti] = (float)1 / membvars->acwinv[ti];
+	events = autotalent->events;
+	changed = 0;
+	while (autotalent->nevents > 0 && events[0].offset == 0) {
+		ramp = &autotalent->ramps[events[0].param];
+		if (events[0].ramp > 0) {
+			ramp->start =
+			    readParameter(&autotalent->live, events[0].param);
+			ramp->target = events[0].value;
+			ramp->length = events[0].ramp;
+			ramp->elapsed = 0;
 		} else {
-			membvars->acwinv[ti] = 0;
+			ramp->length = 0;
+			storeParameter(&autotalent->live, events[0].param,
+				       events[0].value);
+			changed = 1;
 		}
+		autotalent->nevents--;
+		memmove(events, events + 1,
+			autotalent->nevents * sizeof(AutotalentEvent));
 	}
-	membvars->acwinv[0] = 1;
-	// ---- END Calculate autocorrelation of window ----
 
-	membvars->lrshift = 0;
-	membvars->ptarget = 0;
-	membvars->sptarget = 0;
-	membvars->vthresh = 0.7;	//  The voiced confidence (unbiased peak) threshold level
+	len = SampleCount;
+	if (autotalent->nevents > 0 && events[0].offset < len) {
+		len = events[0].offset;
+	}
+	for (ti = 0; ti < AT_PARAM_COUNT; ti++) {
+		ramp = &autotalent->ramps[ti];
+		if (ramp->length == 0) {
+			continue;
+		}
+		if (ramp->elapsed >= ramp->length) {
+			storeParameter(&autotalent->live, ti, ramp->target);
+			ramp->length = 0;
+		} else {
+			storeParameter(&autotalent->live, ti,
+				       ramp->start + (ramp->target -
+						      ramp->start) *
+				       ramp->elapsed / ramp->length);
+			if (len > AT_RAMP_STEP) {
+				len = AT_RAMP_STEP;
+			}
+			if (len > ramp->length - ramp->elapsed) {
+				len = ramp->length - ramp->elapsed;
+			}
+		}
+		changed = 1;
+	}
 
-	// Pitch shifter initialization
-	membvars->phprdd = 0.01;	// Default period
-	membvars->inphinc = (float)1 / (membvars->phprdd * SampleRate);
-	membvars->phincfact = 1;
-	membvars->phasein = 0;
-	membvars->phaseout = 0;
-	membvars->frag = calloc(membvars->cbsize, sizeof(float));
-	membvars->fragsize = 0;
+	if (changed) {
+		loadAutotalentSettings(autotalent, &autotalent->settings);
+	}
+	return len;
+}
+
+// Move pending events and ramps on by SampleCount samples
+static void advanceEvents(Autotalent * autotalent, unsigned long SampleCount)
+{
+	int ti;
 
-	// initialize the memory for settings
-	membvars->m_pfTune = malloc(sizeof(float));
-	membvars->m_pfFixed = malloc(sizeof(float));
-	membvars->m_pfPull = malloc(sizeof(float));
-	membvars->m_pfAmount = malloc(sizeof(float));
-	membvars->m_pfSmooth = malloc(sizeof(float));
-	membvars->m_pfShift = malloc(sizeof(float));
-	membvars->m_pfScwarp = malloc(sizeof(int));
-	membvars->m_pfLfoamp = malloc(sizeof(float));
-	membvars->m_pfLforate = malloc(sizeof(float));
-	membvars->m_pfLfoshape = malloc(sizeof(float));
-	membvars->m_pfLfosymm = malloc(sizeof(float));
-	membvars->m_pfLfoquant = malloc(sizeof(int));
-	membvars->m_pfFcorr = malloc(sizeof(int));
-	membvars->m_pfFwarp = malloc(sizeof(float));
-	membvars->m_pfMix = malloc(sizeof(float));
+	for (ti = 0; ti < autotalent->nevents; ti++) {
+		autotalent->events[ti].offset -= SampleCount;
+	}
+	for (ti = 0; ti < AT_PARAM_COUNT; ti++) {
+		if (autotalent->ramps[ti].length > 0) {
+			autotalent->ramps[ti].elapsed += SampleCount;
+		}
+	}
+}
 
-	return membvars;
+// Set one of the AT_PARAM_* control values
+//   On a compact instance, formant correction only starts once
+//   enableAutotalentFormant has given it formant state.
+void
+setAutotalentParameter(Autotalent * autotalent, int param, float value)
+{
+	if (storeParameter(&autotalent->params, param, value) == 0) {
+		autotalent->params.changes[param]++;
+		publishParameters(autotalent);
+	}
 }
 
 // Set autotalent key
 void setAutotalentKey(Autotalent * autotalent, char *keyPtr)
 {
 	int *key;
-	key = calloc(12, sizeof(int));
+	key = autotalent->params.iKey;
+	memset(key, 0, 12 * sizeof(int));
 
 	switch (*keyPtr) {
 	case 'a':
@@ -367,21 +1687,29 @@ void setAutotalentKey(Autotalent * autotalent, char *keyPtr)
 		break;
 	}
 
-	autotalent->m_pfKey = key;
+	autotalent->params.changes[AT_PARAM_COUNT]++;
+	publishParameters(autotalent);
 	__android_log_print(ANDROID_LOG_DEBUG, "libautotalent.so",
 			    "A: %d, Bb: %d, B: %d, C: %d, Db: %d, D: %d, Eb: %d, E: %d, F: %d, Gb: %d, G: %d, Ab: %d",
-			    autotalent->m_pfKey[AT_A],
-			    autotalent->m_pfKey[AT_Bb],
-			    autotalent->m_pfKey[AT_B],
-			    autotalent->m_pfKey[AT_C],
-			    autotalent->m_pfKey[AT_Db],
-			    autotalent->m_pfKey[AT_D],
-			    autotalent->m_pfKey[AT_Eb],
-			    autotalent->m_pfKey[AT_E],
-			    autotalent->m_pfKey[AT_F],
-			    autotalent->m_pfKey[AT_Gb],
-			    autotalent->m_pfKey[AT_G],
-			    autotalent->m_pfKey[AT_Ab]);
+			    key[AT_A],
+			    key[AT_Bb],
+			    key[AT_B],
+			    key[AT_C],
+			    key[AT_Db],
+			    key[AT_D],
+			    key[AT_Eb],
+			    key[AT_E],
+			    key[AT_F],
+			    key[AT_Gb],
+			    key[AT_G],
+			    key[AT_Ab]);
+}
+
+// Publish the default value of every parameter
+void setAutotalentDefaults(Autotalent * autotalent)
+{
+	setDefaultParams(&autotalent->params);
+	publishParameters(autotalent);
 }
 
 // Set input and output buffers
@@ -393,508 +1721,878 @@ setAutotalentBuffers(Autotalent * autotalent, short *inputBuffer,
 	autotalent->m_pfOutputBuffer1 = outputBuffer;
 }
 
-// Called every time we get a new chunk of audio
-void runAutotalent(Autotalent * Instance, unsigned long SampleCount)
+// One wavefront step of the formant analysis lattice
+//   Runs stages kmin..kmax, each on its own sample.  Stage k reads its
+//   input from wa/wb[k] and leaves its output in wna/wnb[k + 1], so the
+//   stages are independent and the loop vectorizes across them.
+static void
+formantStep(float *__restrict wa, float *__restrict wb,
+	    float *__restrict wna, float *__restrict wnb,
+	    float *__restrict sig, float *__restrict cst,
+	    float *__restrict bst, float *__restrict kst,
+	    float *__restrict smooth, float *__restrict coef,
+	    long int kmin, long int kmax, float falph, float foma, float flamb)
 {
-	short *pfInput;
-	short *pfOutput;
+	long int k;
+	float fa;
+	float fb;
+	float fc;
+	float fk;
+	float tf;
 
-	float fAmount;
-	float fSmooth;
-	int iNotes[12];
-	int iPitch2Note[12];
-	int iNote2Pitch[12];
-	int numNotes;
-	float fTune;
-	float fFixed;
-	float fPull;
-	float fShift;
-	int iScwarp;
-	float fLfoamp;
-	float fLforate;
-	float fLfoshape;
-	float fLfosymm;
-	int iLfoquant;
-	int iFcorr;
-	float fFwarp;
-	float fMix;
-	Autotalent *psAutotalent;
-	unsigned long lSampleIndex;
+	for (k = kmin; k <= kmax; k++) {
+		fa = wa[k];
+		fb = wb[k];
+		sig[k] = fa * fa * foma + sig[k] * falph;
+		fc = (fb - cst[k]) * flamb + bst[k];
+		cst[k] = fc;
+		bst[k] = fb;
+		fk = fa * fc * foma + kst[k] * falph;
+		kst[k] = fk;
+		tf = fk / (sig[k] + 0.000001);
+		tf = tf * foma + smooth[k] * falph;
+		smooth[k] = tf;
+		coef[k] = tf;
+		wnb[k + 1] = fc - (tf * fa);
+		wna[k + 1] = fa - (tf * fc);
+	}
+}
 
-	long int N;
-	long int Nf;
-	long int fs;
-	float pmin;
-	float pmax;
-	unsigned long nmin;
-	unsigned long nmax;
+// Formant analysis pre-filter over a block of at most AT_BLOCK samples
+//   Stage k of the lattice at time t only needs stage k-1 at time t and
+//   stage k at time t-1, so the lattice is run as a skewed wavefront: at
+//   step s stage k works on sample s-k.  Every stage still performs
+//   exactly the same arithmetic as the per-sample form.
+// Writes the residual of sample t to fablk[t] and the coefficient of
+//   stage k for sample t to fkblk[(t + k) * ford + k].
+static void
+formantAnalyze(Autotalent * psAutotalent, float *pfInput,
+	       unsigned long SampleCount, float falph, float foma, float flamb)
+{
+	long int ford;
+	long int steps;
+	long int s;
+	long int kmin;
+	long int kmax;
+	float tf;
+	float *wa;
+	float *wb;
+	float *wna;
+	float *wnb;
+	float *swap;
+
+	ford = psAutotalent->ford;
+	steps = SampleCount + ford - 1;
+	wa = psAutotalent->fwa;
+	wb = psAutotalent->fwb;
+	wna = psAutotalent->fwna;
+	wnb = psAutotalent->fwnb;
+
+	for (s = 0; s < steps; s++) {
+		if (s < (long int)SampleCount) {
+			// highpass pre-emphasis filter feeds stage 0
+			tf = pfInput[s];
+			wa[0] = tf - psAutotalent->fhp;
+			wb[0] = wa[0];
+			psAutotalent->fhp = tf;
+		}
+		kmin = s - (long int)SampleCount + 1;
+		if (kmin < 0) {
+			kmin = 0;
+		}
+		kmax = s < ford - 1 ? s : ford - 1;
+		formantStep(wa, wb, wna, wnb, psAutotalent->fsig,
+			    psAutotalent->fc, psAutotalent->fb,
+			    psAutotalent->fk, psAutotalent->fsmooth,
+			    psAutotalent->fkblk + s * ford, kmin, kmax, falph,
+			    foma, flamb);
+		if (kmax == ford - 1) {
+			psAutotalent->fablk[s - kmax] = wna[ford];
+		}
+		// outputs of this step are the inputs of the next one
+		swap = wa;
+		wa = wna;
+		wna = swap;
+		swap = wb;
+		wb = wnb;
+		wnb = swap;
+	}
+}
+
+// Formant lattice state, AT_LATTICE_SIZE(ford) floats
+//   Kept in an analysis file, for the instance to carry on with the live
+//   lattice where the cached formant analysis ends.
+void storeAutotalentLattice(const Autotalent * psAutotalent, float *lattice)
+{
+	long int ford;
+
+	ford = psAutotalent->ford;
+	lattice[0] = psAutotalent->fhp;
+	memcpy(lattice + 1, psAutotalent->fc, ford * sizeof(float));
+	memcpy(lattice + 1 + ford, psAutotalent->fb, ford * sizeof(float));
+	memcpy(lattice + 1 + 2 * ford, psAutotalent->fk, ford * sizeof(float));
+	memcpy(lattice + 1 + 3 * ford, psAutotalent->fsig,
+	       ford * sizeof(float));
+	memcpy(lattice + 1 + 4 * ford, psAutotalent->fsmooth,
+	       ford * sizeof(float));
+}
+
+static void loadLattice(Autotalent * psAutotalent, const float *lattice)
+{
+	long int ford;
+
+	ford = psAutotalent->ford;
+	psAutotalent->fhp = lattice[0];
+	memcpy(psAutotalent->fc, lattice + 1, ford * sizeof(float));
+	memcpy(psAutotalent->fb, lattice + 1 + ford, ford * sizeof(float));
+	memcpy(psAutotalent->fk, lattice + 1 + 2 * ford, ford * sizeof(float));
+	memcpy(psAutotalent->fsig, lattice + 1 + 3 * ford,
+	       ford * sizeof(float));
+	memcpy(psAutotalent->fsmooth, lattice + 1 + 4 * ford,
+	       ford * sizeof(float));
+}
 
+// Derive the settings from the audio thread's control values
+void loadAutotalentSettings(Autotalent * psAutotalent, AutotalentSettings * s)
+{
+	AutotalentParams *p;
 	long int ti;
 	long int ti2;
-	long int ti3;
-	long int ti4;
 	float tf;
-	float tf2;
-
-	// Variables for cubic spline interpolator
-	float indd;
-	int ind0;
-	int ind1;
-	int ind2;
-	int ind3;
-	float vald;
-	float val0;
-	float val1;
-	float val2;
-	float val3;
-
-	int lowersnap;
-	int uppersnap;
-	float lfoval;
 
-	float pperiod;
-	float inpitch;
-	float conf;
-	float outpitch;
-	float aref;
-	float fa;
-	float fb;
-	float fc;
-	float fk;
-	float flamb;
-	float frlamb;
-	float falph;
-	float foma;
-	float f1resp;
-	float f0resp;
-	float flpa;
-	int ford;
-	psAutotalent = (Autotalent *) Instance;
+	p = &psAutotalent->live;
 
-	pfInput = psAutotalent->m_pfInputBuffer1;
-	pfOutput = psAutotalent->m_pfOutputBuffer1;
-	fAmount = (float)*(psAutotalent->m_pfAmount);
-	fSmooth = (float)*(psAutotalent->m_pfSmooth) * 0.8;	// Scales max to a more reasonable value
-	fTune = (float)*(psAutotalent->m_pfTune);
-	iNotes[0] = psAutotalent->m_pfKey[AT_A];
-	iNotes[1] = psAutotalent->m_pfKey[AT_Bb];
-	iNotes[2] = psAutotalent->m_pfKey[AT_B];
-	iNotes[3] = psAutotalent->m_pfKey[AT_C];
-	iNotes[4] = psAutotalent->m_pfKey[AT_Db];
-	iNotes[5] = psAutotalent->m_pfKey[AT_D];
-	iNotes[6] = psAutotalent->m_pfKey[AT_Eb];
-	iNotes[7] = psAutotalent->m_pfKey[AT_E];
-	iNotes[8] = psAutotalent->m_pfKey[AT_F];
-	iNotes[9] = psAutotalent->m_pfKey[AT_Gb];
-	iNotes[10] = psAutotalent->m_pfKey[AT_G];
-	iNotes[11] = psAutotalent->m_pfKey[AT_Ab];
-	fFixed = (float)*(psAutotalent->m_pfFixed);
-	fPull = (float)*(psAutotalent->m_pfPull);
-	fShift = (float)*(psAutotalent->m_pfShift);
-	iScwarp = (int)*(psAutotalent->m_pfScwarp);
-	fLfoamp = (float)*(psAutotalent->m_pfLfoamp);
-	fLforate = (float)*(psAutotalent->m_pfLforate);
-	fLfoshape = (float)*(psAutotalent->m_pfLfoshape);
-	fLfosymm = (float)*(psAutotalent->m_pfLfosymm);
-	iLfoquant = (int)*(psAutotalent->m_pfLfoquant);
-	iFcorr = (int)*(psAutotalent->m_pfFcorr);
-	fFwarp = (float)*(psAutotalent->m_pfFwarp);
-	fMix = (float)*(psAutotalent->m_pfMix);
+	s->fAmount = p->fAmount;
+	s->fSmooth = p->fSmooth * 0.8;	// Scales max to a more reasonable value
+	s->fTune = p->fTune;
+	for (ti = 0; ti < 12; ti++) {
+		s->iNotes[ti] = p->iKey[ti];
+	}
+	s->fFixed = p->fFixed;
+	s->fPull = p->fPull;
+	s->fShift = p->fShift;
+	s->iScwarp = p->iScwarp;
+	s->fLfoamp = p->fLfoamp;
+	s->fLforate = p->fLforate;
+	s->fLfoshape = p->fLfoshape;
+	s->fLfosymm = p->fLfosymm;
+	s->iLfoquant = p->iLfoquant;
+	s->iFcorr = p->iFcorr;
+	s->fFwarp = p->fFwarp;
+	s->fMix = p->fMix;
 
 	// Some logic for the semitone->scale and scale->semitone conversion
 	// If no notes are selected as being in the scale, instead snap to all notes
 	ti2 = 0;
 	for (ti = 0; ti < 12; ti++) {
-		if (iNotes[ti] >= 0) {
-			iPitch2Note[ti] = ti2;
-			iNote2Pitch[ti2] = ti;
+		if (s->iNotes[ti] >= 0) {
+			s->iPitch2Note[ti] = ti2;
+			s->iNote2Pitch[ti2] = ti;
 			ti2 = ti2 + 1;
 		} else {
-			iPitch2Note[ti] = -1;
+			s->iPitch2Note[ti] = -1;
 		}
 	}
-	numNotes = ti2;
+	s->numNotes = ti2;
 	while (ti2 < 12) {
-		iNote2Pitch[ti2] = -1;
+		s->iNote2Pitch[ti2] = -1;
 		ti2 = ti2 + 1;
 	}
-	if (numNotes == 0) {
+	if (s->numNotes == 0) {
 		for (ti = 0; ti < 12; ti++) {
-			iNotes[ti] = 1;
-			iPitch2Note[ti] = ti;
-			iNote2Pitch[ti] = ti;
+			s->iNotes[ti] = 1;
+			s->iPitch2Note[ti] = ti;
+			s->iNote2Pitch[ti] = ti;
+		}
+		s->numNotes = 12;
+	}
+	s->iScwarp = (s->iScwarp + s->numNotes * 5) % s->numNotes;
+
+	s->falph = psAutotalent->falph;
+	s->foma = (float)1 - s->falph;
+	s->flpa = psAutotalent->flpa;
+	s->flamb = psAutotalent->flamb;
+	tf = pow((float)2, s->fFwarp / 2) * (1 + s->flamb) / (1 - s->flamb);
+	s->frlamb = (tf - 1) / (tf + 1);
+
+	// Pick the kernel specialized for these settings
+	s->iKernel = 0;
+	if (s->iFcorr >= 1 && psAutotalent->cbf != NULL) {
+		s->iKernel |= AT_KERNEL_FORMANT;
+	}
+	if (s->fMix != 1) {
+		s->iKernel |= AT_KERNEL_MIX;
+	}
+	if (s->fLfoamp != 0) {
+		s->iKernel |= AT_KERNEL_LFO;
+	}
+	if (s->numNotes != 12) {
+		s->iKernel |= AT_KERNEL_SCALE;
+	}
+	for (ti = 0; ti < 12; ti++) {
+		if (s->iNotes[ti] != 1) {
+			s->iKernel |= AT_KERNEL_SCALE;
+		}
+	}
+	// Nothing would be heard but the delayed input
+	s->iBypass = s->fMix == 0 || (s->fAmount == 0 && s->fShift == 0
+				       && s->fPull == 0 && s->fLfoamp == 0
+				       && s->iScwarp == 0 && s->iFcorr < 1);
+
+	psAutotalent->aref = (float)s->fTune;
+}
+
+// Length of the next sub-block, at most SampleCount
+//   A sub-block ends on the sample that completes a hop (the pitch
+//   estimate has to see exactly the input up to it) or on the sample
+//   that resets the input phase (the grain is cut from the input up to
+//   it), whichever comes first.  *pHop is set when it ends on a hop.
+unsigned long
+getAutotalentBlockLength(Autotalent * psAutotalent, unsigned long SampleCount,
+			 int *pHop)
+{
+	unsigned long hop;
+	unsigned long len;
+	unsigned long ti;
+	unsigned long tlim;
+	double phase;
+
+	hop = psAutotalent->cbsize / psAutotalent->noverlap;
+	len = hop - (psAutotalent->cbiwr % hop);
+	*pHop = 1;
+	if (len > SampleCount) {
+		len = SampleCount;
+		*pHop = 0;
+	}
+	// The hop sample itself already runs with the new phase increment
+	tlim = *pHop ? len - 1 : len;
+	phase = psAutotalent->phasein;
+	for (ti = 0; ti < tlim; ti++) {
+		phase = phase + psAutotalent->inphinc;
+		if (phase >= 1) {
+			*pHop = 0;
+			return ti + 1;
 		}
-		numNotes = 12;
 	}
-	iScwarp = (iScwarp + numNotes * 5) % numNotes;
+	return len;
+}
+
+// Convert a sub-block of input samples to floats in blkin
+void
+convertAutotalentInput(Autotalent * psAutotalent, short *pfInput,
+		       unsigned long SampleCount)
+{
+	unsigned long ti;
+	float *blkin;
+
+	blkin = psAutotalent->blkin;
+	for (ti = 0; ti < SampleCount; ti++) {
+		blkin[ti] = pfInput[ti] / (float)FP_FACTOR;
+	}
+}
+
+// Write blkin into the circular buffers
+//   The delayed dry signal and formant coefficients that this sub-block
+//   reads back are saved to blkdry and blkcoef first, since the writes
+//   below would otherwise overwrite them.
+static AT_INLINE void
+analyzeBlock(Autotalent * psAutotalent, const AutotalentSettings * s,
+	     unsigned long SampleCount, const int iKernel)
+{
+	unsigned long N;
+	unsigned long ti;
+	unsigned long ti2;
+	unsigned long ti3;
+	unsigned long ti4;
+	long int ford;
+	long int k;
+	unsigned long cached;
+	unsigned long done;
+	float *coef;
+	AutotalentAnalysis *analysis;
+	float *frame;
 
+	N = psAutotalent->cbsize;
 	ford = psAutotalent->ford;
-	falph = psAutotalent->falph;
-	foma = (float)1 - falph;
-	flpa = psAutotalent->flpa;
-	flamb = psAutotalent->flamb;
-	tf = pow((float)2, fFwarp / 2) * (1 + flamb) / (1 - flamb);
-	frlamb = (tf - 1) / (tf + 1);
 
-	psAutotalent->aref = (float)fTune;
+	ti4 = psAutotalent->cbiwr + 3;
+	if (iKernel & AT_KERNEL_MIX) {
+		for (ti = 0; ti < SampleCount; ti++) {
+			psAutotalent->blkdry[ti] =
+			    psAutotalent->cbi[(ti4 + ti) % N] /
+			    (float)FP_FACTOR;
+		}
+	}
+	if (iKernel & AT_KERNEL_FORMANT) {
+		for (ti = 0; ti < SampleCount; ti++) {
+			coef = psAutotalent->blkcoef + ti * ford;
+			for (k = 0; k < ford; k++) {
+				coef[k] = psAutotalent->fbuff[k][(ti4 + ti) % N];
+			}
+		}
+	}
+
+	ti4 = psAutotalent->cbiwr;
+	for (ti = 0; ti < SampleCount; ti++) {
+		psAutotalent->cbi[(ti4 + ti) % N] =
+		    (short)(psAutotalent->blkin[ti] * FP_FACTOR);
+	}
+
+	// Cached residual and coefficients of this block, if any
+	analysis = psAutotalent->analysis;
+	frame = NULL;
+	cached = 0;
+	if ((iKernel & AT_KERNEL_FORMANT) && analysis != NULL
+	    && analysis->formant != NULL
+	    && psAutotalent->position <= analysis->length) {
+		frame = analysis->formant + psAutotalent->position * (ford + 1);
+		cached = analysis->length - psAutotalent->position;
+		if (cached > SampleCount) {
+			cached = SampleCount;
+		}
+	}
+
+	done = 0;
+	if (frame != NULL && !analysis->writable) {
+		for (ti = 0; ti < cached; ti++) {
+			psAutotalent->cbf[(ti4 + ti) % N] = frame[0];
+			for (k = 0; k < ford; k++) {
+				psAutotalent->fbuff[k][(ti4 + ti) % N] =
+				    frame[k + 1];
+			}
+			frame += ford + 1;
+		}
+		done = cached;
+		// the lattice did not run over the cached samples; carry on
+		// from where it was left when the cache was recorded
+		if (cached < SampleCount) {
+			loadLattice(psAutotalent, analysis->lattice);
+		}
+	}
+	if (iKernel & AT_KERNEL_FORMANT) {
+		// Somewhat experimental formant corrector
+		//  formants are removed using an adaptive pre-filter and
+		//  re-introduced after pitch manipulation using post-filter
+		for (ti = done; ti < SampleCount; ti += AT_BLOCK) {
+			ti2 = SampleCount - ti;
+			if (ti2 > AT_BLOCK) {
+				ti2 = AT_BLOCK;
+			}
+			formantAnalyze(psAutotalent, psAutotalent->blkin + ti,
+				       ti2, s->falph, s->foma, s->flamb);
+			for (ti3 = 0; ti3 < ti2; ti3++) {
+				for (k = 0; k < ford; k++) {
+					psAutotalent->fbuff[k][(ti4 + ti +
+								ti3) % N] =
+					    psAutotalent->fkblk[(ti3 + k) *
+								ford + k];
+				}
+				psAutotalent->cbf[(ti4 + ti + ti3) % N] =
+				    psAutotalent->fablk[ti3];
+			}
+			if (frame != NULL) {
+				for (ti3 = 0; ti3 < ti2 && ti + ti3 < cached;
+				     ti3++) {
+					frame[0] = psAutotalent->fablk[ti3];
+					for (k = 0; k < ford; k++) {
+						frame[k + 1] =
+						    psAutotalent->fkblk[(ti3 +
+									 k) *
+									ford +
+									k];
+					}
+					frame += ford + 1;
+				}
+			}
+		}
+		// Now hopefully the formants are reduced
+		// More formant correction code in resynthesizeAutotalentBlock
+	} else if (psAutotalent->cbf != NULL) {
+		for (ti = 0; ti < SampleCount; ti++) {
+			psAutotalent->cbf[(ti4 + ti) % N] =
+			    psAutotalent->blkin[ti];
+		}
+	}
+
+	// Input write pointer logic
+	psAutotalent->cbiwr = (ti4 + SampleCount) % N;
+	psAutotalent->position += SampleCount;
+}
+
+void
+analyzeAutotalentBlock(Autotalent * psAutotalent,
+		       const AutotalentSettings * s, unsigned long SampleCount)
+{
+	analyzeBlock(psAutotalent, s, SampleCount, s->iKernel);
+}
+
+// Estimate the pitch period and its confidence from the input history
+//   Depends on nothing but the input, so it can be cached per hop.
+//   conf keeps its previous value when no peak is found.
+static void
+measurePeriodWith(Autotalent * psAutotalent, AutotalentScratch * scratch,
+		  float *period, float *confidence)
+{
+	long int N;
+	long int Nf;
+	long int fs;
+	float pmin;
+	unsigned long nmin;
+	unsigned long nmax;
+
+	long int ti;
+	long int ti2;
+	long int ti3;
+	long int ti4;
+	float tf;
+	float tf2;
+
+	float pperiod;
+	float conf;
 
 	N = psAutotalent->cbsize;
 	Nf = psAutotalent->corrsize;
 	fs = psAutotalent->fs;
 
-	pmax = psAutotalent->pmax;
 	pmin = psAutotalent->pmin;
 	nmax = psAutotalent->nmax;
 	nmin = psAutotalent->nmin;
 
-	aref = psAutotalent->aref;
-	pperiod = psAutotalent->pmax;
-	inpitch = psAutotalent->inpitch;
 	conf = psAutotalent->conf;
-	outpitch = psAutotalent->outpitch;
+	ti4 = 0;
 
-  /*******************
-   *  MAIN DSP LOOP  *
-   *******************/
-	for (lSampleIndex = 0; lSampleIndex < SampleCount; lSampleIndex++) {
+	// ---- Obtain autocovariance ----
 
-		// load data into circular buffer
-		tf = *(pfInput++) / (float)FP_FACTOR;
-		ti4 = psAutotalent->cbiwr;
-		psAutotalent->cbi[ti4] = tf;
-
-		if (iFcorr >= 1) {
-			// Somewhat experimental formant corrector
-			//  formants are removed using an adaptive pre-filter and
-			//  re-introduced after pitch manipulation using post-filter
-			// tf is signal input
-			fa = tf - psAutotalent->fhp;	// highpass pre-emphasis filter
-			psAutotalent->fhp = tf;
-			fb = fa;
-			for (ti = 0; ti < ford; ti++) {
-				psAutotalent->fsig[ti] =
-				    fa * fa * foma +
-				    psAutotalent->fsig[ti] * falph;
-				fc = (fb - psAutotalent->fc[ti]) * flamb +
-				    psAutotalent->fb[ti];
-				psAutotalent->fc[ti] = fc;
-				psAutotalent->fb[ti] = fb;
-				fk = fa * fc * foma +
-				    psAutotalent->fk[ti] * falph;
-				psAutotalent->fk[ti] = fk;
-				tf = fk / (psAutotalent->fsig[ti] + 0.000001);
-				tf = tf * foma +
-				    psAutotalent->fsmooth[ti] * falph;
-				psAutotalent->fsmooth[ti] = tf;
-				psAutotalent->fbuff[ti][ti4] = tf;
-				fb = fc - (tf * fa);
-				fa = fa - (tf * fc);
-			}
-			psAutotalent->cbf[ti4] = fa;
-			// Now hopefully the formants are reduced
-			// More formant correction code at the end of the DSP loop
-		} else {
-			psAutotalent->cbf[ti4] = tf;
+	scratch->fmembvars = fft_init(scratch->fftmem, N);
+
+	// Window and fill FFT buffer
+	ti2 = psAutotalent->cbiwr;
+	for (ti = 0; ti < N; ti++) {
+		scratch->ffttime[ti] =
+		    (float)(psAutotalent->cbi[(ti2 - ti + N) % N] /
+			    (float)FP_FACTOR * psAutotalent->cbwindow[ti]);
+	}
+
+	// Calculate FFT
+	fft_forward(scratch->fmembvars, scratch->ffttime,
+		    scratch->fftfreqre, scratch->fftfreqim);
+
+	// Remove DC
+	scratch->fftfreqre[0] = 0;
+	scratch->fftfreqim[0] = 0;
+
+	// Take magnitude squared
+	for (ti = 1; ti < Nf; ti++) {
+		scratch->fftfreqre[ti] =
+		    (scratch->fftfreqre[ti]) *
+		    (scratch->fftfreqre[ti]) +
+		    (scratch->fftfreqim[ti]) *
+		    (scratch->fftfreqim[ti]);
+		scratch->fftfreqim[ti] = 0;
+	}
+
+	// Calculate IFFT
+	fft_inverse(scratch->fmembvars, scratch->fftfreqre,
+		    scratch->fftfreqim, scratch->ffttime);
+
+	// Normalize
+	tf = (float)1 / scratch->ffttime[0];
+	for (ti = 1; ti < N; ti++) {
+		scratch->ffttime[ti] = scratch->ffttime[ti] * tf;
+	}
+	scratch->ffttime[0] = 1;
+
+	//  ---- END Obtain autocovariance ----
+
+	//  ---- Calculate pitch and confidence ----
+
+	// Calculate pitch period
+	//   Pitch period is determined by the location of the max (biased)
+	//     peak within a given range
+	//   Confidence is determined by the corresponding unbiased height
+	tf2 = 0;
+	pperiod = pmin;
+	for (ti = nmin; ti < nmax; ti++) {
+		ti2 = ti - 1;
+		ti3 = ti + 1;
+		if (ti2 < 0) {
+			ti2 = 0;
 		}
+		if (ti3 > Nf) {
+			ti3 = Nf;
+		}
+		tf = scratch->ffttime[ti];
 
-		// Input write pointer logic
-		psAutotalent->cbiwr++;
-		if (psAutotalent->cbiwr >= N) {
-			psAutotalent->cbiwr = 0;
+		if ((tf > scratch->ffttime[ti2])
+		    && (tf >= scratch->ffttime[ti3])
+		    && (tf > tf2)) {
+			tf2 = tf;
+			ti4 = ti;
 		}
-		// ********************
-		// * Low-rate section *
-		// ********************
-
-		// Every N/noverlap samples, run pitch estimation / manipulation code
-		if ((psAutotalent->cbiwr) % (N / psAutotalent->noverlap) == 0) {
-			// ---- Obtain autocovariance ----
-
-			// Window and fill FFT buffer
-			ti2 = psAutotalent->cbiwr;
-			for (ti = 0; ti < N; ti++) {
-				psAutotalent->ffttime[ti] =
-				    (float)(psAutotalent->cbi[(ti2 - ti +
-							       N) % N] *
-					    psAutotalent->cbwindow[ti]);
-			}
+	}
+	if (tf2 > 0) {
+		conf = tf2 * psAutotalent->acwinv[ti4 - nmin];
+		if (ti4 > 0 && ti4 < Nf) {
+			// Find the center of mass in the vicinity of the detected peak
+			tf = scratch->ffttime[ti4 - 1] * (ti4 - 1);
+			tf = tf + scratch->ffttime[ti4] * ti4;
+			tf = tf + scratch->ffttime[ti4 + 1] * (ti4 + 1);
+			tf = tf /
+			    (scratch->ffttime[ti4 - 1] +
+			     scratch->ffttime[ti4] +
+			     scratch->ffttime[ti4 + 1]);
+			pperiod = tf / fs;
+		} else {
+			pperiod = (float)ti4 / fs;
+		}
+	}
 
-			// Calculate FFT
-			fft_forward(psAutotalent->fmembvars,
-				    psAutotalent->ffttime,
-				    psAutotalent->fftfreqre,
-				    psAutotalent->fftfreqim);
-
-			// Remove DC
-			psAutotalent->fftfreqre[0] = 0;
-			psAutotalent->fftfreqim[0] = 0;
-
-			// Take magnitude squared
-			for (ti = 1; ti < Nf; ti++) {
-				psAutotalent->fftfreqre[ti] =
-				    (psAutotalent->fftfreqre[ti]) *
-				    (psAutotalent->fftfreqre[ti]) +
-				    (psAutotalent->fftfreqim[ti]) *
-				    (psAutotalent->fftfreqim[ti]);
-				psAutotalent->fftfreqim[ti] = 0;
-			}
+	*period = pperiod;
+	*confidence = conf;
+}
 
-			// Calculate IFFT
-			fft_inverse(psAutotalent->fmembvars,
-				    psAutotalent->fftfreqre,
-				    psAutotalent->fftfreqim,
-				    psAutotalent->ffttime);
-
-			// Normalize
-			tf = (float)1 / psAutotalent->ffttime[0];
-			for (ti = 1; ti < N; ti++) {
-				psAutotalent->ffttime[ti] =
-				    psAutotalent->ffttime[ti] * tf;
-			}
-			psAutotalent->ffttime[0] = 1;
+// As measurePeriodWith, on the scratch of the calling thread
+//   A thread never prepared borrows the scratch of the shared tables.
+static int
+measurePeriod(Autotalent * psAutotalent, float *period, float *confidence)
+{
+	AutotalentScratch *scratch;
+	AutotalentTables *tables;
 
-			//  ---- END Obtain autocovariance ----
+	scratch = getScratch();
+	if (scratch != NULL) {
+		measurePeriodWith(psAutotalent, scratch, period, confidence);
+		return 0;
+	}
+	tables = psAutotalent->tables;
+	pthread_mutex_lock(&tables->scratchlock);
+	measurePeriodWith(psAutotalent, tables->scratch, period, confidence);
+	pthread_mutex_unlock(&tables->scratchlock);
+	return 0;
+}
 
-			//  ---- Calculate pitch and confidence ----
+// Pitch period and confidence of the hop just completed
+//   Read from the cached analysis when there is one, else measured (and
+//   written to the analysis while it is being recorded).
+static int
+measurePitch(Autotalent * psAutotalent, float *period, float *confidence)
+{
+	unsigned long hop;
+	AutotalentAnalysis *analysis;
+	float *pitch;
+
+	hop = psAutotalent->cbsize / psAutotalent->noverlap;
+	analysis = psAutotalent->analysis;
+	if (analysis != NULL && !analysis->writable
+	    && psAutotalent->position / hop < analysis->nhops) {
+		pitch = analysis->pitch + 2 * (psAutotalent->position / hop);
+		*period = pitch[0];
+		*confidence = pitch[1];
+		return 0;
+	}
+	if (measurePeriod(psAutotalent, period, confidence) != 0) {
+		return -1;
+	}
+	if (analysis != NULL && analysis->writable
+	    && psAutotalent->position / hop < analysis->nhops) {
+		pitch = analysis->pitch + 2 * (psAutotalent->position / hop);
+		pitch[0] = *period;
+		pitch[1] = *confidence;
+	}
+	return 0;
+}
 
-			// Calculate pitch period
-			//   Pitch period is determined by the location of the max (biased)
-			//     peak within a given range
-			//   Confidence is determined by the corresponding unbiased height
-			tf2 = 0;
-			pperiod = pmin;
-			for (ti = nmin; ti < nmax; ti++) {
-				ti2 = ti - 1;
-				ti3 = ti + 1;
-				if (ti2 < 0) {
-					ti2 = 0;
-				}
-				if (ti3 > Nf) {
-					ti3 = Nf;
-				}
-				tf = psAutotalent->ffttime[ti];
+int
+measureAutotalentPitch(Autotalent * psAutotalent, float *period,
+		       float *confidence)
+{
+	return measurePitch(psAutotalent, period, confidence);
+}
 
-				if ((tf > psAutotalent->ffttime[ti2])
-				    && (tf >= psAutotalent->ffttime[ti3])
-				    && (tf > tf2)) {
-					tf2 = tf;
-					ti4 = ti;
-				}
-			}
-			if (tf2 > 0) {
-				conf = tf2 * psAutotalent->acwinv[ti4];
-				if (ti4 > 0 && ti4 < Nf) {
-					// Find the center of mass in the vicinity of the detected peak
-					tf = psAutotalent->ffttime[ti4 -
-								   1] * (ti4 -
-									 1);
-					tf = tf +
-					    psAutotalent->ffttime[ti4] * ti4;
-					tf = tf + psAutotalent->ffttime[ti4 +
-									1] *
-					    (ti4 + 1);
-					tf = tf /
-					    (psAutotalent->ffttime[ti4 - 1] +
-					     psAutotalent->ffttime[ti4] +
-					     psAutotalent->ffttime[ti4 + 1]);
-					pperiod = tf / fs;
-				} else {
-					pperiod = (float)ti4 / fs;
-				}
-			}
-			// Convert to semitones
-			tf = (float)-12 * log10((float)aref * pperiod) * L2SC;
-			if (conf >= psAutotalent->vthresh) {
-				inpitch = tf;
-				psAutotalent->inpitch = tf;	// update pitch only if voiced
-			}
-			psAutotalent->conf = conf;
+// Pitch manipulation, from the measured period and confidence
+static AT_INLINE void
+targetPitch(Autotalent * psAutotalent, const AutotalentSettings * s,
+	    float pperiod, float conf, const int iKernel)
+{
+	long int N;
+	long int fs;
+
+	long int ti;
+	long int ti2;
+	long int ti3;
+	float tf;
+	float tf2;
 
-			//  ---- END Calculate pitch and confidence ----
+	int lowersnap;
+	int uppersnap;
+	float lfoval;
 
-			//  ---- Modify pitch in all kinds of ways! ----
+	float inpitch;
+	float outpitch;
+	float aref;
 
-			outpitch = inpitch;
+	N = psAutotalent->cbsize;
+	fs = psAutotalent->fs;
 
-			// Pull to fixed pitch
-			outpitch = ((1 - fPull) * outpitch) + (fPull * fFixed);
+	aref = psAutotalent->aref;
+	inpitch = psAutotalent->inpitch;
 
-			// -- Convert from semitones to scale notes --
-			ti = (int)(outpitch / 12 + 32) - 32;	// octave
-			tf = outpitch - (ti * 12);	// semitone in octave
-			ti2 = (int)tf;
-			ti3 = ti2 + 1;
-			// a little bit of pitch correction logic, since it's a convenient place for it
-			if (iNotes[ti2 % 12] < 0 || iNotes[ti3 % 12] < 0) {	// if between 2 notes that are more than a semitone apart
+	// Convert to semitones
+	tf = (float)-12 * log10((float)aref * pperiod) * L2SC;
+	if (conf >= psAutotalent->vthresh) {
+		inpitch = tf;
+		psAutotalent->inpitch = tf;	// update pitch only if voiced
+	}
+	psAutotalent->conf = conf;
+
+	//  ---- END Calculate pitch and confidence ----
+
+	//  ---- Modify pitch in all kinds of ways! ----
+
+	outpitch = inpitch;
+
+	// Pull to fixed pitch
+	outpitch = ((1 - s->fPull) * outpitch) + (s->fPull * s->fFixed);
+
+	// -- Convert from semitones to scale notes --
+	ti = (int)(outpitch / 12 + 32) - 32;	// octave
+	tf = outpitch - (ti * 12);	// semitone in octave
+	ti2 = (int)tf;
+	ti3 = ti2 + 1;
+	// a little bit of pitch correction logic, since it's a convenient place for it
+	// (every note of the chromatic scale is in the scale and snaps)
+	lowersnap = 1;
+	uppersnap = 1;
+	if (iKernel & AT_KERNEL_SCALE) {
+		if (s->iNotes[ti2 % 12] < 0 || s->iNotes[ti3 % 12] < 0) {	// if between 2 notes that are more than a semitone apart
+			lowersnap = 1;
+			uppersnap = 1;
+		} else {
+			lowersnap = 0;
+			uppersnap = 0;
+			if (s->iNotes[ti2 % 12] == 1) {	// if specified by user
 				lowersnap = 1;
-				uppersnap = 1;
-			} else {
-				lowersnap = 0;
-				uppersnap = 0;
-				if (iNotes[ti2 % 12] == 1) {	// if specified by user
-					lowersnap = 1;
-				}
-				if (iNotes[ti3 % 12] == 1) {	// if specified by user
-					uppersnap = 1;
-				}
-			}
-			// (back to the semitone->scale conversion)
-			// finding next lower pitch in scale
-			while (iNotes[(ti2 + 12) % 12] < 0) {
-				ti2 = ti2 - 1;
-			}
-			// finding next higher pitch in scale
-			while (iNotes[ti3 % 12] < 0) {
-				ti3 = ti3 + 1;
-			}
-			tf = (tf - ti2) / (ti3 - ti2) +
-			    iPitch2Note[(ti2 + 12) % 12];
-			if (ti2 < 0) {
-				tf = tf - numNotes;
-			}
-			outpitch = tf + (numNotes * ti);
-			// -- Done converting to scale notes --
-
-			// The actual pitch correction
-			ti = (int)(outpitch + 128) - 128;
-			tf = outpitch - ti - 0.5;
-			ti2 = ti3 - ti2;
-			if (ti2 > 2) {	// if more than 2 semitones apart, put a 2-semitone-like transition halfway between
-				tf2 = (float)ti2 / 2;
-			} else {
-				tf2 = (float)1;
-			}
-			if (fSmooth < 0.001) {
-				tf2 = (tf * tf2) / 0.001;
-			} else {
-				tf2 = (tf * tf2) / fSmooth;
 			}
-			if (tf2 < -0.5)
-				tf2 = -0.5;
-			if (tf2 > 0.5)
-				tf2 = 0.5;
-			tf2 = 0.5 * sin(PI * tf2) + 0.5;	// jumping between notes using horizontally-scaled sine segment
-			tf2 = tf2 + ti;
-			if ((tf < 0.5 && lowersnap) || (tf >= 0.5 && uppersnap)) {
-				outpitch =
-				    (fAmount * tf2) + ((float)1 -
-						       fAmount) * outpitch;
+			if (s->iNotes[ti3 % 12] == 1) {	// if specified by user
+				uppersnap = 1;
 			}
-			// Add in pitch shift
-			outpitch = outpitch + fShift;
+		}
+		// (back to the semitone->scale conversion)
+		// finding next lower pitch in scale
+		while (s->iNotes[(ti2 + 12) % 12] < 0) {
+			ti2 = ti2 - 1;
+		}
+		// finding next higher pitch in scale
+		while (s->iNotes[ti3 % 12] < 0) {
+			ti3 = ti3 + 1;
+		}
+	}
+	tf = (tf - ti2) / (ti3 - ti2) + s->iPitch2Note[(ti2 + 12) % 12];
+	if (ti2 < 0) {
+		tf = tf - s->numNotes;
+	}
+	outpitch = tf + (s->numNotes * ti);
+	// -- Done converting to scale notes --
+
+	// The actual pitch correction
+	ti = (int)(outpitch + 128) - 128;
+	tf = outpitch - ti - 0.5;
+	ti2 = ti3 - ti2;
+	if (ti2 > 2) {		// if more than 2 semitones apart, put a 2-semitone-like transition halfway between
+		tf2 = (float)ti2 / 2;
+	} else {
+		tf2 = (float)1;
+	}
+	if (s->fSmooth < 0.001) {
+		tf2 = (tf * tf2) / 0.001;
+	} else {
+		tf2 = (tf * tf2) / s->fSmooth;
+	}
+	if (tf2 < -0.5)
+		tf2 = -0.5;
+	if (tf2 > 0.5)
+		tf2 = 0.5;
+	tf2 = 0.5 * sin(PI * tf2) + 0.5;	// jumping between notes using horizontally-scaled sine segment
+	tf2 = tf2 + ti;
+	if ((tf < 0.5 && lowersnap) || (tf >= 0.5 && uppersnap)) {
+		outpitch =
+		    (s->fAmount * tf2) + ((float)1 - s->fAmount) * outpitch;
+	}
+	// Add in pitch shift
+	outpitch = outpitch + s->fShift;
 
-			// LFO logic
-			tf = (fLforate * N) / (psAutotalent->noverlap * fs);
-			if (tf > 1) {
-				tf = 1;
-			}
-			psAutotalent->lfophase = psAutotalent->lfophase + tf;
-			if (psAutotalent->lfophase > 1) {
-				psAutotalent->lfophase =
-				    psAutotalent->lfophase - 1;
+	// LFO logic
+	tf = (s->fLforate * N) / (psAutotalent->noverlap * fs);
+	if (tf > 1) {
+		tf = 1;
+	}
+	psAutotalent->lfophase = psAutotalent->lfophase + tf;
+	if (psAutotalent->lfophase > 1) {
+		psAutotalent->lfophase = psAutotalent->lfophase - 1;
+	}
+	// With no LFO depth lfoval is zero, which leaves outpitch unchanged
+	lfoval = 0;
+	if (iKernel & AT_KERNEL_LFO) {
+		lfoval = psAutotalent->lfophase;
+		tf = (s->fLfosymm + 1) / 2;
+		if (tf <= 0 || tf >= 1) {
+			if (tf <= 0) {
+				lfoval = 1 - lfoval;
 			}
-			lfoval = psAutotalent->lfophase;
-			tf = (fLfosymm + 1) / 2;
-			if (tf <= 0 || tf >= 1) {
-				if (tf <= 0) {
-					lfoval = 1 - lfoval;
-				}
+		} else {
+			if (lfoval <= tf) {
+				lfoval = lfoval / tf;
 			} else {
-				if (lfoval <= tf) {
-					lfoval = lfoval / tf;
-				} else {
-					lfoval = 1 - (lfoval - tf) / (1 - tf);
-				}
+				lfoval = 1 - (lfoval - tf) / (1 - tf);
 			}
-			if (fLfoshape >= 0) {
-				// linear combination of cos and line
-				lfoval =
-				    (0.5 - 0.5 * cos(lfoval * PI)) * fLfoshape +
-				    lfoval * (1 - fLfoshape);
-				lfoval = fLfoamp * (lfoval * 2 - 1);
+		}
+		if (s->fLfoshape >= 0) {
+			// linear combination of cos and line
+			lfoval =
+			    (0.5 - 0.5 * cos(lfoval * PI)) * s->fLfoshape +
+			    lfoval * (1 - s->fLfoshape);
+			lfoval = s->fLfoamp * (lfoval * 2 - 1);
+		} else {
+			// smoosh the sine horizontally until it's squarish
+			tf = 1 + s->fLfoshape;
+			if (tf < 0.001) {
+				lfoval = ((lfoval - 0.5) * 2) / 0.001;
 			} else {
-				// smoosh the sine horizontally until it's squarish
-				tf = 1 + fLfoshape;
-				if (tf < 0.001) {
-					lfoval = ((lfoval - 0.5) * 2) / 0.001;
-				} else {
-					lfoval = ((lfoval - 0.5) * 2) / tf;
-				}
-				if (lfoval > 1) {
-					lfoval = 1;
-				}
-				if (lfoval < -1) {
-					lfoval = -1;
-				}
-				lfoval = fLfoamp * sin(lfoval * PI * 0.5);
+				lfoval = ((lfoval - 0.5) * 2) / tf;
 			}
-			// add in quantized LFO
-			if (iLfoquant >= 1) {
-				outpitch =
-				    outpitch + (int)(numNotes * lfoval +
-						     numNotes + 0.5) - numNotes;
+			if (lfoval > 1) {
+				lfoval = 1;
 			}
-			// Convert back from scale notes to semitones
-			outpitch = outpitch + iScwarp;	// output scale rotate implemented here
-			ti = (int)(outpitch / numNotes + 32) - 32;
-			tf = outpitch - (ti * numNotes);
-			ti2 = (int)tf;
-			ti3 = ti2 + 1;
-			outpitch =
-			    iNote2Pitch[ti3 % numNotes] - iNote2Pitch[ti2];
-			if (ti3 >= numNotes) {
-				outpitch = outpitch + 12;
+			if (lfoval < -1) {
+				lfoval = -1;
 			}
-			outpitch = outpitch * (tf - ti2) + iNote2Pitch[ti2];
-			outpitch = outpitch + (12 * ti);
-			outpitch = outpitch - (iNote2Pitch[iScwarp] - iNote2Pitch[0]);	//more scale rotation here
+			lfoval = s->fLfoamp * sin(lfoval * PI * 0.5);
+		}
+		// add in quantized LFO
+		if (s->iLfoquant >= 1) {
+			outpitch =
+			    outpitch + (int)(s->numNotes * lfoval + s->numNotes +
+					     0.5) - s->numNotes;
+		}
+	}
+	// Convert back from scale notes to semitones
+	outpitch = outpitch + s->iScwarp;	// output scale rotate implemented here
+	ti = (int)(outpitch / s->numNotes + 32) - 32;
+	tf = outpitch - (ti * s->numNotes);
+	ti2 = (int)tf;
+	ti3 = ti2 + 1;
+	outpitch = s->iNote2Pitch[ti3 % s->numNotes] - s->iNote2Pitch[ti2];
+	if (ti3 >= s->numNotes) {
+		outpitch = outpitch + 12;
+	}
+	outpitch = outpitch * (tf - ti2) + s->iNote2Pitch[ti2];
+	outpitch = outpitch + (12 * ti);
+	outpitch = outpitch - (s->iNote2Pitch[s->iScwarp] - s->iNote2Pitch[0]);	//more scale rotation here
 
-			// add in unquantized LFO
-			if (iLfoquant <= 0) {
-				outpitch = outpitch + lfoval * 2;
-			}
+	// add in unquantized LFO
+	if (s->iLfoquant <= 0) {
+		outpitch = outpitch + lfoval * 2;
+	}
 
-			if (outpitch < -36) {
-				outpitch = -48;
-			}
-			if (outpitch > 24) {
-				outpitch = 24;
-			}
+	if (outpitch < -36) {
+		outpitch = -48;
+	}
+	if (outpitch > 24) {
+		outpitch = 24;
+	}
 
-			psAutotalent->outpitch = outpitch;
+	psAutotalent->outpitch = outpitch;
 
-			//  ---- END Modify pitch in all kinds of ways! ----
+	//  ---- END Modify pitch in all kinds of ways! ----
 
-			// Compute variables for pitch shifter that depend on pitch
-			psAutotalent->inphinc =
-			    aref * pow(2, inpitch / 12) / fs;
-			psAutotalent->outphinc =
-			    aref * pow(2, outpitch / 12) / fs;
-			psAutotalent->phincfact =
-			    psAutotalent->outphinc / psAutotalent->inphinc;
-		}
-		// ************************
-		// * END Low-Rate Section *
-		// ************************
+	// Compute variables for pitch shifter that depend on pitch
+	psAutotalent->inphinc = aref * pow(2, inpitch / 12) / fs;
+	psAutotalent->outphinc = aref * pow(2, outpitch / 12) / fs;
+	psAutotalent->phincfact = psAutotalent->outphinc / psAutotalent->inphinc;
+}
+
+void
+targetAutotalentPitch(Autotalent * psAutotalent, const AutotalentSettings * s,
+		      float period, float confidence)
+{
+	targetPitch(psAutotalent, s, period, confidence, s->iKernel);
+}
 
-		// *****************
-		// * Pitch Shifter *
-		// *****************
+// Run pitch estimation / manipulation code, once every N/noverlap samples
+static AT_INLINE void
+estimatePitch(Autotalent * psAutotalent, const AutotalentSettings * s,
+	      const int iKernel)
+{
+	float pperiod;
+	float conf;
+
+	if (measurePitch(psAutotalent, &pperiod, &conf) != 0) {
+		return;
+	}
+	targetPitch(psAutotalent, s, pperiod, conf, iKernel);
+}
+
+void
+estimateAutotalentPitch(Autotalent * psAutotalent, const AutotalentSettings * s)
+{
+	estimatePitch(psAutotalent, s, s->iKernel);
+}
+
+// Pitch shifter (kind of like a pitch-synchronous version of Fairbanks' technique)
+//   Shifts samples Offset..Offset+SampleCount-1 of the sub-block into blkwet
+//   Note: pitch estimate is naturally N/2 samples old
+void
+shiftAutotalentBlock(Autotalent * psAutotalent, unsigned long Offset,
+		     unsigned long SampleCount)
+{
+	long int N;
+	unsigned long lSampleIndex;
+
+	long int ti;
+	long int ti2;
+	long int ti3;
+	float tf;
+
+	// Variables for cubic spline interpolator
+	float indd;
+	int ind0;
+	int ind1;
+	int ind2;
+	int ind3;
+	float vald;
+	float val0;
+	float val1;
+	float val2;
+	float val3;
 
-		// Pitch shifter (kind of like a pitch-synchronous version of Fairbanks' technique)
-		//   Note: pitch estimate is naturally N/2 samples old
+	N = psAutotalent->cbsize;
+
+	for (lSampleIndex = Offset; lSampleIndex < Offset + SampleCount;
+	     lSampleIndex++) {
 		psAutotalent->phasein =
 		    psAutotalent->phasein + psAutotalent->inphinc;
 		psAutotalent->phaseout =
 		    psAutotalent->phaseout + psAutotalent->outphinc;
 
 		//   When input phase resets, take a snippet from N/2 samples in the past
+		//   (only ever on the last sample of a sub-block, so cbiwr is current)
 		if (psAutotalent->phasein >= 1) {
 			psAutotalent->phasein = psAutotalent->phasein - 1;
 			ti2 = psAutotalent->cbiwr - (N / 2);
-			for (ti = -N / 2; ti < N / 2; ti++) {
-				psAutotalent->frag[(ti + N) % N] =
-				    psAutotalent->cbf[(ti + ti2 + N) % N];
+			if (psAutotalent->cbf != NULL) {
+				for (ti = -N / 2; ti < N / 2; ti++) {
+					psAutotalent->frag[(ti + N) % N] =
+					    psAutotalent->cbf[(ti + ti2 +
+							       N) % N];
+				}
+			} else {
+				// compact, before any formant state exists
+				for (ti = -N / 2; ti < N / 2; ti++) {
+					psAutotalent->frag[(ti + N) % N] =
+					    psAutotalent->cbi[(ti + ti2 +
+							       N) % N] /
+					    (float)FP_FACTOR;
+				}
 			}
 		}
 		//   When output phase resets, put a snippet N/2 samples in the future
@@ -960,142 +2658,511 @@ void runAutotalent(Autotalent * Instance, unsigned long SampleCount)
 		if (psAutotalent->cbord >= N) {
 			psAutotalent->cbord = 0;
 		}
-		// *********************
-		// * END Pitch Shifter *
-		// *********************
-
-		ti4 = (psAutotalent->cbiwr + 2) % N;
-		if (iFcorr >= 1) {
-			// The second part of the formant corrector
-			// This is a post-filter that re-applies the formants, designed
-			//   to result in the exact original signal when no pitch
-			//   manipulation is performed.
-			// tf is signal input
-			// gotta run it 3 times because of a pesky delay free loop
-			//  first time: compute 0-response
-			tf2 = tf;
-			fa = 0;
-			fb = fa;
-			for (ti = 0; ti < ford; ti++) {
-				fc = (fb - psAutotalent->frc[ti]) * frlamb +
-				    psAutotalent->frb[ti];
-				tf = psAutotalent->fbuff[ti][ti4];
-				fb = fc - (tf * fa);
-				psAutotalent->ftvec[ti] = (tf * fc);
-				fa = fa - psAutotalent->ftvec[ti];
-			}
-			tf = -fa;
-			for (ti = ford - 1; ti >= 0; ti--) {
-				tf = tf + psAutotalent->ftvec[ti];
-			}
-			f0resp = tf;
-			//  second time: compute 1-response
-			fa = 1;
-			fb = fa;
-			for (ti = 0; ti < ford; ti++) {
-				fc = (fb - psAutotalent->frc[ti]) * frlamb +
-				    psAutotalent->frb[ti];
-				tf = psAutotalent->fbuff[ti][ti4];
-				fb = fc - (tf * fa);
-				psAutotalent->ftvec[ti] = tf * fc;
-				fa = fa - psAutotalent->ftvec[ti];
-			}
-			tf = -fa;
-			for (ti = ford - 1; ti >= 0; ti--) {
-				tf = tf + psAutotalent->ftvec[ti];
-			}
-			f1resp = tf;
-			//  now solve equations for output, based on 0-response and 1-response
-			tf = ((float)2) * tf2;
-			tf2 = tf;
-			tf = (((float)1) - f1resp + f0resp);
-			if (tf != 0) {
-				tf2 = (tf2 + f0resp) / tf;
-			} else {
-				tf2 = 0;
-			}
-			//  third time: update delay registers
-			fa = tf2;
-			fb = fa;
-			for (ti = 0; ti < ford; ti++) {
-				fc = (fb - psAutotalent->frc[ti]) * frlamb +
-				    psAutotalent->frb[ti];
-				psAutotalent->frc[ti] = fc;
-				psAutotalent->frb[ti] = fb;
-				tf = psAutotalent->fbuff[ti][ti4];
-				fb = fc - (tf * fa);
-				fa = fa - (tf * fc);
-			}
-			tf = tf2;
-			tf = tf + (flpa * psAutotalent->flp);	// lowpass post-emphasis filter
-			psAutotalent->flp = tf;
-			// Bring up the gain slowly when formant correction goes from disabled
-			// to enabled, while things stabilize.
-			if (psAutotalent->fmute > 0.5) {
-				tf = tf * (psAutotalent->fmute - 0.5) * 2;
-			} else {
-				tf = 0;
+		psAutotalent->blkwet[lSampleIndex] = tf;
+	}
+}
+
+// The second part of the formant corrector, run over blkwet in place
+//   This is a post-filter that re-applies the formants, designed
+//   to result in the exact original signal when no pitch
+//   manipulation is performed.
+static AT_INLINE void
+resynthesizeBlock(Autotalent * psAutotalent, const AutotalentSettings * s,
+		  unsigned long SampleCount, const int iKernel)
+{
+	unsigned long lSampleIndex;
+	long int ti;
+	long int ford;
+	float tf;
+	float tf2;
+	float fa;
+	float fb;
+	float fc;
+	float frlamb;
+	float flpa;
+	float f1resp;
+	float f0resp;
+	float *coef;
+
+	if (!(iKernel & AT_KERNEL_FORMANT)) {
+		psAutotalent->fmute = 0;
+		return;
+	}
+
+	ford = psAutotalent->ford;
+	frlamb = s->frlamb;
+	flpa = s->flpa;
+
+	for (lSampleIndex = 0; lSampleIndex < SampleCount; lSampleIndex++) {
+		coef = psAutotalent->blkcoef + lSampleIndex * ford;
+		tf = psAutotalent->blkwet[lSampleIndex];
+		// tf is signal input
+		// gotta run it 3 times because of a pesky delay free loop
+		//  first time: compute 0-response
+		tf2 = tf;
+		fa = 0;
+		fb = fa;
+		for (ti = 0; ti < ford; ti++) {
+			fc = (fb - psAutotalent->frc[ti]) * frlamb +
+			    psAutotalent->frb[ti];
+			tf = coef[ti];
+			fb = fc - (tf * fa);
+			psAutotalent->ftvec[ti] = (tf * fc);
+			fa = fa - psAutotalent->ftvec[ti];
+		}
+		tf = -fa;
+		for (ti = ford - 1; ti >= 0; ti--) {
+			tf = tf + psAutotalent->ftvec[ti];
+		}
+		f0resp = tf;
+		//  second time: compute 1-response
+		fa = 1;
+		fb = fa;
+		for (ti = 0; ti < ford; ti++) {
+			fc = (fb - psAutotalent->frc[ti]) * frlamb +
+			    psAutotalent->frb[ti];
+			tf = coef[ti];
+			fb = fc - (tf * fa);
+			psAutotalent->ftvec[ti] = tf * fc;
+			fa = fa - psAutotalent->ftvec[ti];
+		}
+		tf = -fa;
+		for (ti = ford - 1; ti >= 0; ti--) {
+			tf = tf + psAutotalent->ftvec[ti];
+		}
+		f1resp = tf;
+		//  now solve equations for output, based on 0-response and 1-response
+		tf = ((float)2) * tf2;
+		tf2 = tf;
+		tf = (((float)1) - f1resp + f0resp);
+		if (tf != 0) {
+			tf2 = (tf2 + f0resp) / tf;
+		} else {
+			tf2 = 0;
+		}
+		//  third time: update delay registers
+		fa = tf2;
+		fb = fa;
+		for (ti = 0; ti < ford; ti++) {
+			fc = (fb - psAutotalent->frc[ti]) * frlamb +
+			    psAutotalent->frb[ti];
+			psAutotalent->frc[ti] = fc;
+			psAutotalent->frb[ti] = fb;
+			tf = coef[ti];
+			fb = fc - (tf * fa);
+			fa = fa - (tf * fc);
+		}
+		tf = tf2;
+		tf = tf + (flpa * psAutotalent->flp);	// lowpass post-emphasis filter
+		psAutotalent->flp = tf;
+		// Bring up the gain slowly when formant correction goes from disabled
+		// to enabled, while things stabilize.
+		if (psAutotalent->fmute > 0.5) {
+			tf = tf * (psAutotalent->fmute - 0.5) * 2;
+		} else {
+			tf = 0;
+		}
+		tf2 = psAutotalent->fmutealph;
+		psAutotalent->fmute = (1 - tf2) + (tf2 * psAutotalent->fmute);
+		// now tf is signal output
+		// ...and we're done messing with formants
+		psAutotalent->blkwet[lSampleIndex] = tf;
+	}
+}
+
+void
+resynthesizeAutotalentBlock(Autotalent * psAutotalent,
+			    const AutotalentSettings * s,
+			    unsigned long SampleCount)
+{
+	resynthesizeBlock(psAutotalent, s, SampleCount, s->iKernel);
+}
+
+// Write audio to output of plugin
+// Mix (blend between original (delayed) =0 and processed =1)
+//   At mix 1 the dry term is exactly zero and is left out.
+static AT_INLINE void
+mixOutput(Autotalent * psAutotalent, const AutotalentSettings * s,
+	  short *pfOutput, unsigned long SampleCount, const int iKernel)
+{
+	unsigned long ti;
+	float fMix;
+
+	if (!(iKernel & AT_KERNEL_MIX)) {
+		for (ti = 0; ti < SampleCount; ti++) {
+			pfOutput[ti] =
+			    (short)(psAutotalent->blkwet[ti] * FP_FACTOR);
+		}
+		return;
+	}
+	fMix = s->fMix;
+	for (ti = 0; ti < SampleCount; ti++) {
+		pfOutput[ti] =
+		    (short)(((1 - fMix) * psAutotalent->blkdry[ti] +
+			     fMix * psAutotalent->blkwet[ti]) * FP_FACTOR);
+	}
+}
+
+void
+mixAutotalentOutput(Autotalent * psAutotalent, const AutotalentSettings * s,
+		    short *pfOutput, unsigned long SampleCount)
+{
+	mixOutput(psAutotalent, s, pfOutput, SampleCount, s->iKernel);
+}
+
+// Bypass: only run the dry delay line the mix would have blended in
+//   The shifter output that would have been heard meanwhile is dropped,
+//   and formant correction fades in again as it does when switched on.
+static void
+bypassBlocks(Autotalent * psAutotalent, short *pfInput, short *pfOutput,
+	     unsigned long SampleCount)
+{
+	unsigned long N;
+	unsigned long hop;
+	unsigned long len;
+	unsigned long ti;
+	unsigned long ti4;
+
+	N = psAutotalent->cbsize;
+	hop = N / psAutotalent->noverlap;
+	psAutotalent->fmute = 0;
+
+	while (SampleCount > 0) {
+		len = SampleCount < hop ? SampleCount : hop;
+		ti4 = psAutotalent->cbiwr;
+		for (ti = 0; ti < len; ti++) {
+			pfOutput[ti] = psAutotalent->cbi[(ti4 + 3) % N];
+			psAutotalent->cbi[ti4] = pfInput[ti];
+			if (psAutotalent->cbf != NULL) {
+				psAutotalent->cbf[ti4] =
+				    pfInput[ti] / (float)FP_FACTOR;
 			}
-			tf2 = psAutotalent->fmutealph;
-			psAutotalent->fmute =
-			    (1 - tf2) + (tf2 * psAutotalent->fmute);
-			// now tf is signal output
-			// ...and we're done messing with formants
+			ti4 = (ti4 + 1) % N;
+		}
+		psAutotalent->cbiwr = ti4;
+		psAutotalent->position += len;
+		for (ti = 0; ti < len; ti++) {
+			psAutotalent->cbo[psAutotalent->cbord] = 0;
+			psAutotalent->cbord = (psAutotalent->cbord + 1) % N;
+		}
+		pfInput += len;
+		pfOutput += len;
+		SampleCount -= len;
+	}
+}
+
+// Processing loop, specialized on the AT_KERNEL_* flags in iKernel
+//   The chunk is cut into sub-blocks (see getAutotalentBlockLength) and
+//   each sub-block goes through the stages in turn.
+static AT_INLINE void
+processBlocks(Autotalent * psAutotalent, const AutotalentSettings * s,
+	      short *pfInput, short *pfOutput, unsigned long SampleCount,
+	      const int iKernel)
+{
+	unsigned long len;
+	int hop;
+
+	while (SampleCount > 0) {
+		len = getAutotalentBlockLength(psAutotalent, SampleCount, &hop);
+
+		convertAutotalentInput(psAutotalent, pfInput, len);
+		analyzeBlock(psAutotalent, s, len, iKernel);
+		if (hop) {
+			shiftAutotalentBlock(psAutotalent, 0, len - 1);
+			estimatePitch(psAutotalent, s, iKernel);
+			shiftAutotalentBlock(psAutotalent, len - 1, 1);
 		} else {
-			psAutotalent->fmute = 0;
+			shiftAutotalentBlock(psAutotalent, 0, len);
 		}
+		resynthesizeBlock(psAutotalent, s, len, iKernel);
+		mixOutput(psAutotalent, s, pfOutput, len, iKernel);
+
+		pfInput += len;
+		pfOutput += len;
+		SampleCount -= len;
+	}
+}
+
+typedef void (*AutotalentKernel) (Autotalent *, const AutotalentSettings *,
+				  short *, short *, unsigned long);
+
+#define AT_DEFINE_KERNEL(flags) \
+static void \
+processKernel##flags(Autotalent * psAutotalent, const AutotalentSettings * s, \
+		     short *pfInput, short *pfOutput, unsigned long SampleCount) \
+{ \
+	processBlocks(psAutotalent, s, pfInput, pfOutput, SampleCount, flags); \
+}
+
+AT_DEFINE_KERNEL(0)
+AT_DEFINE_KERNEL(1)
+AT_DEFINE_KERNEL(2)
+AT_DEFINE_KERNEL(3)
+AT_DEFINE_KERNEL(4)
+AT_DEFINE_KERNEL(5)
+AT_DEFINE_KERNEL(6)
+AT_DEFINE_KERNEL(7)
+AT_DEFINE_KERNEL(8)
+AT_DEFINE_KERNEL(9)
+AT_DEFINE_KERNEL(10)
+AT_DEFINE_KERNEL(11)
+AT_DEFINE_KERNEL(12)
+AT_DEFINE_KERNEL(13)
+AT_DEFINE_KERNEL(14)
+AT_DEFINE_KERNEL(15)
+
+static const AutotalentKernel kernels[AT_KERNEL_COUNT] = {
+	processKernel0, processKernel1, processKernel2, processKernel3,
+	processKernel4, processKernel5, processKernel6, processKernel7,
+	processKernel8, processKernel9, processKernel10, processKernel11,
+	processKernel12, processKernel13, processKernel14, processKernel15
+};
+
+// Flush subnormal floats to zero for the duration of one call
+//   The recursive filters and the output buffer decay into subnormals in
+//   silence, which most FPUs handle in slow microcode or software.
+//   Without SSE or hard-float VFP there is no control to set.
+#if defined(__SSE__)
+#define AT_FTZ_DAZ 0x8040	// MXCSR flush-to-zero and denormals-are-zero
+
+static unsigned long flushDenormals(void)
+{
+	unsigned int csr;
+
+	csr = _mm_getcsr();
+	_mm_setcsr(csr | AT_FTZ_DAZ);
+	return csr;
+}
+
+static void restoreDenormals(unsigned long csr)
+{
+	_mm_setcsr(csr);
+}
+#elif defined(__aarch64__)
+#define AT_FPCR_FZ (1UL << 24)
+
+static unsigned long flushDenormals(void)
+{
+	unsigned long fpcr;
+
+	__asm__ __volatile__("mrs %0, fpcr":"=r"(fpcr));
+	__asm__ __volatile__("msr fpcr, %0"::"r"(fpcr | AT_FPCR_FZ));
+	return fpcr;
+}
+
+static void restoreDenormals(unsigned long fpcr)
+{
+	__asm__ __volatile__("msr fpcr, %0"::"r"(fpcr));
+}
+#elif defined(__arm__) && defined(__VFP_FP__) && !defined(__SOFTFP__)
+#define AT_FPSCR_FZ (1UL << 24)
+
+static unsigned long flushDenormals(void)
+{
+	unsigned long fpscr;
+
+	__asm__ __volatile__("vmrs %0, fpscr":"=r"(fpscr));
+	__asm__ __volatile__("vmsr fpscr, %0"::"r"(fpscr | AT_FPSCR_FZ));
+	return fpscr;
+}
+
+static void restoreDenormals(unsigned long fpscr)
+{
+	__asm__ __volatile__("vmsr fpscr, %0"::"r"(fpscr));
+}
+#else
+static unsigned long flushDenormals(void)
+{
+	return 0;
+}
+
+static void restoreDenormals(unsigned long state)
+{
+}
+#endif
+
+// Have runAutotalent flush subnormals to zero, restoring the caller's
+// floating-point mode before it returns
+void setAutotalentDenormalMode(Autotalent * autotalent, int flush)
+{
+	autotalent->flushdenormals = flush;
+}
+
+// Called every time we get a new chunk of audio
+//   New control values are picked up here.  The chunk is split where
+//   automation events are due, and the kernel is chosen once for each
+//   part from the cached settings.
+void runAutotalent(Autotalent * Instance, unsigned long SampleCount)
+{
+	Autotalent *psAutotalent;
+	AutotalentSettings *settings;
+	short *pfInput;
+	short *pfOutput;
+	unsigned long len;
+	unsigned long fpstate;
+	int flush;
 
-		// Write audio to output of plugin
-		// Mix (blend between original (delayed) =0 and processed =1)
-		*(pfOutput++) =
-		    (short)(((1 - fMix) * psAutotalent->cbi[ti4] +
-			     fMix * tf) * FP_FACTOR);
+	psAutotalent = (Autotalent *) Instance;
+	flush = psAutotalent->flushdenormals;
+	if (flush) {
+		fpstate = flushDenormals();
+	}
+	pollAutotalentParameters(psAutotalent);
+	settings = &psAutotalent->settings;
+
+	pfInput = psAutotalent->m_pfInputBuffer1;
+	pfOutput = psAutotalent->m_pfOutputBuffer1;
+	while (SampleCount > 0) {
+		len = applyEvents(psAutotalent, SampleCount);
+		if (len == 0) {
+			continue;
+		}
+		if (settings->iBypass) {
+			bypassBlocks(psAutotalent, pfInput, pfOutput, len);
+		} else {
+			kernels[settings->iKernel] (psAutotalent, settings,
+						    pfInput, pfOutput, len);
+		}
+		advanceEvents(psAutotalent, len);
+		pfInput += len;
+		pfOutput += len;
+		SampleCount -= len;
+	}
+	if (flush) {
+		restoreDenormals(fpstate);
 	}
 }
 
 void cleanupAutotalent(Autotalent * Instance)
 {
+	AutotalentAllocator allocator;
+
+	if (Instance == NULL) {
+		return;
+	}
+	// the allocator lives in the memory it frees
+	allocator = Instance->allocator;
+	releaseTables(Instance->tables);
+	atFree(&allocator, Instance->formantmem);
+	atFree(&allocator, Instance);
+}
+
+// Report the memory an instance holds
+void
+getAutotalentFootprint(Autotalent * Instance, AutotalentFootprint * footprint)
+{
+	footprint->instance = Instance->arenasize;
+	footprint->formant = Instance->formantsize;
+	pthread_mutex_lock(&tableLock);
+	footprint->shared = Instance->tables->size;
+	footprint->sharers = Instance->tables->refs;
+	pthread_mutex_unlock(&tableLock);
+}
+
+// Pool of reset instances of one sample rate
+struct AutotalentPool {
+	pthread_mutex_t lock;
+	Autotalent *idle;	// linked through poolnext
+	unsigned long fs;
+	AutotalentAllocator allocator;
+};
+
+AutotalentPool *createAutotalentPool(unsigned long SampleRate, int count,
+				     const AutotalentAllocator * allocator)
+{
+	AutotalentPool *pool;
+	Autotalent *instance;
 	int ti;
-	fft_des(Instance->fmembvars);
-	free(Instance->cbi);
-	free(Instance->cbf);
-	free(Instance->cbo);
-	free(Instance->cbwindow);
-	free(Instance->hannwindow);
-	free(Instance->acwinv);
-	free(Instance->frag);
-	free(Instance->ffttime);
-	free(Instance->fftfreqre);
-	free(Instance->fftfreqim);
-	free(Instance->fk);
-	free(Instance->fb);
-	free(Instance->fc);
-	free(Instance->frb);
-	free(Instance->frc);
-	free(Instance->fsmooth);
-	free(Instance->fsig);
-	for (ti = 0; ti < Instance->ford; ti++) {
-		free(Instance->fbuff[ti]);
-	}
-	free(Instance->fbuff);
-	free(Instance->ftvec);
-
-	// we allocated these so it keeps the values properly
-	free(Instance->m_pfTune);
-	free(Instance->m_pfFixed);
-	free(Instance->m_pfPull);
-	free(Instance->m_pfAmount);
-	free(Instance->m_pfSmooth);
-	free(Instance->m_pfShift);
-	free(Instance->m_pfScwarp);
-	free(Instance->m_pfLfoamp);
-	free(Instance->m_pfLforate);
-	free(Instance->m_pfLfoshape);
-	free(Instance->m_pfLfosymm);
-	free(Instance->m_pfLfoquant);
-	free(Instance->m_pfFcorr);
-	free(Instance->m_pfFwarp);
-	free(Instance->m_pfMix);
-
-	free(Instance);
+
+	if (allocator == NULL) {
+		allocator = &libcAllocator;
+	}
+	pool = atAlloc(allocator, sizeof(AutotalentPool));
+	if (pool == NULL) {
+		return NULL;
+	}
+	pthread_mutex_init(&pool->lock, NULL);
+	pool->fs = SampleRate;
+	pool->allocator = *allocator;
+
+	// pre-warm, so that the tables and arenas are paid for up front
+	for (ti = 0; ti < count; ti++) {
+		instance =
+		    instantiateAutotalentWithAllocator(SampleRate, allocator);
+		if (instance == NULL) {
+			break;
+		}
+		instance->pool = pool;
+		instance->poolnext = pool->idle;
+		pool->idle = instance;
+	}
+	return pool;
+}
+
+// Take an instance in its freshly instantiated state from the pool
+//   Only instantiates when the pool has run dry.
+Autotalent *acquireAutotalent(AutotalentPool * pool)
+{
+	Autotalent *instance;
+
+	pthread_mutex_lock(&pool->lock);
+	instance = pool->idle;
+	if (instance != NULL) {
+		pool->idle = instance->poolnext;
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	if (instance == NULL) {
+		instance =
+		    instantiateAutotalentWithAllocator(pool->fs,
+						       &pool->allocator);
+		if (instance == NULL) {
+			return NULL;
+		}
+		instance->pool = pool;
+	}
+	instance->poolnext = NULL;
+	return instance;
+}
+
+// Reset an instance and give it back to the pool it came from
+//   The reset happens here so that the next acquire is only a pop.  What
+//   the session handed the instance goes too: its buffers, its analysis,
+//   which the session may close, and its denormal mode.
+void releaseAutotalent(Autotalent * instance)
+{
+	AutotalentPool *pool;
+
+	pool = instance->pool;
+	setDefaultParams(&instance->params);
+	resetAutotalent(instance);
+	instance->m_pfInputBuffer1 = NULL;
+	instance->m_pfOutputBuffer1 = NULL;
+	instance->analysis = NULL;
+	instance->flushdenormals = 0;
+
+	pthread_mutex_lock(&pool->lock);
+	instance->poolnext = pool->idle;
+	pool->idle = instance;
+	pthread_mutex_unlock(&pool->lock);
+}
+
+// Free a pool and its idle instances
+//   Every acquired instance must have been released first.
+void destroyAutotalentPool(AutotalentPool * pool)
+{
+	AutotalentAllocator allocator;
+	Autotalent *instance;
+
+	if (pool == NULL) {
+		return;
+	}
+	while (pool->idle != NULL) {
+		instance = pool->idle;
+		pool->idle = instance->poolnext;
+		cleanupAutotalent(instance);
+	}
+	pthread_mutex_destroy(&pool->lock);
+	allocator = pool->allocator;
+	atFree(&allocator, pool);
 }
@@ -19,6 +19,9 @@
  */
 /*****************************************************************************/
 
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
 #include "fft.h"
 
 #define AT_A 0
@@ -207,80 +210,211 @@
 #define FP_DIGITS 15
 #define FP_FACTOR (1 << FP_DIGITS)
 
+// alignment of every block of instance memory
+#define AT_CACHE_LINE 64
+#define AT_LINE_ALIGNED __attribute__((aligned(AT_CACHE_LINE)))
+
+// samples per formant analysis block
+#define AT_BLOCK 64
+
+// Features a processing kernel is specialized for
+#define AT_KERNEL_FORMANT 1	// formant correction on
+#define AT_KERNEL_MIX 2		// dry signal mixed in (mix != 1)
+#define AT_KERNEL_LFO 4		// LFO depth not zero
+#define AT_KERNEL_SCALE 8	// scale other than chromatic
+#define AT_KERNEL_COUNT 16
+
+// Parameter ids for setAutotalentParameter
+#define AT_PARAM_TUNE 0
+#define AT_PARAM_FIXED 1
+#define AT_PARAM_PULL 2
+#define AT_PARAM_AMOUNT 3
+#define AT_PARAM_SMOOTH 4
+#define AT_PARAM_SHIFT 5
+#define AT_PARAM_SCWARP 6
+#define AT_PARAM_LFOAMP 7
+#define AT_PARAM_LFORATE 8
+#define AT_PARAM_LFOSHAPE 9
+#define AT_PARAM_LFOSYMM 10
+#define AT_PARAM_LFOQUANT 11
+#define AT_PARAM_FCORR 12
+#define AT_PARAM_FWARP 13
+#define AT_PARAM_MIX 14
+#define AT_PARAM_COUNT 15
+
+// Memory source for an instance
+//   alloc returns size bytes aligned to align, or NULL; the library zeroes
+//   them itself.  free releases a block returned by alloc.  Both are only
+//   called from instantiate and cleanup, never from the audio path.
 typedef struct {
-	float *m_pfTune;
-	float *m_pfFixed;
-	float *m_pfPull;
-	int *m_pfKey;
-	float *m_pfAmount;
-	float *m_pfSmooth;
-	float *m_pfShift;
-	int *m_pfScwarp;
-	float *m_pfLfoamp;
-	float *m_pfLforate;
-	float *m_pfLfoshape;
-	float *m_pfLfosymm;
-	int *m_pfLfoquant;
-	int *m_pfFcorr;
-	float *m_pfFwarp;
-	float *m_pfMix;
-
-	short *m_pfInputBuffer1;
-	short *m_pfOutputBuffer1;
-
-	fft_vars *fmembvars;	// member variables for fft routine
-
-	unsigned long fs;	// Sample rate
+	void *(*alloc) (void *ctx, size_t size, size_t align);
+	void (*free) (void *ctx, void *mem);
+	void *ctx;
+} AutotalentAllocator;
+
+typedef struct AutotalentPool AutotalentPool;
+
+// Read-only windows for one (fs, cbsize), shared between instances
+typedef struct AutotalentTables {
+	struct AutotalentTables *next;
+	size_t size;		// bytes of the tables
+	unsigned long fs;
+	unsigned long cbsize;
+	unsigned long nmin;	// searched lags, as in the instance
+	unsigned long nmax;
+	int refs;		// instances using the tables, under the table lock
+	float *hannwindow;
+	float *cbwindow;
+	float *acwinv;		// lags nmin to nmax only
+	AutotalentAllocator allocator;	// where the tables came from
+	struct AutotalentScratch *scratch;	// for threads not prepared
+	pthread_mutex_t scratchlock;
+} AutotalentTables;
+
+// Analysis of a fixed take that does not depend on the settings
+//   Mapped from a file written by writeAutotalentAnalysis.  The instance
+//   using it must start the take from its freshly instantiated or reset
+//   state; samples count from there.
+typedef struct {
+	void *map;		// the mapped file
+	size_t size;
+	int writable;		// being recorded rather than replayed
+	unsigned long fs;
+	unsigned long cbsize;
+	unsigned long hop;
+	unsigned long length;	// samples of the take
+	unsigned long nhops;
+	int ford;
+	uint64_t checksum;	// of the take, see checkAutotalentAnalysis
+	float *pitch;		// period (s) and confidence, per hop
+	float *formant;		// residual and ford coefficients per sample, or NULL
+	float *lattice;		// formant lattice at the end of the take, or NULL
+} AutotalentAnalysis;
 
-	unsigned long cbsize;	// size of circular buffer
-	unsigned long corrsize;	// cbsize/2 + 1
-	unsigned long cbiwr;
-	unsigned long cbord;
-	float *cbi;		// circular input buffer
-	float *cbf;		// circular formant correction buffer
-	float *cbo;		// circular output buffer
+// Also cache the formant analysis, (ford + 1) floats per sample
+#define AT_ANALYSIS_FORMANT 1
 
-	float *cbwindow;	// hann of length N/2, zeros for the rest
-	float *acwinv;		// inverse of autocorrelation of window
-	float *hannwindow;	// length-N hann
-	int noverlap;
+// Floats of formant lattice state: the pre-emphasis and five per stage
+#define AT_LATTICE_SIZE(ford) (1 + 5 * (ford))
 
-	float *ffttime;
-	float *fftfreqre;
-	float *fftfreqim;
+// Memory held by an instance, in bytes
+typedef struct {
+	size_t instance;	// the arena allocated with the instance
+	size_t formant;		// formant state allocated later, compact mode only
+	size_t shared;		// tables shared with instances of the same rate
+	int sharers;		// instances sharing those tables
+} AutotalentFootprint;
 
-	// VARIABLES FOR LOW-RATE SECTION
-	float aref;		// A tuning reference (Hz)
-	float inpitch;		// Input pitch (semitones)
-	float conf;		// Confidence of pitch period estimate (between 0 and 1)
-	float outpitch;		// Output pitch (semitones)
-	float vthresh;		// Voiced speech threshold
+// Control values
+typedef struct {
+	float fTune;
+	float fFixed;
+	float fPull;
+	int iKey[12];
+	float fAmount;
+	float fSmooth;
+	float fShift;
+	int iScwarp;
+	float fLfoamp;
+	float fLforate;
+	float fLfoshape;
+	float fLfosymm;
+	int iLfoquant;
+	int iFcorr;
+	float fFwarp;
+	float fMix;
+	// stores per AT_PARAM_* id and, last, the key; the merge takes over
+	// a field whose count moved, even if it was set to the same value
+	unsigned int changes[AT_PARAM_COUNT + 1];
+} AutotalentParams;
+
+// Automation event, see queueAutotalentEvent
+typedef struct {
+	int param;		// AT_PARAM_* id
+	unsigned long offset;	// samples from the start of the next call
+	float value;
+	unsigned long ramp;	// samples to reach value over, 0 to jump
+} AutotalentEvent;
 
-	float pmax;		// Maximum allowable pitch period (seconds)
-	float pmin;		// Minimum allowable pitch period (seconds)
-	unsigned long nmax;	// Maximum period index for pitch prd est
-	unsigned long nmin;	// Minimum period index for pitch prd est
+// Automation ramp in progress, inactive while length is 0
+typedef struct {
+	float start;
+	float target;
+	unsigned long length;
+	unsigned long elapsed;
+} AutotalentRamp;
 
-	float lrshift;		// Shift prescribed by low-rate section
-	int ptarget;		// Pitch target, between 0 and 11
-	float sptarget;		// Smoothed pitch target
+// capacity of the automation event queue
+#define AT_EVENT_COUNT 64
 
-	float lfophase;
+// samples between updates of a ramping parameter
+#define AT_RAMP_STEP 16
 
-	// VARIABLES FOR PITCH SHIFTER
-	float phprdd;		// default (unvoiced) phase period
+// Everything the processing derives from the control values
+typedef struct {
+	float fAmount;
+	float fSmooth;
+	int iNotes[12];
+	int iPitch2Note[12];
+	int iNote2Pitch[12];
+	int numNotes;
+	float fTune;
+	float fFixed;
+	float fPull;
+	float fShift;
+	int iScwarp;
+	float fLfoamp;
+	float fLforate;
+	float fLfoshape;
+	float fLfosymm;
+	int iLfoquant;
+	int iFcorr;
+	float fFwarp;
+	float fMix;
+	float falph;
+	float foma;
+	float flamb;
+	float frlamb;
+	float flpa;
+	int iKernel;		// AT_KERNEL_* flags of the processing kernel
+	int iBypass;		// only run the dry delay
+} AutotalentSettings;
+
+// Instance state, grouped by which thread touches it and how often
+//   Each group starts on its own cache line so that the control thread
+//   and the audio thread do not false-share.  The struct itself is a
+//   whole number of lines, and every arena starts on a line, so
+//   neighbouring instances never share one either.
+typedef struct Autotalent {
+	// HOT, audio thread, touched every sample
+	unsigned long cbiwr AT_LINE_ALIGNED;
+	unsigned long cbord;
+	double phasein;
+	double phaseout;
 	double inphinc;		// input phase increment
 	double outphinc;	// input phase increment
 	double phincfact;	// factor determining output phase increment
-	double phasein;
-	double phaseout;
-	float *frag;		// windowed fragment of speech
 	unsigned long fragsize;	// size of fragment in samples
+	float fhp;
+	float flp;
+	float fmute;
+	float lfophase;
+	unsigned long position;	// samples processed since reset
 
-	// VARIABLES FOR FORMANT CORRECTOR
-	int ford;
-	float falph;
-	float flamb;
+	short *m_pfInputBuffer1;
+	short *m_pfOutputBuffer1;
+	short *cbi;		// circular input buffer, as input samples
+	float *cbf;		// circular formant correction buffer, or NULL
+	float *cbo;		// circular output buffer
+	float *frag;		// windowed fragment of speech
+
+	// SUB-BLOCK STAGING, at most cbsize/noverlap samples
+	float *blkin;		// converted input
+	float *blkdry;		// delayed dry signal
+	float *blkwet;		// processed signal
+	float *blkcoef;		// delayed formant coefficients, ford per sample
+
+	// FORMANT CORRECTOR, audio thread
 	float *fk;
 	float *fb;
 	float *fc;
@@ -288,24 +422,529 @@ typedef struct {
 	float *frc;
 	float *fsig;
 	float *fsmooth;
-	float fhp;
-	float flp;
-	float flpa;
 	float **fbuff;
 	float *ftvec;
-	float fmute;
+	float *fwa;		// wavefront stage inputs (ford + 1 lanes)
+	float *fwb;
+	float *fwna;		// wavefront stage outputs (ford + 1 lanes)
+	float *fwnb;
+	float *fablk;		// analysis residual for the current block
+	float *fkblk;		// lattice coefficients per wavefront step
+
+	// LOW-RATE SECTION, audio thread, once per hop
+	float inpitch;		// Input pitch (semitones)
+	float conf;		// Confidence of pitch period estimate (between 0 and 1)
+	float outpitch;		// Output pitch (semitones)
+	float lrshift;		// Shift prescribed by low-rate section
+	int ptarget;		// Pitch target, between 0 and 11
+	float sptarget;		// Smoothed pitch target
+
+	// PARAMETERS IN EFFECT, audio thread, read every sample
+	AutotalentSettings settings AT_LINE_ALIGNED;	// derived from live
+	AutotalentParams live;	// values in effect
+
+	// AUTOMATION AND MAILBOX READ SIDE, audio thread, once per call
+	int mboxfront;		// slot owned by the audio thread
+	AutotalentParams mboxlast;	// values last picked up from the mailbox
+	AutotalentEvent events[AT_EVENT_COUNT];	// sorted by offset
+	int nevents;
+	AutotalentRamp ramps[AT_PARAM_COUNT];
+
+	// PARAMETER MAILBOX
+	//   Setters edit params and publish a copy through a triple buffer;
+	//   runAutotalent picks up the latest copy when it starts a call.
+	volatile int mboxmid AT_LINE_ALIGNED;	// slot in between, AT_MAILBOX_NEW if unread
+	void *volatile formantmem;	// compact mode formant state, once prepared
+	volatile int formantstate;	// AT_FORMANT_*, who holds formantmem
+	AutotalentParams mbox[3] AT_LINE_ALIGNED;
+
+	// MAILBOX WRITE SIDE, control thread
+	AutotalentParams params AT_LINE_ALIGNED;	// latest values
+	int mboxback;		// slot owned by the control thread
+
+	// CONFIGURATION, fixed after instantiation, read-mostly
+	unsigned long fs AT_LINE_ALIGNED;	// Sample rate
+	unsigned long cbsize;	// size of circular buffer
+	unsigned long corrsize;	// cbsize/2 + 1
+	int noverlap;
+	float aref;		// A tuning reference (Hz)
+	float vthresh;		// Voiced speech threshold
+	float pmax;		// Maximum allowable pitch period (seconds)
+	float pmin;		// Minimum allowable pitch period (seconds)
+	unsigned long nmax;	// Maximum period index for pitch prd est
+	unsigned long nmin;	// Minimum period index for pitch prd est
+	float phprdd;		// default (unvoiced) phase period
+	int ford;
+	float falph;
+	float flamb;
+	float flpa;
 	float fmutealph;
 
+	AutotalentTables *tables;	// shared windows below
+	float *cbwindow;	// hann of length N/2, zeros for the rest
+	float *acwinv;		// inverse of autocorrelation of window, from nmin
+	float *hannwindow;	// length-N hann
+	int compact;		// formant state only while enabled
+	AutotalentAnalysis *analysis;	// cached analysis of the take, or NULL
+	int flushdenormals;	// run with subnormals flushed to zero
+
+	// COLD, instantiate and cleanup only
+	size_t arenasize;	// bytes of the arena holding all of the state
+	size_t formantsize;	// bytes at formantmem
+	AutotalentAllocator allocator;	// where the arena came from
+	struct AutotalentPool *pool;	// pool the instance belongs to, if any
+	struct Autotalent *poolnext;	// next idle instance of the pool
 } Autotalent;
 
+
 Autotalent *instantiateAutotalent(unsigned long sampleRate);
 
+// As instantiateAutotalent, taking all memory from allocator (libc if NULL)
+Autotalent *instantiateAutotalentWithAllocator(unsigned long sampleRate,
+					       const AutotalentAllocator *
+					       allocator);
+
+// Compact mode, for hosts running very many instances
+//   The formant corrector state, nearly three quarters of an instance, is
+//   only allocated by enableAutotalentFormant and freed again by
+//   releaseAutotalentFormant, both on the control thread.
+Autotalent *instantiateCompactAutotalent(unsigned long sampleRate,
+					 const AutotalentAllocator * allocator);
+
+int enableAutotalentFormant(Autotalent * instance);
+
+int releaseAutotalentFormant(Autotalent * instance);
+
 void setAutotalentKey(Autotalent * autotalent, char *keyPtr);
 
+void
+setAutotalentParameter(Autotalent * autotalent, int param, float value);
+
+int
+queueAutotalentEvent(Autotalent * autotalent, int param, unsigned long offset,
+		     float value, unsigned long ramp);
+
 void
 setAutotalentBuffers(Autotalent * autotalent, short *inputBuffer,
 		     short *outputBuffer);
 
 void runAutotalent(Autotalent * instance, unsigned long sampleCount);
 
+// Flush subnormal floats to zero while processing (off by default)
+//   Keeps silence as cheap as voice; has no effect on soft-float ABIs.
+void setAutotalentDenormalMode(Autotalent * autotalent, int flush);
+
+// Processing stages, in the order runAutotalent drives them over each
+// sub-block.  They are exposed so that each can be exercised on its own.
+void loadAutotalentSettings(Autotalent * instance,
+			    AutotalentSettings * settings);
+
+int pollAutotalentParameters(Autotalent * instance);
+
+unsigned long
+getAutotalentBlockLength(Autotalent * instance, unsigned long sampleCount,
+			 int *hop);
+
+void
+convertAutotalentInput(Autotalent * instance, short *input,
+		       unsigned long sampleCount);
+
+void
+analyzeAutotalentBlock(Autotalent * instance,
+		       const AutotalentSettings * settings,
+		       unsigned long sampleCount);
+
+void
+estimateAutotalentPitch(Autotalent * instance,
+			const AutotalentSettings * settings);
+
+// estimateAutotalentPitch in its two halves, measurement and target
+int
+measureAutotalentPitch(Autotalent * instance, float *period,
+		       float *confidence);
+
+void
+targetAutotalentPitch(Autotalent * instance,
+		      const AutotalentSettings * settings, float period,
+		      float confidence);
+
+void
+shiftAutotalentBlock(Autotalent * instance, unsigned long offset,
+		     unsigned long sampleCount);
+
+void
+resynthesizeAutotalentBlock(Autotalent * instance,
+			    const AutotalentSettings * settings,
+			    unsigned long sampleCount);
+
+void
+mixAutotalentOutput(Autotalent * instance,
+		    const AutotalentSettings * settings, short *output,
+		    unsigned long sampleCount);
+
 void cleanupAutotalent(Autotalent * instance);
+
+void getAutotalentFootprint(Autotalent * instance,
+			    AutotalentFootprint * footprint);
+
+// Clear all processing state, keeping parameters, buffers, analysis and
+// denormal mode
+void resetAutotalent(Autotalent * instance);
+
+void setAutotalentDefaults(Autotalent * autotalent);
+
+// Snapshots of the complete processing state, for forking a warmed-up
+// instance into several renders
+size_t getAutotalentStateSize(Autotalent * instance);
+
+size_t saveAutotalentState(Autotalent * instance, void *state, size_t size);
+
+int
+restoreAutotalentState(Autotalent * instance, const void *state, size_t size);
+
+// Checkpoints: the part of a snapshot needed to resume processing the
+// same input, which restoring takes again to rebuild the input ring
+size_t getAutotalentCheckpointSize(Autotalent * instance);
+
+size_t
+saveAutotalentCheckpoint(Autotalent * instance, void *checkpoint, size_t size);
+
+int
+restoreAutotalentCheckpoint(Autotalent * instance, const void *checkpoint,
+			    size_t size, const short *input);
+
+Autotalent *cloneAutotalent(Autotalent * instance);
+
+// Pre-warmed instances for hosts that open and close many sessions
+//   acquire and release are O(1) and thread-safe; acquire instantiates
+//   only when the pool is empty.
+AutotalentPool *createAutotalentPool(unsigned long sampleRate, int count,
+				     const AutotalentAllocator * allocator);
+
+Autotalent *acquireAutotalent(AutotalentPool * pool);
+
+void releaseAutotalent(Autotalent * instance);
+
+void destroyAutotalentPool(AutotalentPool * pool);
+
+// Zeroed, line-aligned memory from the allocator of an instance, for
+// structures that live alongside it
+void *allocAutotalentMemory(Autotalent * instance, size_t size);
+
+void freeAutotalentMemory(Autotalent * instance, void *mem);
+
+// Test hook: count of allocations the library has made.  It does not move
+// across any setter, nor across runAutotalent.
+unsigned long getAutotalentAllocCount(void);
+
+// Give the calling thread FFT scratch of its own, from allocator (NULL
+// for libc), freed when the thread exits.  Pitch estimates on threads
+// never prepared share one scratch per set of tables, under a lock.
+int prepareAutotalentThread(const AutotalentAllocator * allocator);
+
+// Offline rendering of a take with seeking
+//   The first pass over the take records a state checkpoint every
+//   interval samples; a seek then restores the nearest one at or before
+//   the target and pre-rolls only the rest.  Checkpoints hold the
+//   settings they were recorded with, so clear them after changing any.
+//   Each holds what getAutotalentCheckpointSize gives, about 87 KB at
+//   44.1 kHz with formant state and 21 KB for a compact instance
+//   without, so a take of length samples keeps length / interval of them.
+typedef struct AutotalentRenderer AutotalentRenderer;
+
+AutotalentRenderer *createAutotalentRenderer(Autotalent * instance,
+					     const short *take,
+					     unsigned long length,
+					     unsigned long interval);
+
+unsigned long
+renderAutotalent(AutotalentRenderer * renderer, unsigned long start,
+		 unsigned long count, short *output);
+
+void clearAutotalentCheckpoints(AutotalentRenderer * renderer);
+
+void destroyAutotalentRenderer(AutotalentRenderer * renderer);
+
+// Cached analysis of a fixed take for fast re-renders
+//   writeAutotalentAnalysis runs the analysis over the take once; an
+//   instance given the mapped file with setAutotalentAnalysis then skips
+//   the pitch autocorrelation, and the formant lattice if the file has
+//   it, for as much of the take as the file covers; past that the live
+//   lattice carries on from the state the file ends with.  The formant
+//   cache matches a render with formant correction on from the start.
+//   checkAutotalentAnalysis tells whether a file was made from a take.
+int
+writeAutotalentAnalysis(const char *path, unsigned long sampleRate,
+			const short *take, unsigned long length, int flags);
+
+AutotalentAnalysis *openAutotalentAnalysis(const char *path);
+
+void closeAutotalentAnalysis(AutotalentAnalysis * analysis);
+
+int
+setAutotalentAnalysis(Autotalent * instance, AutotalentAnalysis * analysis);
+
+int
+checkAutotalentAnalysis(const AutotalentAnalysis * analysis, const short *take,
+			unsigned long length);
+
+void storeAutotalentLattice(const Autotalent * instance, float *lattice);
+
+// One runAutotalent call of a batch
+typedef struct {
+	Autotalent *instance;
+	short *input;
+	short *output;
+	unsigned long length;
+} AutotalentJob;
+
+typedef struct AutotalentWorkers AutotalentWorkers;
+
+// Worker threads for batches of jobs; the caller of a batch works too, so
+// threads is the number of extra cores to use
+AutotalentWorkers *createAutotalentWorkers(int threads);
+
+// Run every job and return once all are done
+//   An instance may appear in only one job of a batch.  If another batch
+//   is already using the workers, or workers is NULL, the jobs run in
+//   order on the calling thread.
+void
+runAutotalentJobs(AutotalentWorkers * workers, AutotalentJob * jobs,
+		  int count);
+
+void destroyAutotalentWorkers(AutotalentWorkers * workers);
+
+// Lock-free ring of samples between one producer and one consumer
+//   It holds no pointers and only fixed-width indices, so it can sit in
+//   memory mapped at different addresses by different processes.  head
+//   and tail count samples and wrap freely; size is a power of two.
+typedef struct {
+	volatile uint32_t head AT_LINE_ALIGNED;	// advanced by the producer
+	volatile uint32_t tail AT_LINE_ALIGNED;	// advanced by the consumer
+	uint32_t size AT_LINE_ALIGNED;	// samples
+	short data[];
+} AutotalentRing;
+
+// Bytes of a ring holding at least samples samples
+size_t getAutotalentRingSize(unsigned long samples);
+
+void initAutotalentRing(AutotalentRing * ring, unsigned long samples);
+
+unsigned long getAutotalentRingFill(const AutotalentRing * ring);
+
+// Contiguous room (producer) or samples (consumer) at *data; commit and
+// consume then hand them over to the other side
+unsigned long getAutotalentRingWritable(AutotalentRing * ring, short **data);
+
+void commitAutotalentRing(AutotalentRing * ring, unsigned long count);
+
+unsigned long getAutotalentRingReadable(AutotalentRing * ring, short **data);
+
+void consumeAutotalentRing(AutotalentRing * ring, unsigned long count);
+
+// Copy in or out as much as fits, returning the number of samples
+unsigned long
+writeAutotalentRing(AutotalentRing * ring, const short *samples,
+		    unsigned long count);
+
+unsigned long
+readAutotalentRing(AutotalentRing * ring, short *samples, unsigned long count);
+
+// The same for a ring shared with a process that is not trusted, taking
+// the size the caller validated once instead of the one in the ring
+unsigned long
+getAutotalentSharedRingWritable(AutotalentRing * ring, uint32_t size,
+				short **data);
+
+unsigned long
+getAutotalentSharedRingReadable(AutotalentRing * ring, uint32_t size,
+				short **data);
+
+unsigned long
+writeAutotalentSharedRing(AutotalentRing * ring, uint32_t size,
+			  const short *samples, unsigned long count);
+
+unsigned long
+readAutotalentSharedRing(AutotalentRing * ring, uint32_t size,
+			 short *samples, unsigned long count);
+
+// Real-time engine for an instance
+//   A thread of its own, at real-time priority where the system allows
+//   it, processes whole blocks from an input ring into an output ring.
+//   The caller only writes input and reads output, from one producer and
+//   one consumer thread.  Setters still apply while the engine runs;
+//   runAutotalent must not be called on the instance meanwhile.
+typedef struct AutotalentStream AutotalentStream;
+
+typedef struct {
+	unsigned long blocks;	// blocks processed
+	unsigned long overruns;	// input samples dropped, input ring full
+	unsigned long underruns;	// output samples asked for, not ready
+	unsigned long inputfill;	// samples waiting to be processed
+	unsigned long outputfill;	// samples waiting to be read
+} AutotalentStreamStats;
+
+AutotalentStream *startAutotalentStream(Autotalent * instance,
+					unsigned long ringSamples,
+					unsigned long blockSize);
+
+unsigned long
+writeAutotalentStream(AutotalentStream * stream, const short *samples,
+		      unsigned long count);
+
+unsigned long
+readAutotalentStream(AutotalentStream * stream, short *samples,
+		     unsigned long count);
+
+void
+getAutotalentStreamStats(AutotalentStream * stream,
+			 AutotalentStreamStats * stats);
+
+void stopAutotalentStream(AutotalentStream * stream);
+
+// Shared-memory transport to an instance in a separate process
+//   The host creates the region in a shared file descriptor (memfd,
+//   ashmem or shm) and hands the descriptor to a worker process, which
+//   maps it and serves it with an instance of its own.  Audio goes through
+//   two lock-free rings and parameters through a block in the region, with
+//   futexes to wake either side.  One host thread writes, one reads.
+//   Each side keeps the geometry it checked once in a handle of its own,
+//   and no wait outlasts a block period, so that the other process can
+//   neither steer it out of the region nor hold it up for good.
+typedef struct AutotalentTransport AutotalentTransport;
+
+AutotalentTransport *createAutotalentTransport(int fd,
+					       unsigned long sampleRate,
+					       unsigned long ringSamples,
+					       unsigned long blockSize);
+
+AutotalentTransport *openAutotalentTransport(int fd);
+
+void closeAutotalentTransport(AutotalentTransport * transport);
+
+unsigned long getAutotalentTransportRate(AutotalentTransport * transport);
+
+unsigned long
+writeAutotalentTransport(AutotalentTransport * transport,
+			 const short *samples, unsigned long count);
+
+// Returns short of count, even with wait, once the worker is lost
+unsigned long
+readAutotalentTransport(AutotalentTransport * transport, short *samples,
+			unsigned long count, int wait);
+
+// Host side: 0 while the worker beats, -1 once it has gone quiet for
+// good, crashed or killed
+int checkAutotalentTransport(AutotalentTransport * transport);
+
+void
+setAutotalentTransportParameter(AutotalentTransport * transport, int param,
+				float value);
+
+void setAutotalentTransportKey(AutotalentTransport * transport, char key);
+
+void stopAutotalentTransport(AutotalentTransport * transport);
+
+int serveAutotalentTransport(AutotalentTransport * transport,
+			     Autotalent * instance);
+
+// Engine processing many streams on a fixed pool of worker threads
+//   Each stream runs on one worker at a time.  A stream with work is
+//   queued on the worker that last ran it, so its state stays in that
+//   core's cache, and each worker runs its streams earliest deadline
+//   first; a worker with nothing queued steals the most urgent stream of
+//   the others.  Workers share no lock: queuing a stream takes the lock
+//   of one worker's queue, and a stream going idle only its own.
+typedef struct AutotalentEngine AutotalentEngine;
+
+// Per-stream figures, latencies in microseconds from submit to done
+typedef struct {
+	unsigned long blocks;	// blocks processed
+	unsigned long misses;	// blocks done after their deadline
+	unsigned long migrations;	// times the stream changed worker
+	unsigned long meanlatency;
+	unsigned long maxlatency;
+} AutotalentEngineReport;
+
+AutotalentEngine *createAutotalentEngine(int threads, int maxStreams);
+
+int addAutotalentEngineStream(AutotalentEngine * engine, Autotalent * instance);
+
+Autotalent *getAutotalentEngineInstance(AutotalentEngine * engine, int id);
+
+int
+submitAutotalentBlock(AutotalentEngine * engine, int id, short *input,
+		      short *output, unsigned long length,
+		      unsigned long deadline);
+
+void waitAutotalentEngineStream(AutotalentEngine * engine, int id);
+
+void
+getAutotalentEngineReport(AutotalentEngine * engine, int id,
+			  AutotalentEngineReport * report);
+
+Autotalent *removeAutotalentEngineStream(AutotalentEngine * engine, int id);
+
+void destroyAutotalentEngine(AutotalentEngine * engine);
+
+// Channels of one performance, e.g. a stereo or multi-mic vocal
+//   Pitch is estimated once, on a key channel or on the downmix, and
+//   every channel is shifted with it, so grains land at the same times
+//   in all of them.  Each channel keeps its own shifter and output.
+#define AT_CHANNELS_MAX 8
+#define AT_CHANNELS_DOWNMIX -1	// estimate on the average of all channels
+
+// Adapt the formant filter on the key only, and apply it to every channel
+#define AT_CHANNELS_SHARE_FORMANT 1
+
+typedef struct AutotalentChannels AutotalentChannels;
+
+AutotalentChannels *createAutotalentChannels(unsigned long sampleRate,
+					     int count, int keyChannel,
+					     int flags);
+
+void
+setAutotalentChannelsParameter(AutotalentChannels * channels, int param,
+			       float value);
+
+void setAutotalentChannelsKey(AutotalentChannels * channels, char *keyPtr);
+
+// Ignored for a channel outside 0 .. count - 1
+void
+setAutotalentChannelBuffers(AutotalentChannels * channels, int channel,
+			    short *inputBuffer, short *outputBuffer);
+
+// Does nothing while any channel is missing a buffer
+void
+runAutotalentChannels(AutotalentChannels * channels,
+		      unsigned long sampleCount);
+
+void destroyAutotalentChannels(AutotalentChannels * channels);
+
+// Voices of a harmony, all from one input
+//   The input is taken in, formant analyzed and pitch measured once.
+//   Each voice has its own parameters, so its own pitch target, and its
+//   own shifter, post-filter, mix and output buffer.
+#define AT_HARMONY_VOICES_MAX 8
+
+typedef struct AutotalentHarmony AutotalentHarmony;
+
+AutotalentHarmony *createAutotalentHarmony(unsigned long sampleRate,
+					   int voices);
+
+void
+setAutotalentHarmonyParameter(AutotalentHarmony * harmony, int voice,
+			      int param, float value);
+
+void
+setAutotalentHarmonyKey(AutotalentHarmony * harmony, int voice,
+			char *keyPtr);
+
+void
+setAutotalentHarmonyBuffers(AutotalentHarmony * harmony, short *inputBuffer,
+			    short *const *outputBuffers);
+
+void
+runAutotalentHarmony(AutotalentHarmony * harmony, unsigned long sampleCount);
+
+void destroyAutotalentHarmony(AutotalentHarmony * harmony);
@@ -45,6 +45,27 @@ fft_vars *fft_con(int nfft)
 	return membvars;
 }
 
+// Size of the memory fft_init needs for an nfft point transform
+size_t fft_size(int nfft)
+{
+	return ((sizeof(fft_vars) + 15) & ~(size_t) 15) + nfft * sizeof(float);
+}
+
+// Constructor for FFT routine in fft_size(nfft) zeroed bytes at mem
+//   Nothing is allocated; the memory stays owned by the caller.
+fft_vars *fft_init(void *mem, int nfft)
+{
+	fft_vars *membvars = (fft_vars *) mem;
+
+	membvars->nfft = nfft;
+	membvars->numfreqs = nfft / 2 + 1;
+
+	membvars->fft_data =
+	    (float *)((char *)mem + ((sizeof(fft_vars) + 15) & ~(size_t) 15));
+
+	return membvars;
+}
+
 // Destructor for FFT routine
 void fft_des(fft_vars * membvars)
 {
@@ -27,6 +27,8 @@
  *
  */
 
+#include <stddef.h>
+
 typedef struct {
 	int nfft;		// size of FFT
 	int numfreqs;		// number of frequencies represented (nfft/2 +1)
@@ -35,6 +37,10 @@ typedef struct {
 
 fft_vars *fft_con(int nfft);
 
+size_t fft_size(int nfft);
+
+fft_vars *fft_init(void *mem, int nfft);
+
 void fft_des(fft_vars * membvars);
 
 void
@@ -52,6 +52,8 @@ http://crca.ucsd.edu/~msp/software.html */
 * of work.  -msp
 */
 
+#include <string.h>
+
 #define REAL float
 #define GOOD_TRIG
 
@@ -168,7 +170,9 @@ static REAL sintab[20] = {
 	.00004793689960306688454900399049465887274686668768
 };
 
-static REAL coswrk[20] = {
+// Initial trig work values; each transform works on its own copy so that
+// transforms may run on several threads at once
+static const REAL coswrk0[20] = {
 	.00000000000000000000000000000000000000000000000000,
 	.70710678118654752440084436210484903928483593768847,
 	.92387953251128675612818318939678828682241662586364,
@@ -187,7 +191,7 @@ static REAL coswrk[20] = {
 	.99999999885102682756267330779455410840053741619428
 };
 
-static REAL sinwrk[20] = {
+static const REAL sinwrk0[20] = {
 	1.0000000000000000000000000000000000000000000000000,
 	.70710678118654752440084436210484903928483593768846,
 	.38268343236508977172845998403039886676134456248561,
@@ -216,8 +220,13 @@ REAL c1,s1,s2,c2,s3,c3,s4,c4;
  REAL f0,g0,f1,g1,f2,g2,f3,g3; */
 	int k, k1, k2, k3, k4, kx;
 	REAL *fi, *fn, *gi;
+	REAL coswrk[20];
+	REAL sinwrk[20];
 	TRIG_VARS;
 
+	memcpy(coswrk, coswrk0, sizeof(coswrk));
+	memcpy(sinwrk, sinwrk0, sizeof(sinwrk));
+
 	for (k1 = 1, k2 = 0; k1 < n; k1++) {
 		REAL aa;
 		for (k = n >> 1; (!((k2 ^= k) & k)); k >>= 1) ;
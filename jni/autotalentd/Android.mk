@@ -0,0 +1,20 @@
+LOCAL_PATH := $(call my-dir)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := autotalentd
+LOCAL_SRC_FILES := autotalentd.c autotalentd-socket.c
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/../autotalent
+LOCAL_CFLAGS := -ftree-vectorize
+LOCAL_SHARED_LIBRARIES := autotalent
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := autotalent-loadgen
+LOCAL_SRC_FILES := autotalent-loadgen.c autotalentd-socket.c
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/../autotalent
+LOCAL_LDLIBS := -lm
+
+include $(BUILD_EXECUTABLE)
@@ -0,0 +1,269 @@
+/* autotalent-loadgen.c
+ * Autotalent library for Android
+ *
+ * Load generator for autotalentd: throughput and latency percentiles.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+/*****************************************************************************/
+#define _GNU_SOURCE
+#include "autotalentd.h"
+#include "autotalent.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+typedef struct {
+	const char *name;
+	int blocks;		// per client
+	unsigned long blocksize;
+	int shared;		// PCM through a memfd, not the socket
+	double *latencies;	// microseconds, one per block
+	int failed;
+	pthread_t thread;
+} Client;
+
+static double getMicroseconds(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int createMemfd(size_t size)
+{
+	int fd = -1;
+
+	// -m needs a kernel and headers from 3.17 on
+#ifdef __NR_memfd_create
+	fd = syscall(__NR_memfd_create, "autotalent-loadgen",
+		     MFD_ALLOW_SEALING);
+#endif
+	if (fd < 0) {
+		return -1;
+	}
+	// the daemon only maps buffers that cannot shrink under it
+	if (ftruncate(fd, size) != 0
+	    || fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+// A sung-ish test tone with some noise, so pitch tracking has work to do
+static void fillTone(short *pcm, unsigned long length, unsigned long start)
+{
+	unsigned long i;
+
+	for (i = 0; i < length; i++) {
+		pcm[i] = (short)(8000 * sin((start + i) * 0.05) +
+				 ((start + i) * 7919) % 500);
+	}
+}
+
+static int runBlock(Client * client, int sock, short *pcm)
+{
+	AutotalentMessage msg;
+	int fd;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.type = client->shared ? AT_MSG_PROCESS_SHARED : AT_MSG_PROCESS;
+	msg.length = client->blocksize;
+	if (sendAutotalentMessage(sock, &msg, -1) != 0) {
+		return -1;
+	}
+	if (!client->shared
+	    && writeAutotalentSocket(sock, pcm,
+				     client->blocksize * sizeof(short)) != 0) {
+		return -1;
+	}
+	if (receiveAutotalentMessage(sock, &msg, &fd) != 0
+	    || msg.type != AT_MSG_DONE) {
+		return -1;
+	}
+	if (!client->shared) {
+		return readAutotalentSocket(sock, pcm,
+					    client->blocksize * sizeof(short));
+	}
+	return 0;
+}
+
+static void *runClient(void *arg)
+{
+	Client *client = arg;
+	AutotalentMessage msg;
+	size_t size = client->blocksize * sizeof(short);
+	short *pcm;
+	double start;
+	int sock, fd, i;
+
+	client->failed = 1;
+	sock = connectAutotalentDaemon(client->name);
+	if (sock < 0) {
+		return NULL;
+	}
+	memset(&msg, 0, sizeof(msg));
+	msg.type = AT_MSG_PARAM;
+	msg.param = AT_PARAM_SHIFT;
+	msg.value = 2;
+	sendAutotalentMessage(sock, &msg, -1);
+
+	if (client->shared) {
+		fd = createMemfd(size);
+		pcm = fd < 0 ? MAP_FAILED :
+		    mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (pcm == MAP_FAILED) {
+			close(sock);
+			return NULL;
+		}
+		msg.type = AT_MSG_BUFFER;
+		msg.length = client->blocksize;
+		sendAutotalentMessage(sock, &msg, fd);
+		close(fd);
+		if (receiveAutotalentMessage(sock, &msg, &fd) != 0
+		    || msg.type != AT_MSG_DONE) {
+			munmap(pcm, size);
+			close(sock);
+			return NULL;
+		}
+	} else {
+		pcm = malloc(size);
+		if (pcm == NULL) {
+			close(sock);
+			return NULL;
+		}
+	}
+
+	for (i = 0; i < client->blocks; i++) {
+		fillTone(pcm, client->blocksize, i * client->blocksize);
+		start = getMicroseconds();
+		if (runBlock(client, sock, pcm) != 0) {
+			break;
+		}
+		client->latencies[i] = getMicroseconds() - start;
+	}
+	client->failed = i < client->blocks;
+
+	if (client->shared) {
+		munmap(pcm, size);
+	} else {
+		free(pcm);
+	}
+	close(sock);
+	return NULL;
+}
+
+static int compareDoubles(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: autotalent-loadgen [-s name] [-c clients] [-n blocks]"
+		" [-b samples] [-r rate] [-m]\n"
+		"  -m  pass samples through a shared memfd, not the socket\n");
+}
+
+int main(int argc, char **argv)
+{
+	const char *name = AT_DAEMON_SOCKET;
+	int clients = 8, blocks = 1000, shared = 0;
+	unsigned long blocksize = 256, rate = 44100;
+	Client *client;
+	double *all, start, elapsed;
+	int i, opt, failed = 0;
+	long total;
+
+	while ((opt = getopt(argc, argv, "s:c:n:b:r:m")) != -1) {
+		switch (opt) {
+		case 's':
+			name = optarg;
+			break;
+		case 'c':
+			clients = atoi(optarg);
+			break;
+		case 'n':
+			blocks = atoi(optarg);
+			break;
+		case 'b':
+			blocksize = strtoul(optarg, NULL, 10);
+			break;
+		case 'r':
+			rate = strtoul(optarg, NULL, 10);
+			break;
+		case 'm':
+			shared = 1;
+			break;
+		default:
+			usage();
+			return 1;
+		}
+	}
+	if (clients < 1 || blocks < 1 || blocksize == 0
+	    || blocksize > AT_MSG_MAX) {
+		usage();
+		return 1;
+	}
+	client = calloc(clients, sizeof(Client));
+	all = calloc((size_t)clients * blocks, sizeof(double));
+	if (client == NULL || all == NULL) {
+		return 1;
+	}
+
+	start = getMicroseconds();
+	for (i = 0; i < clients; i++) {
+		client[i].name = name;
+		client[i].blocks = blocks;
+		client[i].blocksize = blocksize;
+		client[i].shared = shared;
+		client[i].latencies = all + (size_t)i * blocks;
+		pthread_create(&client[i].thread, NULL, runClient, &client[i]);
+	}
+	for (i = 0; i < clients; i++) {
+		pthread_join(client[i].thread, NULL);
+		failed += client[i].failed;
+	}
+	elapsed = (getMicroseconds() - start) / 1e6;
+	if (failed > 0) {
+		fprintf(stderr, "autotalent-loadgen: %d of %d clients failed\n",
+			failed, clients);
+		return 1;
+	}
+
+	total = (long)clients * blocks;
+	qsort(all, total, sizeof(double), compareDoubles);
+	printf("%d clients x %d blocks of %lu samples%s\n", clients, blocks,
+	       blocksize, shared ? ", shared memory" : "");
+	printf("throughput: %.0f blocks/s, %.1fx real time\n",
+	       total / elapsed, total * blocksize / elapsed / rate);
+	printf("latency: p50 %.0f us, p99 %.0f us, max %.0f us\n",
+	       all[total / 2], all[total * 99 / 100], all[total - 1]);
+	free(all);
+	free(client);
+	return 0;
+}
@@ -0,0 +1,207 @@
+/* autotalentd-socket.c
+ * Autotalent library for Android
+ *
+ * Socket plumbing shared by autotalentd and its clients.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+/*****************************************************************************/
+#define _GNU_SOURCE		// struct ucred
+#include "autotalentd.h"
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stddef.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+int readAutotalentSocket(int sock, void *data, size_t size)
+{
+	char *p = data;
+	ssize_t n;
+
+	while (size > 0) {
+		n = read(sock, p, size);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return -1;
+		}
+		p += n;
+		size -= n;
+	}
+	return 0;
+}
+
+int writeAutotalentSocket(int sock, const void *data, size_t size)
+{
+	const char *p = data;
+	ssize_t n;
+
+	while (size > 0) {
+		n = send(sock, p, size, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return -1;
+		}
+		p += n;
+		size -= n;
+	}
+	return 0;
+}
+
+int sendAutotalentMessage(int sock, const AutotalentMessage * msg, int fd)
+{
+	struct msghdr mh;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	char control[CMSG_SPACE(sizeof(int))];
+	ssize_t n;
+
+	if (fd < 0) {
+		return writeAutotalentSocket(sock, msg, sizeof(*msg));
+	}
+	memset(&mh, 0, sizeof(mh));
+	memset(control, 0, sizeof(control));
+	iov.iov_base = (void *)msg;
+	iov.iov_len = sizeof(*msg);
+	mh.msg_iov = &iov;
+	mh.msg_iovlen = 1;
+	mh.msg_control = control;
+	mh.msg_controllen = sizeof(control);
+	cmsg = CMSG_FIRSTHDR(&mh);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+	do {
+		n = sendmsg(sock, &mh, MSG_NOSIGNAL);
+	} while (n < 0 && errno == EINTR);
+	if (n <= 0) {
+		return -1;
+	}
+	// the descriptor went with the first byte; send the rest plainly
+	return writeAutotalentSocket(sock, (const char *)msg + n,
+				     sizeof(*msg) - n);
+}
+
+int receiveAutotalentMessage(int sock, AutotalentMessage * msg, int *fd)
+{
+	struct msghdr mh;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	char control[CMSG_SPACE(sizeof(int))];
+	ssize_t n;
+
+	memset(&mh, 0, sizeof(mh));
+	iov.iov_base = msg;
+	iov.iov_len = sizeof(*msg);
+	mh.msg_iov = &iov;
+	mh.msg_iovlen = 1;
+	mh.msg_control = control;
+	mh.msg_controllen = sizeof(control);
+	do {
+		n = recvmsg(sock, &mh, MSG_CMSG_CLOEXEC);
+	} while (n < 0 && errno == EINTR);
+	if (n <= 0) {
+		return -1;
+	}
+	*fd = -1;
+	for (cmsg = CMSG_FIRSTHDR(&mh); cmsg != NULL;
+	     cmsg = CMSG_NXTHDR(&mh, cmsg)) {
+		if (cmsg->cmsg_level == SOL_SOCKET
+		    && cmsg->cmsg_type == SCM_RIGHTS) {
+			memcpy(fd, CMSG_DATA(cmsg), sizeof(int));
+		}
+	}
+	return readAutotalentSocket(sock, (char *)msg + n, sizeof(*msg) - n);
+}
+
+// Abstract names need no file and vanish with the daemon
+static socklen_t
+makeAddress(struct sockaddr_un *addr, const char *name)
+{
+	size_t len = strlen(name);
+
+	if (len > sizeof(addr->sun_path) - 1) {
+		len = sizeof(addr->sun_path) - 1;
+	}
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	memcpy(addr->sun_path + 1, name, len);
+	return offsetof(struct sockaddr_un, sun_path) + 1 + len;
+}
+
+int connectAutotalentDaemon(const char *name)
+{
+	struct sockaddr_un addr;
+	socklen_t len = makeAddress(&addr, name);
+	int sock;
+
+	sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (sock < 0) {
+		return -1;
+	}
+	if (connect(sock, (struct sockaddr *)&addr, len) != 0) {
+		close(sock);
+		return -1;
+	}
+	return sock;
+}
+
+int listenAutotalentDaemon(const char *name)
+{
+	struct sockaddr_un addr;
+	socklen_t len = makeAddress(&addr, name);
+	int sock;
+
+	sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (sock < 0) {
+		return -1;
+	}
+	if (bind(sock, (struct sockaddr *)&addr, len) != 0
+	    || listen(sock, SOMAXCONN) != 0) {
+		close(sock);
+		return -1;
+	}
+	return sock;
+}
+
+// An abstract socket has no file, so no permissions keep other users
+// out: the daemon checks who connected instead
+int
+checkAutotalentPeer(int sock, const uid_t * allowed, int count)
+{
+	struct ucred cred;
+	socklen_t len = sizeof(cred);
+	int i;
+
+	if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0
+	    || len != sizeof(cred)) {
+		return -1;
+	}
+	if (cred.uid == geteuid()) {
+		return 0;
+	}
+	for (i = 0; i < count; i++) {
+		if (cred.uid == allowed[i]) {
+			return 0;
+		}
+	}
+	return -1;
+}
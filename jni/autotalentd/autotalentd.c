@@ -0,0 +1,264 @@
+/* autotalentd.c
+ * Autotalent library for Android
+ *
+ * Local daemon keeping warm instances for client sessions.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+/*****************************************************************************/
+#include "autotalentd.h"
+#include "autotalent.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#define AT_DAEMON_UIDS 16	// -u options at most
+
+// Sessions draw from one pool, so a new client gets an instance that is
+// already instantiated and only needs the reset release gave it
+static AutotalentPool *pool;
+
+typedef struct {
+	int sock;
+	Autotalent *instance;
+	short *pcm;		// inline samples
+	unsigned long pcmsize;
+	short *shared;		// mapped AT_MSG_BUFFER memfd
+	unsigned long sharedsize;
+} Session;
+
+static int reply(Session * session, uint32_t type, uint32_t length)
+{
+	AutotalentMessage msg;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.type = type;
+	msg.length = length;
+	return sendAutotalentMessage(session->sock, &msg, -1);
+}
+
+static void process(Session * session, short *samples, unsigned long length)
+{
+	setAutotalentBuffers(session->instance, samples, samples);
+	runAutotalent(session->instance, length);
+}
+
+static int mapBuffer(Session * session, int fd, unsigned long length)
+{
+	struct stat st;
+	void *mem;
+	int seals;
+
+	if (session->shared != NULL) {
+		munmap(session->shared, session->sharedsize * sizeof(short));
+		session->shared = NULL;
+		session->sharedsize = 0;
+	}
+	// touching pages past the end of the file would fault, so the file
+	// must be long enough and sealed so that the client cannot shrink it
+	seals = fcntl(fd, F_GET_SEALS);
+	if (length == 0 || length > AT_MSG_MAX || seals < 0
+	    || !(seals & F_SEAL_SHRINK) || fstat(fd, &st) != 0
+	    || (unsigned long)st.st_size < length * sizeof(short)) {
+		close(fd);
+		return -1;
+	}
+	mem = mmap(NULL, length * sizeof(short), PROT_READ | PROT_WRITE,
+		   MAP_SHARED, fd, 0);
+	close(fd);
+	if (mem == MAP_FAILED) {
+		return -1;
+	}
+	session->shared = mem;
+	session->sharedsize = length;
+	return 0;
+}
+
+// Handle one message; -1 ends the session
+static int handle(Session * session, AutotalentMessage * msg, int fd)
+{
+	short *pcm;
+	char key;
+
+	if (fd >= 0 && msg->type != AT_MSG_BUFFER) {
+		close(fd);
+	}
+	switch (msg->type) {
+	case AT_MSG_PARAM:
+		setAutotalentParameter(session->instance, msg->param,
+				       msg->value);
+		return 0;
+	case AT_MSG_KEY:
+		key = msg->param;
+		setAutotalentKey(session->instance, &key);
+		return 0;
+	case AT_MSG_BUFFER:
+		if (fd < 0 || mapBuffer(session, fd, msg->length) != 0) {
+			return reply(session, AT_MSG_ERROR, 0);
+		}
+		return reply(session, AT_MSG_DONE, msg->length);
+	case AT_MSG_PROCESS:
+		// the samples follow, and cannot be skipped without reading
+		if (msg->length > AT_MSG_MAX) {
+			return -1;
+		}
+		if (msg->length > session->pcmsize) {
+			pcm = realloc(session->pcm,
+				      msg->length * sizeof(short));
+			if (pcm == NULL) {
+				return -1;
+			}
+			session->pcm = pcm;
+			session->pcmsize = msg->length;
+		}
+		if (readAutotalentSocket(session->sock, session->pcm,
+					 msg->length * sizeof(short)) != 0) {
+			return -1;
+		}
+		process(session, session->pcm, msg->length);
+		if (reply(session, AT_MSG_DONE, msg->length) != 0) {
+			return -1;
+		}
+		return writeAutotalentSocket(session->sock, session->pcm,
+					     msg->length * sizeof(short));
+	case AT_MSG_PROCESS_SHARED:
+		if (msg->length > session->sharedsize) {
+			return reply(session, AT_MSG_ERROR, 0);
+		}
+		process(session, session->shared, msg->length);
+		return reply(session, AT_MSG_DONE, msg->length);
+	default:
+		return -1;
+	}
+}
+
+static void *serveSession(void *arg)
+{
+	Session *session = arg;
+	AutotalentMessage msg;
+	int fd;
+
+	prepareAutotalentThread(NULL);
+	while (receiveAutotalentMessage(session->sock, &msg, &fd) == 0) {
+		if (handle(session, &msg, fd) != 0) {
+			break;
+		}
+	}
+	if (session->shared != NULL) {
+		munmap(session->shared, session->sharedsize * sizeof(short));
+	}
+	releaseAutotalent(session->instance);
+	close(session->sock);
+	free(session->pcm);
+	free(session);
+	return NULL;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: autotalentd [-s name] [-r rate] [-w warm] "
+		"[-u uid]...\n"
+		"  -s  abstract socket name (default %s)\n"
+		"  -r  sample rate of every session (default 44100)\n"
+		"  -w  instances to instantiate up front (default 16)\n"
+		"  -u  also accept clients running as uid; by default only\n"
+		"      clients of the daemon's own uid are accepted\n",
+		AT_DAEMON_SOCKET);
+}
+
+int main(int argc, char **argv)
+{
+	const char *name = AT_DAEMON_SOCKET;
+	unsigned long rate = 44100;
+	uid_t allowed[AT_DAEMON_UIDS];
+	int nallowed = 0;
+	int warm = 16;
+	char *end;
+	Session *session;
+	pthread_attr_t attr;
+	pthread_t thread;
+	int listener, sock, opt;
+
+	while ((opt = getopt(argc, argv, "s:r:w:u:")) != -1) {
+		switch (opt) {
+		case 's':
+			name = optarg;
+			break;
+		case 'r':
+			rate = strtoul(optarg, NULL, 10);
+			break;
+		case 'w':
+			warm = atoi(optarg);
+			break;
+		case 'u':
+			if (nallowed == AT_DAEMON_UIDS) {
+				usage();
+				return 1;
+			}
+			allowed[nallowed] = strtoul(optarg, &end, 10);
+			if (*optarg == '\0' || *end != '\0') {
+				usage();
+				return 1;
+			}
+			nallowed++;
+			break;
+		default:
+			usage();
+			return 1;
+		}
+	}
+	pool = createAutotalentPool(rate, warm, NULL);
+	if (pool == NULL) {
+		fprintf(stderr, "autotalentd: cannot create instances\n");
+		return 1;
+	}
+	listener = listenAutotalentDaemon(name);
+	if (listener < 0) {
+		perror("autotalentd: listen");
+		return 1;
+	}
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	for (;;) {
+		sock = accept(listener, NULL, NULL);
+		if (sock < 0) {
+			continue;
+		}
+		if (checkAutotalentPeer(sock, allowed, nallowed) != 0) {
+			close(sock);
+			continue;
+		}
+		session = calloc(1, sizeof(Session));
+		if (session != NULL) {
+			session->sock = sock;
+			session->instance = acquireAutotalent(pool);
+		}
+		if (session == NULL || session->instance == NULL
+		    || pthread_create(&thread, &attr, serveSession,
+				      session) != 0) {
+			if (session != NULL && session->instance != NULL) {
+				releaseAutotalent(session->instance);
+			}
+			free(session);
+			close(sock);
+		}
+	}
+}
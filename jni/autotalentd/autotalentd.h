@@ -0,0 +1,87 @@
+/* autotalentd.h
+ * Autotalent library for Android
+ *
+ * Protocol between autotalentd and its clients.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+/*****************************************************************************/
+#ifndef AUTOTALENTD_H
+#define AUTOTALENTD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/types.h>
+
+// Abstract UNIX socket name the daemon listens on by default
+#define AT_DAEMON_SOCKET "autotalentd"
+
+// Message types
+//   Each connection is one session with a warm instance of its own.  A
+//   client sends messages and gets an AT_MSG_DONE or AT_MSG_ERROR back for
+//   each AT_MSG_BUFFER and AT_MSG_PROCESS*, and nothing for the others.
+//   An AT_MSG_PROCESS longer than AT_MSG_MAX ends the session.
+#define AT_MSG_PARAM 1		// setAutotalentParameter(param, value)
+#define AT_MSG_KEY 2		// setAutotalentKey with param as the key
+#define AT_MSG_BUFFER 3		// a memfd of length samples, via SCM_RIGHTS,
+				// sealed with F_SEAL_SHRINK
+#define AT_MSG_PROCESS 4	// length samples follow, returned after DONE
+#define AT_MSG_PROCESS_SHARED 5	// process length samples in place in the memfd
+#define AT_MSG_DONE 6
+#define AT_MSG_ERROR 7
+
+#define AT_MSG_MAX 65536	// samples in one message at most
+
+// Memfd sealing, for headers older than Linux 3.17
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS 1033
+#define F_GET_SEALS 1034
+#define F_SEAL_SHRINK 0x0002
+#endif
+#ifndef MFD_ALLOW_SEALING
+#define MFD_ALLOW_SEALING 0x0002
+#endif
+
+// Fixed-size header of every message, in host byte order
+typedef struct {
+	uint32_t type;
+	uint32_t length;	// samples
+	int32_t param;
+	float value;
+} AutotalentMessage;
+
+// Read or write exactly size bytes; 0 on success
+int readAutotalentSocket(int sock, void *data, size_t size);
+
+int writeAutotalentSocket(int sock, const void *data, size_t size);
+
+// Send or receive one header, with a file descriptor alongside if fd is
+// not -1 (send) or not NULL (receive, set to -1 when none came)
+int sendAutotalentMessage(int sock, const AutotalentMessage * msg, int fd);
+
+int receiveAutotalentMessage(int sock, AutotalentMessage * msg, int *fd);
+
+// Connect to, or listen on, an abstract socket name
+int connectAutotalentDaemon(const char *name);
+
+int listenAutotalentDaemon(const char *name);
+
+// 0 if the peer of a connected socket runs as the caller's effective uid
+// or as one of count allowed uids, -1 if not or if it cannot be told
+int
+checkAutotalentPeer(int sock, const uid_t * allowed, int count);
+
+#endif
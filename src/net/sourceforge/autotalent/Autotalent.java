@@ -1,5 +1,9 @@
 package net.sourceforge.autotalent;
 
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.util.HashSet;
+
 public class Autotalent {
     private static final String AUTOTALENT_LIB = "autotalent";
 
@@ -7,45 +11,248 @@ public class Autotalent {
         System.loadLibrary(AUTOTALENT_LIB);
     }
 
+    // native instance owned by this object, 0 once destroyed
+    private long handle;
+
+    // buffers given to setBuffers, whose addresses the native instance
+    // keeps; held here so that the collector cannot free them under it
+    private ByteBuffer samplesBuffer;
+    private ByteBuffer instrumentalBuffer;
+    private ByteBuffer outputBuffer;
+
+    public Autotalent(int sampleRate) {
+        handle = instantiateAutotalent(sampleRate);
+    }
+
     public static native boolean getLiveCorrectionEnabled();
 
-    public static native void instantiateAutotalent(int sampleRate);
+    public void setConcertA(float concertA) {
+        setConcertA(handle, concertA);
+    }
+
+    public void setKey(char key) {
+        setKey(handle, key);
+    }
+
+    public void setFixedPitch(float pitch) {
+        setFixedPitch(handle, pitch);
+    }
+
+    public void setFixedPull(float pull) {
+        setFixedPull(handle, pull);
+    }
+
+    public void setCorrectionStrength(float strength) {
+        setCorrectionStrength(handle, strength);
+    }
+
+    public void setCorrectionSmoothness(float smooth) {
+        setCorrectionSmoothness(handle, smooth);
+    }
+
+    public void setPitchShift(float shift) {
+        setPitchShift(handle, shift);
+    }
+
+    public void setScaleRotate(int rotate) {
+        setScaleRotate(handle, rotate);
+    }
+
+    public void setLfoDepth(float depth) {
+        setLfoDepth(handle, depth);
+    }
+
+    public void setLfoRate(float rate) {
+        setLfoRate(handle, rate);
+    }
+
+    public void setLfoShape(float shape) {
+        setLfoShape(handle, shape);
+    }
+
+    public void setLfoSymmetric(float symmetric) {
+        setLfoSymmetric(handle, symmetric);
+    }
+
+    public void setLfoQuantization(int quantization) {
+        setLfoQuantization(handle, quantization);
+    }
+
+    public void setFormantCorrection(int correction) {
+        setFormantCorrection(handle, correction);
+    }
+
+    public void setFormantWarp(float warp) {
+        setFormantWarp(handle, warp);
+    }
+
+    public void setMix(float mix) {
+        setMix(handle, mix);
+    }
+
+    public void processSamples(short[] samples, int numSamples) {
+        processSamples(handle, samples, numSamples);
+    }
+
+    public void processSamples(short[] samples, short[] instrumental, int numSamples) {
+        processSamples(handle, samples, instrumental, numSamples);
+    }
+
+    // Returns a direct buffer of numSamples samples owned by this instance,
+    // valid until destroy(), or null once the instance has handed out eight.
+    public ByteBuffer createBuffer(int numSamples) {
+        ByteBuffer buffer = createBuffer(handle, numSamples);
+        return buffer != null ? buffer.order(ByteOrder.nativeOrder()) : null;
+    }
+
+    // Sets the direct buffers processBuffers works on; instrumental may be
+    // null, samples and output may be the same buffer. They are resolved
+    // once here, so processBuffers holds no JNI critical section. This
+    // object keeps them until they are replaced, or dropped with null.
+    public void setBuffers(ByteBuffer samples, ByteBuffer instrumental, ByteBuffer output) {
+        if (samples == null || output == null) {
+            samples = null;
+            instrumental = null;
+            output = null;
+        }
+        setBuffers(handle, samples, instrumental, output);
+        samplesBuffer = samples;
+        instrumentalBuffer = instrumental;
+        outputBuffer = output;
+    }
+
+    public void processBuffers(int numSamples) {
+        processBuffers(handle, numSamples);
+    }
+
+    // Starts a native engine thread processing blocks of blockSize samples
+    // from an input ring to an output ring of ringSamples each. Feed it with
+    // writeStream from one thread and drain it with readStream from one
+    // thread. Until stopStream, processSamples and processBuffers return
+    // without processing and processBatch refuses the instance.
+    public boolean startStream(int ringSamples, int blockSize) {
+        return startStream(handle, ringSamples, blockSize);
+    }
+
+    public void stopStream() {
+        stopStream(handle);
+    }
+
+    // Returns the number of samples queued; the rest did not fit
+    public int writeStream(short[] samples, int numSamples) {
+        return writeStream(handle, samples, numSamples);
+    }
+
+    // Returns the number of processed samples copied out
+    public int readStream(short[] samples, int numSamples) {
+        return readStream(handle, samples, numSamples);
+    }
+
+    // Fills stats with blocks processed, input samples dropped, output
+    // samples missed, and the samples in the input and output rings
+    public void getStreamStats(long[] stats) {
+        getStreamStats(handle, stats);
+    }
+
+    // Processes each samples[i] in place with instances[i], in one native
+    // call spread over all cores. An instance may appear only once, may
+    // not have a stream running, and each samples[i] must hold
+    // numSamples[i] samples; otherwise throws IllegalArgumentException.
+    public static void processBatch(Autotalent[] instances, short[][] samples, int[] numSamples) {
+        if (samples.length != instances.length || numSamples.length != instances.length) {
+            throw new IllegalArgumentException("instances, samples and numSamples differ in length");
+        }
+        long[] handles = new long[instances.length];
+        HashSet<Long> seen = new HashSet<Long>();
+        for (int i = 0; i < instances.length; i++) {
+            handles[i] = instances[i].handle;
+            if (handles[i] == 0) {
+                continue;
+            }
+            if (!seen.add(handles[i])) {
+                throw new IllegalArgumentException("instance " + i + " given twice");
+            }
+            if (samples[i] == null || numSamples[i] < 0 || numSamples[i] > samples[i].length) {
+                throw new IllegalArgumentException("samples " + i + " shorter than numSamples");
+            }
+        }
+        processBatch(handles, samples, numSamples, instances.length);
+    }
+
+    public synchronized void destroy() {
+        if (handle != 0) {
+            destroyAutotalent(handle);
+            handle = 0;
+        }
+        samplesBuffer = null;
+        instrumentalBuffer = null;
+        outputBuffer = null;
+    }
+
+    @Override
+    protected void finalize() throws Throwable {
+        try {
+            destroy();
+        } finally {
+            super.finalize();
+        }
+    }
+
+    private static native long instantiateAutotalent(int sampleRate);
+
+    private static native void setConcertA(long handle, float concertA);
+
+    private static native void setKey(long handle, char key);
+
+    private static native void setFixedPitch(long handle, float pitch);
+
+    private static native void setFixedPull(long handle, float pull);
+
+    private static native void setCorrectionStrength(long handle, float strength);
+
+    private static native void setCorrectionSmoothness(long handle, float smooth);
+
+    private static native void setPitchShift(long handle, float shift);
+
+    private static native void setScaleRotate(long handle, int rotate);
+
+    private static native void setLfoDepth(long handle, float depth);
 
-    public static native void setConcertA(float concertA);
+    private static native void setLfoRate(long handle, float rate);
 
-    public static native void setKey(char key);
+    private static native void setLfoShape(long handle, float shape);
 
-    public static native void setFixedPitch(float pitch);
+    private static native void setLfoSymmetric(long handle, float symmetric);
 
-    public static native void setFixedPull(float pull);
+    private static native void setLfoQuantization(long handle, int quantization);
 
-    public static native void setCorrectionStrength(float strength);
+    private static native void setFormantCorrection(long handle, int correction);
 
-    public static native void setCorrectionSmoothness(float smooth);
+    private static native void setFormantWarp(long handle, float warp);
 
-    public static native void setPitchShift(float shift);
+    private static native void setMix(long handle, float mix);
 
-    public static native void setScaleRotate(int rotate);
+    private static native void processSamples(long handle, short[] samples, int numSamples);
 
-    public static native void setLfoDepth(float depth);
+    private static native void processSamples(long handle, short[] samples, short[] instrumental, int numSamples);
 
-    public static native void setLfoRate(float rate);
+    private static native void processBatch(long[] handles, short[][] samples, int[] numSamples, int count);
 
-    public static native void setLfoShape(float shape);
+    private static native ByteBuffer createBuffer(long handle, int numSamples);
 
-    public static native void setLfoSymmetric(float symmetric);
+    private static native void setBuffers(long handle, ByteBuffer samples, ByteBuffer instrumental, ByteBuffer output);
 
-    public static native void setLfoQuantization(int quantization);
+    private static native void processBuffers(long handle, int numSamples);
 
-    public static native void setFormantCorrection(int correction);
+    private static native boolean startStream(long handle, int ringSamples, int blockSize);
 
-    public static native void setFormantWarp(float warp);
+    private static native void stopStream(long handle);
 
-    public static native void setMix(float mix);
+    private static native int writeStream(long handle, short[] samples, int numSamples);
 
-    public static native void processSamples(short[] samples, int numSamples);
+    private static native int readStream(long handle, short[] samples, int numSamples);
 
-    public static native void processSamples(short[] samples, short[] instrumental, int numSamples);
+    private static native void getStreamStats(long handle, long[] stats);
 
-    public static native void destroyAutotalent();
-}
\ No newline at end of file
+    private static native void destroyAutotalent(long handle);
+}
@@ -0,0 +1,137 @@
+/* bench-denormal.c
+ * Autotalent library for Android
+ *
+ * Cost of processing silence after voice, where the recursive filters
+ * decay into subnormals, against voice, with and without flushing.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+/*****************************************************************************/
+#include "autotalent.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#define RATE 44100
+#define BLOCK 256
+#define WARMUP (RATE * 2)	// samples of voice before each measurement
+
+static double getSeconds(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void fillVoice(short *buffer, unsigned long length)
+{
+	unsigned long ti;
+	double phase;
+
+	phase = 0;
+	for (ti = 0; ti < length; ti++) {
+		phase += (190 + 30 * sin(ti * 2e-4)) / RATE;
+		buffer[ti] = (short)(9000 * sin(2 * M_PI * phase) +
+				     3000 * sin(6 * M_PI * phase));
+	}
+}
+
+static void
+runBlocks(Autotalent * instance, short *input, short *output,
+	  unsigned long length)
+{
+	unsigned long done;
+
+	for (done = 0; done + BLOCK <= length; done += BLOCK) {
+		setAutotalentBuffers(instance, input + done, output + done);
+		runAutotalent(instance, BLOCK);
+	}
+}
+
+// Seconds of audio per second of processing over length samples of
+// input, after the instance has been warmed up on voice
+static double
+measure(short *voice, short *input, short *output, unsigned long length,
+	int flush)
+{
+	Autotalent *instance;
+	double start;
+	double elapsed;
+
+	instance = instantiateAutotalent(RATE);
+	setAutotalentParameter(instance, AT_PARAM_SHIFT, 2);
+	setAutotalentParameter(instance, AT_PARAM_FCORR, 1);
+	setAutotalentDenormalMode(instance, flush);
+	runBlocks(instance, voice, output, WARMUP);
+
+	start = getSeconds();
+	runBlocks(instance, input, output, length);
+	elapsed = getSeconds() - start;
+	cleanupAutotalent(instance);
+	return length / (double)RATE / elapsed;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long length;
+	short *voice;
+	short *silence;
+	short *output;
+	double rate[2][2];
+	int flush;
+	int opt;
+
+	length = RATE * 10;
+	while ((opt = getopt(argc, argv, "s:")) != -1) {
+		switch (opt) {
+		case 's':
+			length = RATE * strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr, "usage: bench-denormal [-s seconds]\n");
+			return 2;
+		}
+	}
+	voice = malloc((length + WARMUP) * sizeof(short));
+	silence = calloc(length, sizeof(short));
+	output = malloc((length + WARMUP) * sizeof(short));
+	if (voice == NULL || silence == NULL || output == NULL) {
+		return 1;
+	}
+	fillVoice(voice, length + WARMUP);
+
+	for (flush = 0; flush <= 1; flush++) {
+		rate[flush][0] = measure(voice, voice + WARMUP, output, length,
+					 flush);
+		rate[flush][1] = measure(voice, silence, output, length,
+					 flush);
+	}
+
+	printf("%lu s of input, %d-sample blocks\n", length / RATE, BLOCK);
+	printf("flush  x realtime voice  x realtime silence  "
+	       "cost silence/voice\n");
+	for (flush = 0; flush <= 1; flush++) {
+		printf("%5s  %16.1f  %18.1f  %18.2f\n", flush ? "on" : "off",
+		       rate[flush][0], rate[flush][1],
+		       rate[flush][0] / rate[flush][1]);
+	}
+	free(voice);
+	free(silence);
+	free(output);
+	return 0;
+}
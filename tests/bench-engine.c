@@ -0,0 +1,173 @@
+/* bench-engine.c
+ * Autotalent library for Android
+ *
+ * Engine scaling benchmark: the same streams on 1, 2, 4 ... workers,
+ * with a deadline of one queue of blocks on every block.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+/*****************************************************************************/
+#include "autotalent.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#define RATE 44100
+#define BLOCK 256
+#define QUEUE 8			// blocks each stream keeps in flight
+#define PER_WORKER 4		// streams per worker at the most workers
+
+typedef struct {
+	double rate;		// seconds of audio per second, over all streams
+	unsigned long misses;
+	unsigned long migrations;
+	unsigned long meanlatency;
+	unsigned long maxlatency;
+} Result;
+
+static double getSeconds(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Feed every stream blocks round robin from one thread, as a server
+// reading many sockets would, waiting on a stream only when its queue
+// is full
+static void
+measure(int workers, int streams, unsigned long blocks, short *input,
+	short *output, Result * result)
+{
+	AutotalentEngineReport report;
+	AutotalentEngine *engine;
+	Autotalent *instance;
+	unsigned long deadline;
+	unsigned long b;
+	double start;
+	short *out;
+	int *ids;
+	int i;
+
+	engine = createAutotalentEngine(workers, streams);
+	ids = calloc(streams, sizeof(int));
+	for (i = 0; i < streams; i++) {
+		instance = instantiateAutotalent(RATE);
+		setAutotalentParameter(instance, AT_PARAM_SHIFT, 1);
+		setAutotalentParameter(instance, AT_PARAM_FCORR, i % 2);
+		ids[i] = addAutotalentEngineStream(engine, instance);
+	}
+	deadline = 1000000UL * QUEUE * BLOCK / RATE;
+
+	start = getSeconds();
+	for (b = 0; b < blocks; b++) {
+		for (i = 0; i < streams; i++) {
+			out = output + ((size_t)i * QUEUE + b % QUEUE) * BLOCK;
+			while (submitAutotalentBlock(engine, ids[i],
+						     input + (b % 64) * BLOCK,
+						     out, BLOCK,
+						     deadline) != 0) {
+				waitAutotalentEngineStream(engine, ids[i]);
+			}
+		}
+	}
+	for (i = 0; i < streams; i++) {
+		waitAutotalentEngineStream(engine, ids[i]);
+	}
+	result->rate = (double)streams * blocks * BLOCK / RATE /
+	    (getSeconds() - start);
+
+	result->misses = 0;
+	result->migrations = 0;
+	result->meanlatency = 0;
+	result->maxlatency = 0;
+	for (i = 0; i < streams; i++) {
+		getAutotalentEngineReport(engine, ids[i], &report);
+		result->misses += report.misses;
+		result->migrations += report.migrations;
+		result->meanlatency += report.meanlatency / streams;
+		if (report.maxlatency > result->maxlatency) {
+			result->maxlatency = report.maxlatency;
+		}
+	}
+	destroyAutotalentEngine(engine);
+	free(ids);
+}
+
+int main(int argc, char **argv)
+{
+	short input[64 * BLOCK];
+	unsigned long blocks;
+	Result result;
+	short *output;
+	double base;
+	long cpus;
+	int maxworkers;
+	int workers;
+	int streams;
+	int opt;
+	int i;
+
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	maxworkers = cpus > 1 ? cpus : 2;
+	blocks = 500;
+	while ((opt = getopt(argc, argv, "t:b:")) != -1) {
+		switch (opt) {
+		case 't':
+			maxworkers = atoi(optarg);
+			break;
+		case 'b':
+			blocks = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr, "usage: bench-engine [-t workers] "
+				"[-b blocks]\n");
+			return 2;
+		}
+	}
+
+	for (i = 0; i < 64 * BLOCK; i++) {
+		input[i] = (short)(8000 * sin(i * 0.05) + (i * 7919) % 500);
+	}
+	streams = maxworkers * PER_WORKER;
+	output = calloc((size_t)streams * QUEUE * BLOCK, sizeof(short));
+
+	printf("%ld cpus, %d streams, %d-sample blocks, %d in flight each\n",
+	       cpus, streams, BLOCK, QUEUE);
+	printf("workers  x realtime  per worker  efficiency  misses  "
+	       "migrations  mean us  max us\n");
+	base = 0;
+	workers = 1;
+	for (;;) {
+		measure(workers, streams, blocks, input, output, &result);
+		if (workers == 1) {
+			base = result.rate;
+		}
+		printf("%7d  %10.1f  %10.1f  %9.0f%%  %6lu  %10lu  %7lu  %6lu\n",
+		       workers, result.rate, result.rate / workers,
+		       100 * result.rate / workers / base, result.misses,
+		       result.migrations, result.meanlatency,
+		       result.maxlatency);
+		if (workers == maxworkers) {
+			break;
+		}
+		workers = workers * 2 < maxworkers ? workers * 2 : maxworkers;
+	}
+	free(output);
+	return 0;
+}
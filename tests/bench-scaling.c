@@ -0,0 +1,202 @@
+/* bench-scaling.c
+ * Autotalent library for Android
+ *
+ * Multi-thread scaling benchmark: instances packed next to each other
+ * in memory, driven from different threads.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+/*****************************************************************************/
+#include "autotalent.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define RATE 44100
+#define BLOCK 256
+#define PER_THREAD 4		// instances each thread runs
+
+// Instances are interleaved across threads: instance i belongs to
+// thread i % threads, so neighbours in memory are run by different
+// threads, the worst case for false sharing.
+typedef struct {
+	Autotalent **instances;
+	int count;
+	int threads;
+	int index;
+	unsigned long blocks;
+	short *input;
+	pthread_t thread;
+} Worker;
+
+static volatile int controlQuit;
+static unsigned long controlCalls;
+
+static double getSeconds(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void *runWorker(void *arg)
+{
+	Worker *worker = arg;
+	short output[BLOCK];
+	unsigned long b;
+	int i;
+
+	prepareAutotalentThread(NULL);
+	for (b = 0; b < worker->blocks; b++) {
+		for (i = worker->index; i < worker->count;
+		     i += worker->threads) {
+			setAutotalentBuffers(worker->instances[i],
+					     worker->input + (b % 64) * BLOCK,
+					     output);
+			runAutotalent(worker->instances[i], BLOCK);
+		}
+	}
+	return NULL;
+}
+
+// Keeps writing parameters, as a UI moving a control on every instance
+static void *runControl(void *arg)
+{
+	Worker *worker = arg;
+	int i;
+
+	while (!controlQuit) {
+		for (i = 0; i < worker->count; i++) {
+			setAutotalentParameter(worker->instances[i],
+					       AT_PARAM_SHIFT,
+					       (controlCalls % 5) * 0.25);
+		}
+		controlCalls++;
+	}
+	return NULL;
+}
+
+// Seconds of audio per second of wall time, over all instances
+static double
+measure(int threads, unsigned long blocks, short *input, int control)
+{
+	Autotalent **instances;
+	Worker *workers;
+	Worker controller;
+	double start;
+	double elapsed;
+	int count;
+	int i;
+
+	count = threads * PER_THREAD;
+	instances = calloc(count, sizeof(Autotalent *));
+	workers = calloc(threads, sizeof(Worker));
+	for (i = 0; i < count; i++) {
+		instances[i] = instantiateAutotalent(RATE);
+		setAutotalentParameter(instances[i], AT_PARAM_SHIFT, 1);
+		setAutotalentParameter(instances[i], AT_PARAM_FCORR, i % 2);
+	}
+
+	controlQuit = 0;
+	controller.instances = instances;
+	controller.count = count;
+	if (control) {
+		pthread_create(&controller.thread, NULL, runControl,
+			       &controller);
+	}
+	start = getSeconds();
+	for (i = 0; i < threads; i++) {
+		workers[i].instances = instances;
+		workers[i].count = count;
+		workers[i].threads = threads;
+		workers[i].index = i;
+		workers[i].blocks = blocks;
+		workers[i].input = input;
+		pthread_create(&workers[i].thread, NULL, runWorker,
+			       &workers[i]);
+	}
+	for (i = 0; i < threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+	}
+	elapsed = getSeconds() - start;
+	if (control) {
+		controlQuit = 1;
+		pthread_join(controller.thread, NULL);
+	}
+
+	for (i = 0; i < count; i++) {
+		cleanupAutotalent(instances[i]);
+	}
+	free(instances);
+	free(workers);
+	return (double)count * blocks * BLOCK / RATE / elapsed;
+}
+
+int main(int argc, char **argv)
+{
+	short input[64 * BLOCK];
+	unsigned long blocks;
+	double base;
+	double rate;
+	long cpus;
+	int maxthreads;
+	int threads;
+	int control;
+	int opt;
+	int i;
+
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	maxthreads = cpus > 1 ? cpus : 2;
+	blocks = 1000;
+	while ((opt = getopt(argc, argv, "t:b:")) != -1) {
+		switch (opt) {
+		case 't':
+			maxthreads = atoi(optarg);
+			break;
+		case 'b':
+			blocks = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr, "usage: bench-scaling [-t threads] "
+				"[-b blocks]\n");
+			return 2;
+		}
+	}
+
+	for (i = 0; i < 64 * BLOCK; i++) {
+		input[i] = (short)(8000 * sin(i * 0.05) + (i * 7919) % 500);
+	}
+
+	printf("%ld cpus, %d instances per thread, %d-sample blocks\n",
+	       cpus, PER_THREAD, BLOCK);
+	printf("threads  control  x realtime  per thread  efficiency\n");
+	for (control = 0; control <= 1; control++) {
+		base = 0;
+		for (threads = 1; threads <= maxthreads; threads *= 2) {
+			rate = measure(threads, blocks, input, control);
+			if (threads == 1) {
+				base = rate;
+			}
+			printf("%7d  %7s  %10.1f  %10.1f  %9.0f%%\n", threads,
+			       control ? "yes" : "no", rate, rate / threads,
+			       100 * rate / threads / base);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,15 @@
+/* android/log.h
+ * Stand-in for the NDK logging header, for the host builds in tests/
+ */
+#ifndef AT_HOST_ANDROID_LOG_H
+#define AT_HOST_ANDROID_LOG_H
+
+#define ANDROID_LOG_DEBUG 3
+
+static inline int __android_log_print(int prio, const char *tag,
+				      const char *fmt, ...)
+{
+	return 0;
+}
+
+#endif
@@ -0,0 +1,192 @@
+/* test-analysis.c
+ * Autotalent library for Android
+ *
+ * Cached take analysis: renders with the cache match renders without it,
+ * also once the take runs on past the end of the cache, and damaged
+ * files are refused.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+/*****************************************************************************/
+#include "autotalent.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <unistd.h>
+
+#define RATE 44100
+#define CACHED 40000		// samples of the take in the file
+#define LENGTH 60000		// samples rendered
+
+#define CHECK(cond) \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+		return 1; \
+	}
+
+static short take[LENGTH];
+
+// The on-disk header, as autotalent-analysis.c writes it
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t fs;
+	uint32_t cbsize;
+	uint32_t hop;
+	uint32_t ford;
+	uint32_t flags;
+	uint32_t reserved;
+	uint64_t length;
+	uint64_t nhops;
+	uint64_t checksum;
+	uint64_t pitchoffset;
+	uint64_t formantoffset;
+	uint64_t latticeoffset;
+} Header;
+
+// Write size bytes of file with header in front to path and open it
+//   Returns whether openAutotalentAnalysis accepted it.
+static int
+accepts(const char *path, const char *file, size_t size,
+	const Header * header)
+{
+	AutotalentAnalysis *analysis;
+	FILE *f;
+
+	f = fopen(path, "wb");
+	fwrite(header, sizeof(*header), 1, f);
+	fwrite(file + sizeof(*header), size - sizeof(*header), 1, f);
+	fclose(f);
+	analysis = openAutotalentAnalysis(path);
+	closeAutotalentAnalysis(analysis);
+	return analysis != NULL;
+}
+
+// Damaged and crafted files are refused
+static int checkDamaged(const char *path)
+{
+	static char file[4 << 20];
+	Header good;
+	Header h;
+	size_t size;
+	FILE *f;
+
+	f = fopen(path, "rb");
+	CHECK(f != NULL);
+	size = fread(file, 1, sizeof(file), f);
+	fclose(f);
+	CHECK(size > sizeof(good) && size < sizeof(file));
+	memcpy(&good, file, sizeof(good));
+
+	CHECK(accepts(path, file, size, &good));
+	// truncated in the lattice
+	CHECK(!accepts(path, file, good.latticeoffset + sizeof(float), &good));
+	// a pitch table that wraps around the end of the address space
+	h = good;
+	h.pitchoffset = UINT64_MAX - 63;
+	CHECK(!accepts(path, file, size, &h));
+	// a pitch table that runs past the end while the formant one fits
+	h = good;
+	h.pitchoffset = size - 64;
+	CHECK(!accepts(path, file, size, &h));
+	// a formant table over the pitch table
+	h = good;
+	h.formantoffset = h.pitchoffset;
+	CHECK(!accepts(path, file, size, &h));
+	// a formant table running into the lattice
+	h = good;
+	h.formantoffset += 64;
+	CHECK(!accepts(path, file, size, &h));
+	// a lattice without a formant table
+	h = good;
+	h.formantoffset = 0;
+	CHECK(!accepts(path, file, size, &h));
+	// a length whose formant table overflows
+	h = good;
+	h.hop = 1;
+	h.length = UINT64_MAX / 4;
+	h.nhops = h.length + 1;
+	CHECK(!accepts(path, file, size, &h));
+	return 0;
+}
+
+// Render the take in calls of uneven length, so that one of them
+// straddles the end of the cache
+static void
+render(AutotalentAnalysis * analysis, short *output)
+{
+	Autotalent *instance;
+	unsigned long done;
+	unsigned long len;
+
+	instance = instantiateAutotalent(RATE);
+	setAutotalentParameter(instance, AT_PARAM_SHIFT, 3);
+	setAutotalentParameter(instance, AT_PARAM_FCORR, 1);
+	setAutotalentParameter(instance, AT_PARAM_FWARP, 0.3);
+	if (analysis != NULL) {
+		setAutotalentAnalysis(instance, analysis);
+	}
+	for (done = 0; done < LENGTH; done += len) {
+		len = 333 + done % 401;
+		if (len > LENGTH - done) {
+			len = LENGTH - done;
+		}
+		setAutotalentBuffers(instance, take + done, output + done);
+		runAutotalent(instance, len);
+	}
+	cleanupAutotalent(instance);
+}
+
+int main(void)
+{
+	static short plain[LENGTH];
+	static short cached[LENGTH];
+	AutotalentAnalysis *analysis;
+	char path[] = "/tmp/test-analysisXXXXXX";
+	int fd;
+	int i;
+
+	for (i = 0; i < LENGTH; i++) {
+		take[i] = (short)(8000 * sin(i * (0.03 + i * 1e-7)) +
+				  2500 * sin(i * 0.21));
+	}
+	fd = mkstemp(path);
+	CHECK(fd >= 0);
+	close(fd);
+	CHECK(writeAutotalentAnalysis(path, RATE, take, CACHED,
+				      AT_ANALYSIS_FORMANT) == 0);
+	analysis = openAutotalentAnalysis(path);
+	CHECK(analysis != NULL);
+	CHECK(checkDamaged(path) == 0);
+	unlink(path);
+
+	// only the take the file was made from is accepted
+	CHECK(checkAutotalentAnalysis(analysis, take, CACHED) == 0);
+	CHECK(checkAutotalentAnalysis(analysis, take, LENGTH) == -1);
+	take[CACHED / 2]++;
+	CHECK(checkAutotalentAnalysis(analysis, take, CACHED) == -1);
+	take[CACHED / 2]--;
+
+	render(NULL, plain);
+	render(analysis, cached);
+	CHECK(memcmp(plain, cached, CACHED * sizeof(short)) == 0);
+	CHECK(memcmp(plain, cached, LENGTH * sizeof(short)) == 0);
+
+	closeAutotalentAnalysis(analysis);
+	printf("ok\n");
+	return 0;
+}
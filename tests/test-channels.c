@@ -0,0 +1,84 @@
+/* test-channels.c
+ * Autotalent library for Android
+ *
+ * Channel groups: buffers for channels outside the group are ignored, a
+ * group runs only once every channel has its buffers, and channels fed
+ * the same take come out the same.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+/*****************************************************************************/
+#include "autotalent.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#define RATE 44100
+#define LENGTH (RATE / 2)
+#define COUNT 3
+
+#define CHECK(cond) \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+		return 1; \
+	}
+
+static short input[LENGTH];
+static short output[COUNT][LENGTH];
+static short untouched[LENGTH];
+
+int main(void)
+{
+	AutotalentChannels *channels;
+	short bogus[1];
+	int tc;
+	int i;
+
+	for (i = 0; i < LENGTH; i++) {
+		input[i] = (short)(8000 * sin(i * 0.03) + 1500 * sin(i * 0.21));
+	}
+	channels = createAutotalentChannels(RATE, COUNT, 0,
+					    AT_CHANNELS_SHARE_FORMANT);
+	CHECK(channels != NULL);
+	setAutotalentChannelsParameter(channels, AT_PARAM_SHIFT, 3);
+	setAutotalentChannelsParameter(channels, AT_PARAM_FCORR, 1);
+
+	// outside the group, on either side
+	setAutotalentChannelBuffers(channels, -1, bogus, bogus);
+	setAutotalentChannelBuffers(channels, COUNT, bogus, bogus);
+	setAutotalentChannelBuffers(channels, AT_CHANNELS_MAX, bogus, bogus);
+	setAutotalentChannelBuffers(channels, 1 << 20, bogus, bogus);
+
+	// the last channel has no buffers yet
+	for (tc = 0; tc < COUNT - 1; tc++) {
+		setAutotalentChannelBuffers(channels, tc, input, output[tc]);
+	}
+	runAutotalentChannels(channels, LENGTH);
+	for (tc = 0; tc < COUNT; tc++) {
+		CHECK(memcmp(output[tc], untouched, sizeof(untouched)) == 0);
+	}
+
+	setAutotalentChannelBuffers(channels, COUNT - 1, input,
+				    output[COUNT - 1]);
+	runAutotalentChannels(channels, LENGTH);
+	CHECK(memcmp(output[0], untouched, sizeof(untouched)) != 0);
+	for (tc = 1; tc < COUNT; tc++) {
+		CHECK(memcmp(output[tc], output[0], sizeof(output[0])) == 0);
+	}
+
+	destroyAutotalentChannels(channels);
+	printf("ok\n");
+	return 0;
+}
@@ -0,0 +1,113 @@
+/* test-compact.c
+ * Autotalent library for Android
+ *
+ * Compact instances: formant state comes and goes only through the
+ * control thread calls, and processing matches a full instance.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+/*****************************************************************************/
+#include "autotalent.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#define RATE 44100
+#define BLOCK 512
+#define BLOCKS 200
+
+#define CHECK(cond) \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+		return 1; \
+	}
+
+static short input[BLOCKS * BLOCK];
+
+static void
+runBlocks(Autotalent * instance, short *output, int first, int count)
+{
+	int b;
+
+	for (b = first; b < first + count; b++) {
+		setAutotalentBuffers(instance, input + b * BLOCK,
+				     output + b * BLOCK);
+		runAutotalent(instance, BLOCK);
+	}
+}
+
+int main(void)
+{
+	static short full[BLOCKS * BLOCK];
+	static short compact[BLOCKS * BLOCK];
+	AutotalentFootprint footprint;
+	Autotalent *a;
+	Autotalent *b;
+	unsigned long count;
+	int i;
+
+	for (i = 0; i < BLOCKS * BLOCK; i++) {
+		input[i] = (short)(9000 * sin(i * 0.031) + 3000 * sin(i * 0.17));
+	}
+	prepareAutotalentThread(NULL);
+
+	a = instantiateAutotalent(RATE);
+	b = instantiateCompactAutotalent(RATE, NULL);
+	CHECK(a != NULL && b != NULL);
+	setAutotalentParameter(a, AT_PARAM_SHIFT, 2);
+	setAutotalentParameter(b, AT_PARAM_SHIFT, 2);
+
+	// without formant state neither setters nor events allocate
+	count = getAutotalentAllocCount();
+	setAutotalentParameter(b, AT_PARAM_FCORR, 1);
+	CHECK(queueAutotalentEvent(b, AT_PARAM_FCORR, 0, 1, 0) == -1);
+	CHECK(getAutotalentAllocCount() == count);
+	setAutotalentParameter(b, AT_PARAM_FCORR, 0);
+
+	// enabled before the first call, it matches a full instance
+	setAutotalentParameter(a, AT_PARAM_FCORR, 1);
+	setAutotalentParameter(b, AT_PARAM_FCORR, 1);
+	CHECK(enableAutotalentFormant(b) == 0);
+	CHECK(getAutotalentAllocCount() == count + 1);
+	CHECK(queueAutotalentEvent(b, AT_PARAM_FCORR, 100, 1, 0) == 0);
+	runBlocks(a, full, 0, BLOCKS / 2);
+	runBlocks(b, compact, 0, BLOCKS / 2);
+	CHECK(getAutotalentAllocCount() == count + 1);
+	CHECK(memcmp(full, compact, sizeof(short) * BLOCK * BLOCKS / 2) == 0);
+
+	// released only once the audio thread has let go of it
+	setAutotalentParameter(b, AT_PARAM_FCORR, 0);
+	CHECK(releaseAutotalentFormant(b) == 1);
+	runBlocks(b, compact, BLOCKS / 2, 1);
+	CHECK(releaseAutotalentFormant(b) == 1);
+	runBlocks(b, compact, BLOCKS / 2 + 1, 1);
+	CHECK(releaseAutotalentFormant(b) == 0);
+	getAutotalentFootprint(b, &footprint);
+	CHECK(footprint.formant == 0);
+	CHECK(queueAutotalentEvent(b, AT_PARAM_FCORR, 0, 1, 0) == -1);
+	runBlocks(b, compact, BLOCKS / 2 + 2, 10);
+
+	// and can be given back
+	CHECK(enableAutotalentFormant(b) == 0);
+	setAutotalentParameter(b, AT_PARAM_FCORR, 1);
+	runBlocks(b, compact, BLOCKS / 2 + 12, 10);
+	getAutotalentFootprint(b, &footprint);
+	CHECK(footprint.formant != 0);
+
+	cleanupAutotalent(a);
+	cleanupAutotalent(b);
+	printf("ok\n");
+	return 0;
+}
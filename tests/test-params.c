@@ -0,0 +1,86 @@
+/* test-params.c
+ * Autotalent library for Android
+ *
+ * Parameter mailbox: a value the control thread sets takes over from
+ * automation, even when it is the value it had set before.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+/*****************************************************************************/
+#include "autotalent.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#define RATE 44100
+#define BLOCK 512
+#define BLOCKS 40
+
+#define CHECK(cond) \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+		return 1; \
+	}
+
+static short input[BLOCKS * BLOCK];
+
+static void
+runBlocks(Autotalent * instance, short *output, int first, int count)
+{
+	int b;
+
+	for (b = first; b < first + count; b++) {
+		setAutotalentBuffers(instance, input + b * BLOCK,
+				     output + b * BLOCK);
+		runAutotalent(instance, BLOCK);
+	}
+}
+
+int main(void)
+{
+	static short automated[BLOCKS * BLOCK];
+	static short set[BLOCKS * BLOCK];
+	Autotalent *a;
+	Autotalent *b;
+	int i;
+
+	for (i = 0; i < BLOCKS * BLOCK; i++) {
+		input[i] = (short)(8000 * sin(i * (0.03 + i * 1e-7)) +
+				   2000 * sin(i * 0.17));
+	}
+	a = instantiateAutotalent(RATE);
+	b = instantiateAutotalent(RATE);
+	CHECK(a != NULL && b != NULL);
+
+	// a moves away from its shift by automation, b by its setter
+	setAutotalentParameter(a, AT_PARAM_SHIFT, 2);
+	CHECK(queueAutotalentEvent(a, AT_PARAM_SHIFT, 0, 5, 0) == 0);
+	setAutotalentParameter(b, AT_PARAM_SHIFT, 5);
+	runBlocks(a, automated, 0, BLOCKS / 2);
+	runBlocks(b, set, 0, BLOCKS / 2);
+	CHECK(memcmp(automated, set, sizeof(set) / 2) == 0);
+
+	// setting 2 again brings a back, although 2 is what it last published
+	setAutotalentParameter(a, AT_PARAM_SHIFT, 2);
+	setAutotalentParameter(b, AT_PARAM_SHIFT, 2);
+	runBlocks(a, automated, BLOCKS / 2, BLOCKS / 2);
+	runBlocks(b, set, BLOCKS / 2, BLOCKS / 2);
+	CHECK(memcmp(automated, set, sizeof(set)) == 0);
+
+	cleanupAutotalent(a);
+	cleanupAutotalent(b);
+	printf("ok\n");
+	return 0;
+}
@@ -0,0 +1,118 @@
+/* test-pool.c
+ * Autotalent library for Android
+ *
+ * Instance pools: a released instance comes back to the next session
+ * with nothing of the previous one, neither its settings nor what it
+ * handed the instance, and renders as a new instance does.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+/*****************************************************************************/
+#include "autotalent.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#define RATE 44100
+#define LENGTH 30000
+
+#define CHECK(cond) \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+		return 1; \
+	}
+
+static short take[LENGTH];
+static short other[LENGTH];
+
+static void render(Autotalent * instance, const short *input, short *output)
+{
+	setAutotalentBuffers(instance, (short *)input, output);
+	runAutotalent(instance, LENGTH);
+}
+
+int main(void)
+{
+	static short pooled[LENGTH];
+	static short fresh[LENGTH];
+	AutotalentAnalysis *analysis;
+	AutotalentPool *pool;
+	Autotalent *first;
+	Autotalent *second;
+	Autotalent *plain;
+	char path[] = "/tmp/test-poolXXXXXX";
+	int fd;
+	int i;
+
+	for (i = 0; i < LENGTH; i++) {
+		take[i] = (short)(8000 * sin(i * 0.03) + 2000 * sin(i * 0.23));
+		other[i] = (short)(6000 * sin(i * (0.02 + i * 1e-7)));
+	}
+	fd = mkstemp(path);
+	CHECK(fd >= 0);
+	close(fd);
+	CHECK(writeAutotalentAnalysis(path, RATE, take, LENGTH,
+				      AT_ANALYSIS_FORMANT) == 0);
+	analysis = openAutotalentAnalysis(path);
+	unlink(path);
+	CHECK(analysis != NULL);
+
+	// a reset keeps what the host handed the instance
+	plain = instantiateAutotalent(RATE);
+	CHECK(setAutotalentAnalysis(plain, analysis) == 0);
+	setAutotalentDenormalMode(plain, 1);
+	setAutotalentBuffers(plain, take, fresh);
+	resetAutotalent(plain);
+	CHECK(plain->analysis == analysis);
+	CHECK(plain->flushdenormals == 1);
+	CHECK(plain->m_pfInputBuffer1 == take);
+	cleanupAutotalent(plain);
+
+	// a session renders its take with the cache, then ends and closes it
+	pool = createAutotalentPool(RATE, 1, NULL);
+	CHECK(pool != NULL);
+	first = acquireAutotalent(pool);
+	CHECK(first != NULL);
+	setAutotalentParameter(first, AT_PARAM_SHIFT, 3);
+	setAutotalentParameter(first, AT_PARAM_FCORR, 1);
+	CHECK(setAutotalentAnalysis(first, analysis) == 0);
+	setAutotalentDenormalMode(first, 1);
+	render(first, take, pooled);
+	releaseAutotalent(first);
+	closeAutotalentAnalysis(analysis);
+
+	// the next session gets the same instance with nothing of that one
+	second = acquireAutotalent(pool);
+	CHECK(second == first);
+	CHECK(second->analysis == NULL);
+	CHECK(second->flushdenormals == 0);
+	CHECK(second->m_pfInputBuffer1 == NULL);
+	CHECK(second->m_pfOutputBuffer1 == NULL);
+	setAutotalentParameter(second, AT_PARAM_FCORR, 1);
+	render(second, other, pooled);
+
+	plain = instantiateAutotalent(RATE);
+	setAutotalentParameter(plain, AT_PARAM_FCORR, 1);
+	render(plain, other, fresh);
+	CHECK(memcmp(pooled, fresh, sizeof(fresh)) == 0);
+
+	cleanupAutotalent(plain);
+	releaseAutotalent(second);
+	destroyAutotalentPool(pool);
+	printf("ok\n");
+	return 0;
+}
@@ -0,0 +1,120 @@
+/* test-render.c
+ * Autotalent library for Android
+ *
+ * Offline rendering with seeking: renders restored from checkpoints
+ * match a straight render, and checkpoints are smaller than snapshots.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+/*****************************************************************************/
+#include "autotalent.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define RATE 44100
+#define LENGTH (RATE * 6)
+#define INTERVAL (RATE / 2)
+#define SEEKS 40
+
+#define CHECK(cond) \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+		return 1; \
+	}
+
+static short take[LENGTH];
+static short straight[LENGTH];
+static short sought[LENGTH];
+
+static void setup(Autotalent * instance, int fcorr)
+{
+	setAutotalentParameter(instance, AT_PARAM_SHIFT, 2);
+	setAutotalentParameter(instance, AT_PARAM_FCORR, fcorr);
+	setAutotalentParameter(instance, AT_PARAM_FWARP, 0.2);
+	setAutotalentParameter(instance, AT_PARAM_MIX, 0.7);
+	setAutotalentParameter(instance, AT_PARAM_LFOAMP, 0.5);
+}
+
+// Seek around a take after a first pass, comparing with a straight run
+static int seek(Autotalent * instance, Autotalent * plain, int fcorr)
+{
+	AutotalentRenderer *renderer;
+	unsigned long start;
+	unsigned long count;
+	unsigned long done;
+	int i;
+
+	setup(instance, fcorr);
+	setup(plain, fcorr);
+	resetAutotalent(plain);
+	setAutotalentBuffers(plain, take, straight);
+	runAutotalent(plain, LENGTH);
+
+	renderer = createAutotalentRenderer(instance, take, LENGTH, INTERVAL);
+	CHECK(renderer != NULL);
+	CHECK(renderAutotalent(renderer, 0, LENGTH, NULL) == LENGTH);
+	printf("%s, formant correction %s: checkpoint %lu bytes, "
+	       "snapshot %lu bytes\n", instance->compact ? "compact" : "full",
+	       fcorr ? "on" : "off",
+	       (unsigned long)getAutotalentCheckpointSize(instance),
+	       (unsigned long)getAutotalentStateSize(instance));
+	CHECK(getAutotalentCheckpointSize(instance) <
+	      getAutotalentStateSize(instance));
+
+	// backwards and forwards, so restores land on arbitrary scratch
+	srand(7);
+	for (i = 0; i < SEEKS; i++) {
+		start = (unsigned long)rand() % LENGTH;
+		count = 1 + (unsigned long)rand() % 20000;
+		done = renderAutotalent(renderer, start, count, sought);
+		CHECK(memcmp(sought, straight + start,
+			     done * sizeof(short)) == 0);
+	}
+	destroyAutotalentRenderer(renderer);
+	return 0;
+}
+
+int main(void)
+{
+	Autotalent *instance;
+	Autotalent *plain;
+	int i;
+
+	for (i = 0; i < LENGTH; i++) {
+		take[i] = (short)(8000 * sin(i * (0.03 + i * 1e-8)) +
+				  (i * 7919) % 700);
+	}
+
+	instance = instantiateAutotalent(RATE);
+	plain = instantiateAutotalent(RATE);
+	CHECK(seek(instance, plain, 1) == 0);
+	cleanupAutotalent(instance);
+	cleanupAutotalent(plain);
+
+	instance = instantiateCompactAutotalent(RATE, NULL);
+	plain = instantiateCompactAutotalent(RATE, NULL);
+	CHECK(instance != NULL && plain != NULL);
+	CHECK(seek(instance, plain, 0) == 0);
+	CHECK(enableAutotalentFormant(instance) == 0);
+	CHECK(enableAutotalentFormant(plain) == 0);
+	CHECK(seek(instance, plain, 1) == 0);
+	cleanupAutotalent(instance);
+	cleanupAutotalent(plain);
+
+	printf("ok\n");
+	return 0;
+}
@@ -0,0 +1,117 @@
+/* test-state.c
+ * Autotalent library for Android
+ *
+ * State snapshots: a restored instance carries on exactly as a fresh one
+ * given the same snapshot, whatever state it held before.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+/*****************************************************************************/
+#include "autotalent.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define RATE 44100
+#define BLOCK 512
+#define BLOCKS 100
+
+#define CHECK(cond) \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+		return 1; \
+	}
+
+static short input[BLOCKS * BLOCK];
+
+static void
+runBlocks(Autotalent * instance, short *output, int first, int count)
+{
+	int b;
+
+	for (b = first; b < first + count; b++) {
+		setAutotalentBuffers(instance, input + b * BLOCK,
+				     output + b * BLOCK);
+		runAutotalent(instance, BLOCK);
+	}
+}
+
+static Autotalent *createCompact(int fcorr)
+{
+	Autotalent *instance;
+
+	instance = instantiateCompactAutotalent(RATE, NULL);
+	setAutotalentParameter(instance, AT_PARAM_SHIFT, -1);
+	if (fcorr) {
+		enableAutotalentFormant(instance);
+		setAutotalentParameter(instance, AT_PARAM_FCORR, 1);
+	}
+	return instance;
+}
+
+int main(void)
+{
+	static short a[BLOCKS * BLOCK];
+	static short b[BLOCKS * BLOCK];
+	Autotalent *source;
+	Autotalent *used;
+	Autotalent *fresh;
+	Autotalent *clone;
+	size_t size;
+	void *state;
+	int i;
+
+	for (i = 0; i < BLOCKS * BLOCK; i++) {
+		input[i] = (short)(7000 * sin(i * 0.043) + 2000 * sin(i * 0.29));
+	}
+
+	// a snapshot taken with no formant state
+	source = createCompact(0);
+	runBlocks(source, a, 0, BLOCKS / 2);
+	size = getAutotalentStateSize(source);
+	state = malloc(size);
+	CHECK(saveAutotalentState(source, state, size) == size);
+
+	// restored into one that has been correcting, and one that has not
+	used = createCompact(1);
+	runBlocks(used, a, 0, BLOCKS / 2);
+	fresh = createCompact(1);
+	CHECK(restoreAutotalentState(used, state, size) == 0);
+	CHECK(restoreAutotalentState(fresh, state, size) == 0);
+	setAutotalentParameter(used, AT_PARAM_FCORR, 1);
+	setAutotalentParameter(fresh, AT_PARAM_FCORR, 1);
+	runBlocks(used, a, BLOCKS / 2, BLOCKS / 2);
+	runBlocks(fresh, b, BLOCKS / 2, BLOCKS / 2);
+	CHECK(memcmp(a + BLOCKS / 2 * BLOCK, b + BLOCKS / 2 * BLOCK,
+		     sizeof(short) * BLOCK * BLOCKS / 2) == 0);
+
+	// a clone carries on as its original
+	clone = cloneAutotalent(used);
+	CHECK(clone != NULL);
+	setAutotalentBuffers(clone, input, a);
+	setAutotalentBuffers(used, input, b);
+	runAutotalent(clone, BLOCK * 4);
+	runAutotalent(used, BLOCK * 4);
+	CHECK(memcmp(a, b, sizeof(short) * BLOCK * 4) == 0);
+
+	cleanupAutotalent(source);
+	cleanupAutotalent(used);
+	cleanupAutotalent(fresh);
+	cleanupAutotalent(clone);
+	free(state);
+	printf("ok\n");
+	return 0;
+}
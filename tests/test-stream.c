@@ -0,0 +1,136 @@
+/* test-stream.c
+ * Autotalent library for Android
+ *
+ * Real-time engine: a synthetic source and sink driven at audio rate,
+ * checking for dropouts and that the output matches a plain render.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+/*****************************************************************************/
+#include "autotalent.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+
+#define RATE 44100
+#define PERIOD 256		// samples the source and sink move per period
+#define BLOCK 128		// samples the engine processes at a time
+#define RING 4096
+#define PRIME 8			// periods the sink starts behind the source
+#define LENGTH (PERIOD * 512)	// about three seconds
+
+#define CHECK(cond) \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+		return 1; \
+	}
+
+static short take[LENGTH];
+static short streamed[LENGTH];
+static AutotalentStream *stream;
+static struct timespec epoch;
+static unsigned long maxfill;
+
+// Sleep until period number n after the epoch
+static void waitPeriod(unsigned long n)
+{
+	struct timespec ts;
+	unsigned long long ns;
+
+	ns = epoch.tv_nsec + n * PERIOD * 1000000000ULL / RATE;
+	ts.tv_sec = epoch.tv_sec + ns / 1000000000ULL;
+	ts.tv_nsec = ns % 1000000000ULL;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL)) ;
+}
+
+static void *runSource(void *arg)
+{
+	unsigned long n;
+
+	for (n = 0; n * PERIOD < LENGTH; n++) {
+		waitPeriod(n);
+		writeAutotalentStream(stream, take + n * PERIOD, PERIOD);
+	}
+	return NULL;
+}
+
+static void *runSink(void *arg)
+{
+	AutotalentStreamStats stats;
+	unsigned long done;
+	unsigned long n;
+
+	done = 0;
+	for (n = PRIME; done < LENGTH; n++) {
+		waitPeriod(n);
+		getAutotalentStreamStats(stream, &stats);
+		if (stats.outputfill > maxfill) {
+			maxfill = stats.outputfill;
+		}
+		done += readAutotalentStream(stream, streamed + done, PERIOD);
+	}
+	return NULL;
+}
+
+int main(void)
+{
+	static short rendered[LENGTH];
+	AutotalentStreamStats stats;
+	Autotalent *instance;
+	Autotalent *plain;
+	pthread_t source;
+	pthread_t sink;
+	unsigned long done;
+	int i;
+
+	for (i = 0; i < LENGTH; i++) {
+		take[i] = (short)(8000 * sin(i * (0.02 + i * 2e-8)) +
+				  1500 * sin(i * 0.37));
+	}
+
+	instance = instantiateAutotalent(RATE);
+	plain = instantiateAutotalent(RATE);
+	setAutotalentParameter(instance, AT_PARAM_SHIFT, -2);
+	setAutotalentParameter(plain, AT_PARAM_SHIFT, -2);
+	stream = startAutotalentStream(instance, RING, BLOCK);
+	CHECK(stream != NULL);
+
+	clock_gettime(CLOCK_MONOTONIC, &epoch);
+	pthread_create(&source, NULL, runSource, NULL);
+	pthread_create(&sink, NULL, runSink, NULL);
+	pthread_join(source, NULL);
+	pthread_join(sink, NULL);
+	getAutotalentStreamStats(stream, &stats);
+	stopAutotalentStream(stream);
+
+	printf("%lu blocks, %lu overruns, %lu underruns, output ring held "
+	       "at most %lu samples\n", stats.blocks, stats.overruns,
+	       stats.underruns, maxfill);
+	CHECK(stats.overruns == 0);
+	CHECK(stats.underruns == 0);
+
+	for (done = 0; done < LENGTH; done += BLOCK) {
+		setAutotalentBuffers(plain, take + done, rendered + done);
+		runAutotalent(plain, BLOCK);
+	}
+	CHECK(memcmp(streamed, rendered, sizeof(rendered)) == 0);
+
+	cleanupAutotalent(instance);
+	cleanupAutotalent(plain);
+	printf("ok\n");
+	return 0;
+}
@@ -0,0 +1,206 @@
+/* test-transport.c
+ * Autotalent library for Android
+ *
+ * Shared-memory transport between a host and a worker process: output
+ * matches a local render, the round trip of each block is measured, and
+ * a host whose worker is killed gets a short read instead of hanging.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+/*****************************************************************************/
+#include "autotalent.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#define RATE 44100
+#define BLOCK 256
+#define RING 4096
+#define BLOCKS 2000
+
+#define CHECK(cond) \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+		return 1; \
+	}
+
+static short take[BLOCKS * BLOCK];
+static short output[BLOCKS * BLOCK];
+static short rendered[BLOCKS * BLOCK];
+static double latencies[BLOCKS];
+
+static double getMicroseconds(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec * 1e-3;
+}
+
+static int compareDoubles(const void *a, const void *b)
+{
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+// The worker process: serve the region with an instance of its own
+static int runWorker(int fd)
+{
+	AutotalentTransport *transport;
+	Autotalent *instance;
+	int result;
+
+	transport = openAutotalentTransport(fd);
+	if (transport == NULL) {
+		return 1;
+	}
+	instance =
+	    instantiateAutotalent(getAutotalentTransportRate(transport));
+	if (instance == NULL) {
+		return 1;
+	}
+	result = serveAutotalentTransport(transport, instance);
+	cleanupAutotalent(instance);
+	closeAutotalentTransport(transport);
+	return result;
+}
+
+static int openShared(void)
+{
+	int fd = -1;
+
+#ifdef __NR_memfd_create
+	fd = syscall(__NR_memfd_create, "test-transport", 0);
+#endif
+	return fd;
+}
+
+// Kill a worker mid-run: the host's blocking read has to come back short
+static int checkKilled(void)
+{
+	AutotalentTransport *transport;
+	double start;
+	pid_t worker;
+	int status;
+	int fd;
+	int b;
+
+	fd = openShared();
+	CHECK(fd >= 0);
+	transport = createAutotalentTransport(fd, RATE, RING, BLOCK);
+	CHECK(transport != NULL);
+	worker = fork();
+	CHECK(worker >= 0);
+	if (worker == 0) {
+		_exit(runWorker(fd));
+	}
+	for (b = 0; b < 10; b++) {
+		CHECK(writeAutotalentTransport(transport, take + b * BLOCK,
+					       BLOCK) == BLOCK);
+		CHECK(readAutotalentTransport(transport, output + b * BLOCK,
+					      BLOCK, 1) == BLOCK);
+	}
+	CHECK(checkAutotalentTransport(transport) == 0);
+
+	kill(worker, SIGKILL);
+	CHECK(waitpid(worker, &status, 0) == worker);
+	start = getMicroseconds();
+	CHECK(writeAutotalentTransport(transport, take, BLOCK) == BLOCK);
+	CHECK(readAutotalentTransport(transport, output, BLOCK, 1) < BLOCK);
+	CHECK(getMicroseconds() - start < 5e6);
+	CHECK(checkAutotalentTransport(transport) == -1);
+	// and stays lost, without waiting again
+	start = getMicroseconds();
+	CHECK(readAutotalentTransport(transport, output, BLOCK, 1) < BLOCK);
+	CHECK(getMicroseconds() - start < 1e5);
+
+	closeAutotalentTransport(transport);
+	close(fd);
+	return 0;
+}
+
+int main(void)
+{
+	AutotalentTransport *transport;
+	Autotalent *plain;
+	double start;
+	pid_t worker;
+	int status;
+	int fd;
+	int b;
+	int i;
+
+	for (i = 0; i < BLOCKS * BLOCK; i++) {
+		take[i] = (short)(8000 * sin(i * (0.025 + i * 1e-8)) +
+				  2000 * sin(i * 0.19));
+	}
+
+	fd = openShared();
+	CHECK(fd >= 0);
+	transport = createAutotalentTransport(fd, RATE, RING, BLOCK);
+	CHECK(transport != NULL);
+	setAutotalentTransportParameter(transport, AT_PARAM_SHIFT, 4);
+	setAutotalentTransportParameter(transport, AT_PARAM_FCORR, 1);
+
+	worker = fork();
+	CHECK(worker >= 0);
+	if (worker == 0) {
+		_exit(runWorker(fd));
+	}
+
+	// one block in flight at a time, as a host with the tightest latency
+	for (b = 0; b < BLOCKS; b++) {
+		start = getMicroseconds();
+		CHECK(writeAutotalentTransport(transport, take + b * BLOCK,
+					       BLOCK) == BLOCK);
+		CHECK(readAutotalentTransport(transport, output + b * BLOCK,
+					      BLOCK, 1) == BLOCK);
+		latencies[b] = getMicroseconds() - start;
+	}
+	stopAutotalentTransport(transport);
+	CHECK(waitpid(worker, &status, 0) == worker);
+	CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+	qsort(latencies, BLOCKS, sizeof(double), compareDoubles);
+	printf("round trip of a %d-sample block (%.0f us of audio): "
+	       "median %.0f us, 99%% %.0f us, max %.0f us\n", BLOCK,
+	       BLOCK * 1e6 / RATE, latencies[BLOCKS / 2],
+	       latencies[BLOCKS * 99 / 100], latencies[BLOCKS - 1]);
+
+	plain = instantiateAutotalent(RATE);
+	setAutotalentParameter(plain, AT_PARAM_SHIFT, 4);
+	setAutotalentParameter(plain, AT_PARAM_FCORR, 1);
+	for (b = 0; b < BLOCKS; b++) {
+		setAutotalentBuffers(plain, take + b * BLOCK,
+				     rendered + b * BLOCK);
+		runAutotalent(plain, BLOCK);
+	}
+	CHECK(memcmp(output, rendered, sizeof(rendered)) == 0);
+
+	cleanupAutotalent(plain);
+	closeAutotalentTransport(transport);
+	close(fd);
+	CHECK(checkKilled() == 0);
+	printf("ok\n");
+	return 0;
+}